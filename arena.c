@@ -1,105 +1,252 @@
 #ifndef ARENA_C
 #define ARENA_C
 
-struct Arena
+// Bump allocator over a chain of blocks. A full block is never moved or grown, the next
+// allocation starts a new block in front of it, so pointers stay valid until the memory is
+// handed back with restore_arena/clear_arena/deinit_arena. Memory is not zeroed.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* TYPES */
+#define ARENA_BLOCK_MIN 4096
+#define ARENA_BLOCK_MAX (1024 * 1024) // blocks double up to this, bigger allocations get their own block
+
+struct ArenaBlock
 {
+  struct ArenaBlock *prev;
   uint length;
   uint capacity;
-  char *buffer;
+  char data[];
+};
+
+// data starts right after the header, keep it aligned like malloc
+static_assert(sizeof(struct ArenaBlock) % alignof(max_align_t) == 0, "arena block data must stay aligned");
+
+struct Arena
+{
+  struct ArenaBlock *block; // newest
+  uint block_size; // capacity of the next block
+  uint length; // bytes handed out over every block, padding included
 };
 
+struct ArenaMark
+{
+  struct ArenaBlock *block;
+  uint block_length;
+  uint length;
+  uint8_t latch; // for ARENA_SCOPE
+};
+
+/* HELPERS */
+static inline struct ArenaBlock *
+arena_push_block(
+    struct Arena *a,
+    uint min_capacity)
+{
+  uint capacity = Max(a->block_size, min_capacity);
+  if(capacity > UINT32_MAX - sizeof(struct ArenaBlock)) { return NULL; }
+
+  struct ArenaBlock *b = malloc(sizeof(*b) + capacity);
+  if(b == NULL) { return NULL; }
+  b->prev = a->block;
+  b->length = 0;
+  b->capacity = capacity;
+  a->block = b;
+  if(a->block_size < ARENA_BLOCK_MAX) { a->block_size = Min(a->block_size * 2, ARENA_BLOCK_MAX); }
+  return b;
+}
+
+// padding that aligns the next byte of b
 static inline uint
-amount_free_arena(
-    struct Arena *a)
+arena_pad(
+    struct ArenaBlock const *b,
+    uint align)
 {
-  return a->capacity - a->length;
+  return (uint)(-(uintptr_t)(b->data + b->length) & ((uintptr_t)align - 1));
 }
 
+// the current block is full, start a new one that surely fits
+__attribute__((noinline, cold))
+static void *
+arena_push_slow(
+    struct Arena *a,
+    uint size,
+    uint align)
+{
+  if(size > UINT32_MAX - align) { return NULL; }
+  struct ArenaBlock *b = arena_push_block(a, size + align - 1);
+  if(b == NULL) { return NULL; }
+
+  uint pad = arena_pad(b, align);
+  void *out = b->data + pad;
+  b->length = pad + size;
+  a->length += pad + size;
+  return out;
+}
+
+/* API */
+// block_size is the capacity of the first block, later blocks double
 static inline uint
 init_arena(
     struct Arena *a,
-    uint capacity)
+    uint block_size)
 {
-  a->capacity = capacity;
+  a->block = NULL;
+  a->block_size = Max(block_size, ARENA_BLOCK_MIN);
   a->length = 0;
-  a->buffer = calloc(a->capacity, sizeof(char)); // arbitary size for our command strings
-  return a->buffer != NULL;
+  return arena_push_block(a, 0) != NULL;
 }
 
 static inline void
 deinit_arena(
     struct Arena *a)
 {
-  free(a->buffer);
-  a->buffer = NULL; // "waste" one cpu cycle
-}
-
-static inline uint
-alloc_arena(
-    struct Arena *a,
-    uint size)
-{
-  if(size <= 0 || size > amount_free_arena(a)) { return 0; }
-
-  a->length += size;
-  return 1;
+  struct ArenaBlock *b = a->block;
+  while(b != NULL)
+  {
+    struct ArenaBlock *prev = b->prev;
+    free(b);
+    b = prev;
+  }
+  a->block = NULL;
+  a->length = 0;
 }
 
-static inline uint
-free_arena(
+// align must be a power of 2, NULL only when malloc fails
+static inline void *
+push_arena(
     struct Arena *a,
-    uint size)
+    uint size,
+    uint align)
 {
-  if(a->length < size)
+  struct ArenaBlock *b = a->block;
+  if(b != NULL)
   {
-    a->length = 0;
-    return 1;
+    uint pad = arena_pad(b, align);
+    uint free_len = b->capacity - b->length;
+    if(pad <= free_len && size <= free_len - pad)
+    {
+      void *out = b->data + b->length + pad;
+      b->length += pad + size;
+      a->length += pad + size;
+      return out;
+    }
   }
-
-  a->length -= size;
-  return 1;
+  return arena_push_slow(a, size, align);
 }
 
-static inline uint
-clear_arena(
-    struct Arena *a)
-{
-  return free_arena(a, a->length);
-}
+#define PUSH_ARENA(a, T, n) ((T *)push_arena(a, sizeof(T) * (n), alignof(T)))
 
-static inline uint
+static inline void *
 copy_alloc_arena(
     struct Arena *restrict a,
     uint8_t const *restrict buffer,
     uint buffer_len)
 {
-  if(buffer_len > amount_free_arena(a)) { return 0; }
+  void *out = push_arena(a, buffer_len, 1);
+  if(out != NULL && buffer_len > 0) { memcpy(out, buffer, buffer_len); }
+  return out;
+}
 
-  uint idx = a->length;
-  if(alloc_arena(a, buffer_len) == 0) { return 0; }
-  memcpy(a->buffer + idx, buffer, buffer_len);
-  return 1;
+// nul terminated copy
+static inline char *
+push_string_arena(
+    struct Arena *restrict a,
+    char const *restrict s,
+    uint s_len)
+{
+  char *out = push_arena(a, s_len + 1, 1);
+  if(out == NULL) { return NULL; }
+  memcpy(out, s, s_len);
+  out[s_len] = 0;
+  return out;
 }
 
-static inline uint
-replace_range_arena(
+// nul terminated, len (optional) does not count the nul
+__attribute__((format(printf, 3, 4)))
+static inline char *
+printf_arena(
     struct Arena *restrict a,
-    uint bottom, uint top,
-    uint8_t const *restrict buffer,
-    uint buffer_len)
+    uint *restrict len,
+    char const *restrict fmt,
+    ...)
 {
-  if(bottom >= top || top > a->length) { return 0; }
+  // format straight into the free tail of the current block, only a miss formats twice
+  struct ArenaBlock *b = a->block;
+  uint free_len = b != NULL ? b->capacity - b->length : 0;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(b != NULL ? b->data + b->length : NULL, free_len, fmt, args);
+  va_end(args);
+  if(n < 0) { return NULL; }
+
+  // byte aligned, so a fit lands exactly where it was formatted
+  char *out = push_arena(a, n + 1, 1);
+  if(out == NULL) { return NULL; }
+  if((uint)n >= free_len)
+  {
+    va_start(args, fmt);
+    vsnprintf(out, n + 1, fmt, args);
+    va_end(args);
+  }
+  if(len != NULL) { *len = n; }
+  return out;
+}
 
-  uint above_top = a->length - top;
-  if(top - bottom != buffer_len)
+static inline struct ArenaMark
+mark_arena(
+    struct Arena const *a)
+{
+  return (struct ArenaMark){
+    .block = a->block,
+    .block_length = a->block != NULL ? a->block->length : 0,
+    .length = a->length,
+    .latch = 1,
+  };
+}
+
+// frees every block newer than the mark, everything allocated after it is gone
+static inline void
+restore_arena(
+    struct Arena *restrict a,
+    struct ArenaMark *restrict m)
+{
+  while(a->block != m->block && a->block != NULL)
   {
-    memmove(a->buffer + buffer_len, a->buffer + top, above_top);
+    struct ArenaBlock *prev = a->block->prev;
+    free(a->block);
+    a->block = prev;
   }
+  if(a->block != NULL) { a->block->length = m->block_length; }
+  a->length = m->length;
+  m->latch = 0;
+}
 
-  memcpy(a->buffer + bottom, buffer, buffer_len);
-  a->length = bottom + buffer_len + above_top;
+// allocations inside the body are freed when it ends, a `break` or `return` skips that
+#define ARENA_SCOPE(a) \
+  for( \
+      struct ArenaMark arena_scope_mark = mark_arena(a); \
+      arena_scope_mark.latch; \
+      restore_arena(a, &arena_scope_mark))
 
-  return 1;
+// keeps the oldest block
+static inline void
+clear_arena(
+    struct Arena *a)
+{
+  while(a->block != NULL && a->block->prev != NULL)
+  {
+    struct ArenaBlock *prev = a->block->prev;
+    free(a->block);
+    a->block = prev;
+  }
+  if(a->block != NULL) { a->block->length = 0; }
+  a->length = 0;
 }
 
 #endif // ARENA_C
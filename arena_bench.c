@@ -0,0 +1,266 @@
+// Benchmark of arena.c against the fixed, calloc'd arena it replaced.
+// Not part of config.so, build and run it by hand:
+//   gcc -std=c23 -O3 -march=native arena_bench.c -o arena_bench && ./arena_bench
+
+#define _GNU_SOURCE // clock_gettime under -std=c23
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int uint;
+#define Min(x,y) ((x) < (y) ? (x) : (y))
+#define Max(x,y) ((x) > (y) ? (x) : (y))
+#define STATIC_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+#include "arena.c"
+
+/* TYPES */
+#define BENCH_ROUNDS 20'000
+#define BENCH_FIXED_CAPACITY (4096 * 4) // what luaopen_config used to allocate
+
+// the old arena, one calloc'd buffer that fails when full
+struct FixedArena
+{
+  uint length;
+  uint capacity;
+  char *buffer;
+};
+
+/* HELPERS */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_nsec;
+}
+
+static inline uint
+init_fixed_arena(
+    struct FixedArena *a,
+    uint capacity)
+{
+  a->capacity = capacity;
+  a->length = 0;
+  a->buffer = calloc(a->capacity, sizeof(char));
+  return a->buffer != NULL;
+}
+
+static inline uint
+copy_alloc_fixed_arena(
+    struct FixedArena *restrict a,
+    uint8_t const *restrict buffer,
+    uint buffer_len)
+{
+  if(buffer_len == 0 || buffer_len > a->capacity - a->length) { return 0; }
+  memcpy(a->buffer + a->length, buffer, buffer_len);
+  a->length += buffer_len;
+  return 1;
+}
+
+// keep the optimizer from dropping the work
+static volatile uintptr_t g_sink;
+
+static char const *g_words[] =
+{
+  "runtimepath", "my-autoread", "BufEnter", "CursorHold", "FocusGained",
+  "/home/user/.local/share/nvim/site/pack/deps/opt/mini.nvim",
+  "if mode() != 'c' | checktime | endif", "<leader>sf",
+};
+
+// filled at runtime, constant lengths let the compiler unroll one side and not the other
+static uint g_word_lens[STATIC_ARRAY_SIZE(g_words)];
+
+static char const g_chunk[32] = "0123456789abcdef0123456789abcde";
+
+static void
+bench_report(
+    char const *name,
+    uint64_t fixed_ns,
+    uint64_t chained_ns,
+    uint ops)
+{
+  printf("%-28s fixed %8.2f ns/op  chained %8.2f ns/op  (%.2fx)\n",
+      name, (double)fixed_ns / ops, (double)chained_ns / ops,
+      chained_ns > 0 ? (double)fixed_ns / (double)chained_ns : 0.0);
+}
+
+/* BENCHMARKS */
+// the luaopen_config pattern: one arena per start, a handful of strings, freed at the end
+static void
+bench_startup(void)
+{
+  uint64_t t0 = bench_now_ns();
+  for(uint r = 0;
+      r < BENCH_ROUNDS;
+      r += 1)
+  {
+    struct FixedArena a;
+    init_fixed_arena(&a, BENCH_FIXED_CAPACITY);
+    for(uint i = 0;
+        i < STATIC_ARRAY_SIZE(g_words);
+        i += 1)
+    {
+      copy_alloc_fixed_arena(&a, (uint8_t const *)g_words[i], g_word_lens[i] + 1);
+    }
+    g_sink += (uintptr_t)a.buffer[a.length - 1];
+    free(a.buffer);
+  }
+  uint64_t t1 = bench_now_ns();
+  for(uint r = 0;
+      r < BENCH_ROUNDS;
+      r += 1)
+  {
+    struct Arena a;
+    init_arena(&a, BENCH_FIXED_CAPACITY);
+    char *last = NULL;
+    for(uint i = 0;
+        i < STATIC_ARRAY_SIZE(g_words);
+        i += 1)
+    {
+      last = push_string_arena(&a, g_words[i], g_word_lens[i]);
+    }
+    g_sink += (uintptr_t)last[0];
+    deinit_arena(&a);
+  }
+  uint64_t t2 = bench_now_ns();
+  bench_report("init+strings+deinit", t1 - t0, t2 - t1, BENCH_ROUNDS);
+}
+
+// temporary strings inside a long lived arena, the old code rewound length by hand
+static void
+bench_scoped(void)
+{
+  struct FixedArena fixed;
+  init_fixed_arena(&fixed, BENCH_FIXED_CAPACITY);
+  struct Arena chained;
+  init_arena(&chained, BENCH_FIXED_CAPACITY);
+
+  uint ops = BENCH_ROUNDS * STATIC_ARRAY_SIZE(g_words);
+  uint64_t t0 = bench_now_ns();
+  for(uint r = 0;
+      r < BENCH_ROUNDS;
+      r += 1)
+  {
+    uint pos = fixed.length;
+    for(uint i = 0;
+        i < STATIC_ARRAY_SIZE(g_words);
+        i += 1)
+    {
+      g_sink += fixed.length;
+      copy_alloc_fixed_arena(&fixed, (uint8_t const *)g_words[i], g_word_lens[i] + 1);
+    }
+    fixed.length = pos;
+  }
+  uint64_t t1 = bench_now_ns();
+  for(uint r = 0;
+      r < BENCH_ROUNDS;
+      r += 1)
+  {
+    ARENA_SCOPE(&chained)
+    {
+      for(uint i = 0;
+          i < STATIC_ARRAY_SIZE(g_words);
+          i += 1)
+      {
+        g_sink += (uintptr_t)push_string_arena(&chained, g_words[i], g_word_lens[i]);
+      }
+    }
+  }
+  uint64_t t2 = bench_now_ns();
+  bench_report("scoped temporaries", t1 - t0, t2 - t1, ops);
+
+  free(fixed.buffer);
+  deinit_arena(&chained);
+}
+
+// fill far past 16 KiB: the fixed arena has to be sized for the worst case up front (and zeroed),
+// the chained one starts at 16 KiB and doubles, each new block is fresh memory from mmap
+// so this measures the worst case of growing, a right-sized first block bumps like the fixed one
+static void
+bench_growth(void)
+{
+  uint const total = 1024 * 1024;
+  uint const rounds = BENCH_ROUNDS / 100;
+  uint ops = 0;
+
+  uint64_t t0 = bench_now_ns();
+  for(uint r = 0;
+      r < rounds;
+      r += 1)
+  {
+    struct FixedArena a;
+    init_fixed_arena(&a, total);
+    while(copy_alloc_fixed_arena(&a, (uint8_t const *)g_chunk, sizeof(g_chunk)))
+    {
+      g_sink += a.length;
+      ops += 1;
+    }
+    free(a.buffer);
+  }
+  uint64_t t1 = bench_now_ns();
+  for(uint r = 0;
+      r < rounds;
+      r += 1)
+  {
+    struct Arena a;
+    init_arena(&a, BENCH_FIXED_CAPACITY);
+    while(a.length + sizeof(g_chunk) <= total)
+    {
+      g_sink += (uintptr_t)copy_alloc_arena(&a, (uint8_t const *)g_chunk, sizeof(g_chunk));
+    }
+    deinit_arena(&a);
+  }
+  uint64_t t2 = bench_now_ns();
+  bench_report("1 MiB of 32 byte strings", t1 - t0, t2 - t1, ops);
+}
+
+// typed allocations, the fixed arena has no alignment so this is the chained one alone
+static void
+bench_aligned(void)
+{
+  struct Arena a;
+  init_arena(&a, BENCH_FIXED_CAPACITY);
+  uint ops = BENCH_ROUNDS * 64;
+  uint64_t t0 = bench_now_ns();
+  for(uint r = 0;
+      r < BENCH_ROUNDS;
+      r += 1)
+  {
+    ARENA_SCOPE(&a)
+    {
+      for(uint i = 0;
+          i < 64;
+          i += 1)
+      {
+        uint64_t *p = PUSH_ARENA(&a, uint64_t, 3);
+        p[0] = i;
+        g_sink += (uintptr_t)p;
+        g_sink += (uintptr_t)push_arena(&a, 1, 1);
+      }
+    }
+  }
+  uint64_t t1 = bench_now_ns();
+  printf("%-28s chained %8.2f ns/op\n", "aligned PUSH_ARENA", (double)(t1 - t0) / ops);
+  deinit_arena(&a);
+}
+
+int
+main(void)
+{
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(g_words);
+      i += 1)
+  {
+    g_word_lens[i] = strlen(g_words[i]);
+  }
+
+  bench_startup();
+  bench_scoped();
+  bench_growth();
+  bench_aligned();
+  return 0;
+}
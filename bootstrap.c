@@ -0,0 +1,303 @@
+#ifndef BOOTSTRAP_C
+#define BOOTSTRAP_C
+
+// Clones missing plugins in the background, with a bounded number of `git` processes at once.
+// Every clone goes into "<path>.bootstrap" first and is renamed into place when git succeeds,
+// so a plugin directory either does not exist or is complete.
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/* TYPES */
+#define BOOTSTRAP_JOBS_MAX 64
+#define BOOTSTRAP_PROGRESS_MAX 128
+
+#define BOOTSTRAP_STATE_LIST \
+  BOOTSTRAP_STATE_X(Queued) \
+  BOOTSTRAP_STATE_X(Running) \
+  BOOTSTRAP_STATE_X(Done) \
+  BOOTSTRAP_STATE_X(Failed)
+
+enum Bootstrap_State : int
+{
+#define BOOTSTRAP_STATE_X(n) Bootstrap_State_##n,
+  BOOTSTRAP_STATE_LIST
+#undef BOOTSTRAP_STATE_X
+  Bootstrap_State_Count,
+};
+
+struct BootstrapJob
+{
+  int id; // owner defined
+  char const *url;
+  char const *checkout; // NULL for the default branch
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX];
+
+  enum Bootstrap_State state;
+  pid_t pid;
+  int err_fd;
+
+  // last line git wrote to stderr, it is the progress meter while running and the reason on failure
+  uint progress_len;
+  char progress[BOOTSTRAP_PROGRESS_MAX];
+  uint line_len;
+  char line[BOOTSTRAP_PROGRESS_MAX];
+};
+
+struct Bootstrap
+{
+  uint parallel;
+  uint running;
+  uint finished;
+  uint jobs_len;
+  struct BootstrapJob jobs[BOOTSTRAP_JOBS_MAX];
+  char **envp;
+};
+
+typedef void (*Bootstrap_On_Done)(void *ctx, struct BootstrapJob *job);
+
+/* HELPERS */
+static inline int
+bootstrap_rm_entry(
+    char const *path,
+    struct stat const *sb,
+    int type,
+    struct FTW *ftw)
+{
+  (void)sb; (void)ftw;
+  return (type == FTW_DP ? rmdir(path) : unlink(path)) == -1 && errno != ENOENT;
+}
+
+static inline int
+bootstrap_rm_tree(
+    char const *path)
+{
+  if(access(path, F_OK) == -1) { return 1; }
+  return nftw(path, bootstrap_rm_entry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+// name of the plugin directory, the same one MiniDeps derives from the source
+static inline char const *
+bootstrap_url_name(
+    char const *url)
+{
+  char const *name = strrchr(url, '/');
+  return name == NULL ? url : name + 1;
+}
+
+/* API */
+static inline uint
+init_bootstrap(
+    struct Bootstrap *b,
+    uint parallel)
+{
+  memset(b, 0, offsetof(struct Bootstrap, jobs));
+  b->parallel = Max(parallel, 1);
+
+  // never let git block on a credential prompt, there is no terminal to answer it
+  uint environ_len = 0;
+  while(environ[environ_len] != NULL) { environ_len += 1; }
+  b->envp = malloc((environ_len + 2) * sizeof(*b->envp));
+  if(b->envp == NULL) { return 0; }
+  memcpy(b->envp, environ, environ_len * sizeof(*b->envp));
+  b->envp[environ_len] = "GIT_TERMINAL_PROMPT=0";
+  b->envp[environ_len + 1] = NULL;
+  return 1;
+}
+
+static inline void
+deinit_bootstrap(
+    struct Bootstrap *b)
+{
+  free(b->envp);
+  b->envp = NULL;
+}
+
+static inline uint
+push_bootstrap(
+    struct Bootstrap *b,
+    int id,
+    char const *restrict url,
+    char const *restrict checkout,
+    char const *restrict dir)
+{
+  if(b->jobs_len >= BOOTSTRAP_JOBS_MAX) { return 0; }
+
+  struct BootstrapJob *job = &b->jobs[b->jobs_len];
+  memset(job, 0, sizeof(*job));
+  job->id = id;
+  job->url = url;
+  job->checkout = checkout;
+  job->err_fd = -1;
+  job->state = Bootstrap_State_Queued;
+
+  char const *name = bootstrap_url_name(url);
+  int len = snprintf(job->path, sizeof(job->path), "%s/%s", dir, name);
+  if(len < 0 || len >= (int)sizeof(job->path)) { return 0; }
+  char const suffix[] = ".bootstrap";
+  if((uint)len + sizeof(suffix) > sizeof(job->tmp_path)) { return 0; }
+  memcpy(job->tmp_path, job->path, len);
+  memcpy(job->tmp_path + len, suffix, sizeof(suffix));
+
+  b->jobs_len += 1;
+  return 1;
+}
+
+static inline uint
+finished_bootstrap(
+    struct Bootstrap *b)
+{
+  return b->finished == b->jobs_len;
+}
+
+static inline uint
+spawn_bootstrap_job(
+    struct Bootstrap *restrict b,
+    struct BootstrapJob *restrict job)
+{
+  // leftovers of a clone that was killed half way
+  if(!bootstrap_rm_tree(job->tmp_path)) { return 0; }
+
+  int pipefd[2];
+  if(pipe2(pipefd, O_CLOEXEC) == -1) { return 0; }
+
+  char *argv[16] = {
+    "git", "clone", "--progress", "--filter=blob:none", "--origin", "origin",
+  };
+  uint argc = 6;
+  if(job->checkout != NULL)
+  {
+    argv[argc++] = "--branch";
+    argv[argc++] = (char *)job->checkout;
+  }
+  argv[argc++] = "--";
+  argv[argc++] = (char *)job->url;
+  argv[argc++] = job->tmp_path;
+  argv[argc++] = NULL;
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDERR_FILENO);
+
+  int err = posix_spawnp(&job->pid, argv[0], &actions, NULL, argv, b->envp);
+  posix_spawn_file_actions_destroy(&actions);
+  close(pipefd[1]);
+  if(err != 0)
+  {
+    close(pipefd[0]);
+    return 0;
+  }
+
+  fcntl(pipefd[0], F_SETFL, fcntl(pipefd[0], F_GETFL) | O_NONBLOCK);
+  job->err_fd = pipefd[0];
+  job->state = Bootstrap_State_Running;
+  b->running += 1;
+  return 1;
+}
+
+static inline void
+read_bootstrap_job(
+    struct BootstrapJob *job)
+{
+  char buf[4096];
+  ssize_t len;
+  while((len = read(job->err_fd, buf, sizeof(buf))) > 0)
+  {
+    // git redraws its meter with '\r', keep the last complete line only
+    for(ssize_t i = 0;
+        i < len;
+        i += 1)
+    {
+      if(buf[i] == '\r' || buf[i] == '\n')
+      {
+        // git follows a "fatal:" with advice ("and the repository exists."), the fatal line is the reason
+        bool fatal = job->progress_len >= 6 && memcmp(job->progress, "fatal:", 6) == 0;
+        if(job->line_len > 0 && !fatal)
+        {
+          memcpy(job->progress, job->line, job->line_len);
+          job->progress_len = job->line_len;
+          job->line_len = 0;
+        }
+      }
+      else if(job->line_len < sizeof(job->line))
+      {
+        job->line[job->line_len++] = buf[i];
+      }
+    }
+  }
+}
+
+// never blocks, reaps the finished clones and starts the queued ones
+// returns the number of jobs that finished during this call
+static inline uint
+poll_bootstrap(
+    struct Bootstrap *restrict b,
+    Bootstrap_On_Done on_done,
+    void *restrict ctx)
+{
+  uint done = 0;
+  for(uint i = 0;
+      i < b->jobs_len;
+      i += 1)
+  {
+    struct BootstrapJob *job = &b->jobs[i];
+    if(job->state != Bootstrap_State_Running) { continue; }
+
+    read_bootstrap_job(job);
+
+    int wstatus;
+    pid_t pid = waitpid(job->pid, &wstatus, WNOHANG);
+    if(pid == 0 || (pid == -1 && errno == EINTR)) { continue; }
+
+    read_bootstrap_job(job);
+    close(job->err_fd);
+    job->err_fd = -1;
+
+    bool ok = pid == job->pid && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+    if(ok && rename(job->tmp_path, job->path) == -1) { ok = false; }
+    if(!ok) { bootstrap_rm_tree(job->tmp_path); }
+
+    job->state = ok ? Bootstrap_State_Done : Bootstrap_State_Failed;
+    b->running -= 1;
+    b->finished += 1;
+    done += 1;
+    if(on_done != NULL) { on_done(ctx, job); }
+  }
+
+  for(uint i = 0;
+      i < b->jobs_len && b->running < b->parallel;
+      i += 1)
+  {
+    struct BootstrapJob *job = &b->jobs[i];
+    if(job->state != Bootstrap_State_Queued) { continue; }
+
+    if(!spawn_bootstrap_job(b, job))
+    {
+      char const msg[] = "failed to spawn git";
+      memcpy(job->progress, msg, sizeof(msg) - 1);
+      job->progress_len = sizeof(msg) - 1;
+      job->state = Bootstrap_State_Failed;
+      b->finished += 1;
+      done += 1;
+      if(on_done != NULL) { on_done(ctx, job); }
+    }
+  }
+
+  return done;
+}
+#endif
+
+#endif // BOOTSTRAP_C
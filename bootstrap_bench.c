@@ -0,0 +1,208 @@
+// Benchmark and check of bootstrap.c against local bare repositories, no network involved.
+// Clones the same set of repos with 1, 4 and 16 git processes at once and checks every job
+// (done, renamed into place, no "<path>.bootstrap" left, never more than `parallel` running),
+// then the failures: a repo that does not exist and a branch that does not exist.
+// Not part of config.so, build and run it by hand, it exits with 1 when a check fails:
+//   gcc -std=c23 -O2 bootstrap_bench.c -o bootstrap_bench && ./bootstrap_bench /tmp/bootstrap_bench 16
+
+#define _GNU_SOURCE // clock_gettime, pipe2 under -std=c23
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int uint;
+#define Min(x,y) ((x) < (y) ? (x) : (y))
+#define Max(x,y) ((x) > (y) ? (x) : (y))
+#define STATIC_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+#include "bootstrap.c"
+
+#define BENCH_POLL_US 1000
+
+static uint g_failed_checks;
+
+/* HELPERS */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_nsec;
+}
+
+static void
+bench_check(
+    bool ok,
+    char const *what,
+    char const *detail)
+{
+  if(ok) { return; }
+  fprintf(stderr, "FAILED: %s (%s)\n", what, detail);
+  g_failed_checks += 1;
+}
+
+static void
+bench_sh(
+    char const *fmt,
+    ...)
+{
+  char cmd[4 * PATH_MAX];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(cmd, sizeof(cmd), fmt, args);
+  va_end(args);
+  if(system(cmd) != 0) { fprintf(stderr, "setup failed: %s\n", cmd); exit(1); }
+}
+
+// root/remote/repo<i> with one commit on main and a branch "stable", like a plugin with a checkout
+static void
+bench_make_remotes(
+    char const *root,
+    uint repos)
+{
+  bench_sh("rm -rf '%s' && mkdir -p '%s/remote' '%s/work'", root, root, root);
+  char work[PATH_MAX];
+  snprintf(work, sizeof(work), "%s/work", root);
+  bench_sh("cd '%s' && git init -q -b main . && printf 'return {}\\n' > init.lua && git add init.lua"
+      " && git -c user.name=bench -c user.email=bench@localhost commit -q -m init && git branch stable", work);
+  for(uint i = 0;
+      i < repos;
+      i += 1)
+  {
+    char remote[PATH_MAX];
+    snprintf(remote, sizeof(remote), "%s/remote/repo%u", root, i);
+    bench_sh("git init -q --bare -b main '%s' && git -C '%s' push -q '%s' main stable", remote, work, remote);
+  }
+}
+
+static void
+bench_on_done(
+    void *ctx,
+    struct BootstrapJob *job)
+{
+  (void)ctx; (void)job;
+}
+
+// polls like bootstrap_tick does, only faster, returns the most jobs that were running at once
+static uint
+bench_run(
+    struct Bootstrap *b)
+{
+  uint running_max = 0;
+  for(;;)
+  {
+    poll_bootstrap(b, bench_on_done, NULL);
+    running_max = Max(running_max, b->running);
+    if(finished_bootstrap(b)) { break; }
+    usleep(BENCH_POLL_US);
+  }
+  return running_max;
+}
+
+static void
+bench_parallel(
+    char const *root,
+    uint repos,
+    uint parallel)
+{
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s/clones%u", root, parallel);
+  bench_sh("rm -rf '%s' && mkdir -p '%s'", dir, dir);
+
+  char urls[BOOTSTRAP_JOBS_MAX][PATH_MAX + 16];
+  struct Bootstrap b;
+  if(!init_bootstrap(&b, parallel)) { fprintf(stderr, "init_bootstrap failed\n"); exit(1); }
+  for(uint i = 0;
+      i < repos;
+      i += 1)
+  {
+    snprintf(urls[i], sizeof(urls[i]), "file://%s/remote/repo%u", root, i);
+    bench_check(push_bootstrap(&b, i, urls[i], i % 2 == 0 ? NULL : "stable", dir), "push_bootstrap", urls[i]);
+  }
+
+  uint64_t t0 = bench_now_ns();
+  uint running_max = bench_run(&b);
+  uint64_t t1 = bench_now_ns();
+
+  uint done = 0;
+  for(uint i = 0;
+      i < b.jobs_len;
+      i += 1)
+  {
+    struct BootstrapJob const *job = &b.jobs[i];
+    char init_lua[PATH_MAX + 16];
+    snprintf(init_lua, sizeof(init_lua), "%s/init.lua", job->path);
+    done += job->state == Bootstrap_State_Done;
+    bench_check(job->state == Bootstrap_State_Done, "clone done", job->progress);
+    bench_check(access(init_lua, F_OK) == 0, "renamed into place", job->path);
+    bench_check(access(job->tmp_path, F_OK) == -1, "no leftover", job->tmp_path);
+  }
+  bench_check(running_max <= parallel, "parallel limit", "more git processes than parallel");
+  bench_check(b.running == 0, "nothing running", "running count after the last job");
+  deinit_bootstrap(&b);
+
+  printf("bootstrap.c %2u parallel  %2u/%2u done  most running %2u  total %8.2f ms\n",
+      parallel, done, repos, running_max, (double)(t1 - t0) / 1e6);
+}
+
+static void
+bench_failures(
+    char const *root)
+{
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s/failures", root);
+  bench_sh("rm -rf '%s' && mkdir -p '%s'", dir, dir);
+
+  char missing[PATH_MAX + 16];
+  char branch[PATH_MAX + 16];
+  snprintf(missing, sizeof(missing), "file://%s/remote/missing", root);
+  snprintf(branch, sizeof(branch), "file://%s/remote/repo0", root);
+
+  struct Bootstrap b;
+  if(!init_bootstrap(&b, 2)) { fprintf(stderr, "init_bootstrap failed\n"); exit(1); }
+  bench_check(push_bootstrap(&b, 0, missing, NULL, dir), "push_bootstrap", missing);
+  bench_check(push_bootstrap(&b, 1, branch, "no-such-branch", dir), "push_bootstrap", branch);
+  bench_run(&b);
+
+  for(uint i = 0;
+      i < b.jobs_len;
+      i += 1)
+  {
+    struct BootstrapJob const *job = &b.jobs[i];
+    bench_check(job->state == Bootstrap_State_Failed, "clone failed", job->url);
+    bench_check(job->progress_len > 0, "failure has a reason", job->url);
+    bench_check(access(job->path, F_OK) == -1, "nothing in place", job->path);
+    bench_check(access(job->tmp_path, F_OK) == -1, "no leftover", job->tmp_path);
+    printf("bootstrap.c failed as expected: %.*s\n", (int)job->progress_len, job->progress);
+  }
+  deinit_bootstrap(&b);
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+  char const *root = argc > 1 ? argv[1] : "/tmp/bootstrap_bench";
+  uint repos = argc > 2 ? (uint)atoi(argv[2]) : 16;
+  repos = Min(Max(repos, 1), BOOTSTRAP_JOBS_MAX);
+
+  bench_make_remotes(root, repos);
+  bench_parallel(root, repos, 1);
+  bench_parallel(root, repos, 4);
+  bench_parallel(root, repos, 16);
+  bench_failures(root);
+
+  if(g_failed_checks > 0)
+  {
+    fprintf(stderr, "%u checks failed\n", g_failed_checks);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,596 @@
+#ifndef BYTECODE_C
+#define BYTECODE_C
+
+// LuaJIT bytecode of plugin modules, served to `require` out of one mmap'd pack.
+// A module that is not in the pack is loaded from source once, dumped, and written into the
+// pack when nvim exits. Every module belongs to the plugin checkout it came from and is thrown
+// away as soon as that checkout points at another commit.
+// The pack is a snapshot file (snapshot.c): plugin records first, then module records.
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* TYPES */
+#define BYTECODE_PLUGINS_MAX 64
+#define BYTECODE_MODULES_MAX 1024
+#define BYTECODE_SLOTS (BYTECODE_MODULES_MAX * 2) // power of 2, keeps the probe chains short
+#define BYTECODE_REF_MAX 256
+#define BYTECODE_PACKED_REFS_CHUNK 4096 // longer than any ref line
+
+static_assert((BYTECODE_SLOTS & (BYTECODE_SLOTS - 1)) == 0, "slots are masked, not divided");
+static_assert(BYTECODE_MODULES_MAX < UINT16_MAX, "slots store module indices in 16 bits");
+
+#define BYTECODE_KIND_LIST \
+  BYTECODE_KIND_X(Plugin) \
+  BYTECODE_KIND_X(Module)
+
+enum Bytecode_Kind : int
+{
+#define BYTECODE_KIND_X(n) Bytecode_Kind_##n,
+  BYTECODE_KIND_LIST
+#undef BYTECODE_KIND_X
+  Bytecode_Kind_Count,
+};
+
+#define BYTECODE_PLUGIN_STATE_LIST \
+  BYTECODE_PLUGIN_STATE_X(Unchecked) \
+  BYTECODE_PLUGIN_STATE_X(Valid) \
+  BYTECODE_PLUGIN_STATE_X(Unversioned)
+
+enum Bytecode_Plugin_State : int
+{
+#define BYTECODE_PLUGIN_STATE_X(n) Bytecode_Plugin_State_##n,
+  BYTECODE_PLUGIN_STATE_LIST
+#undef BYTECODE_PLUGIN_STATE_X
+  Bytecode_Plugin_State_Count,
+};
+
+struct BytecodePlugin
+{
+  char root[PATH_MAX]; // directory that contains lua/
+  uint root_len;
+  uint64_t commit; // hash of the checked out commit
+  enum Bytecode_Plugin_State state;
+};
+
+struct BytecodeModule
+{
+  char const *name;
+  char const *chunkname; // "@<path>", what nvim's own loader would name the chunk
+  char const *code;
+  uint name_len;
+  uint chunkname_len;
+  uint code_len;
+  uint plugin;
+  int64_t parse_ns; // loading the source, measured when the module was recorded
+  bool dead;
+  void *owned; // set for modules recorded in this session
+};
+
+struct BytecodePack
+{
+  char path[PATH_MAX];
+  uint64_t key;
+  char prefix[PATH_MAX]; // only modules below it are packed
+  uint prefix_len;
+
+  struct Snapshot snapshot;
+  bool dirty;
+
+  struct ModuleIndex *index; // optional, resolves modules before the runtimepath is searched
+  void (*on_load)(lua_State *L, char const *name, uint name_len); // optional, name is about to be (re)loaded
+
+  uint plugins_len;
+  struct BytecodePlugin plugins[BYTECODE_PLUGINS_MAX];
+  uint modules_len;
+  struct BytecodeModule modules[BYTECODE_MODULES_MAX];
+  uint16_t slots[BYTECODE_SLOTS]; // module index + 1, 0 is empty
+
+  uint hits;
+  uint misses;
+  int64_t saved_ns;
+};
+
+struct BytecodeBuffer
+{
+  char *data;
+  size_t len;
+  size_t cap;
+};
+
+/* HELPERS */
+// hash of the commit a plugin checkout is on, 0 when it is not a git checkout
+static inline uint64_t
+bytecode_plugin_commit(
+    char const *root)
+{
+  char path[PATH_MAX + BYTECODE_REF_MAX];
+  char head[BYTECODE_REF_MAX];
+  snprintf(path, sizeof(path), "%s/.git/HEAD", root);
+  int head_len = read_small_file(path, head, sizeof(head));
+  while(head_len > 0 && isspace((unsigned char)head[head_len - 1])) { head[--head_len] = 0; }
+  if(head_len <= 0) { return 0; }
+
+  // detached
+  if(strncmp(head, "ref: ", 5) != 0) { return snapshot_hash(SNAPSHOT_FNV_OFFSET, head, head_len); }
+
+  char const *ref = head + 5;
+  char sha[BYTECODE_REF_MAX];
+  snprintf(path, sizeof(path), "%s/.git/%s", root, ref);
+  int sha_len = read_small_file(path, sha, sizeof(sha));
+  while(sha_len > 0 && isspace((unsigned char)sha[sha_len - 1])) { sha[--sha_len] = 0; }
+  if(sha_len > 0) { return snapshot_hash(SNAPSHOT_FNV_OFFSET, sha, sha_len); }
+
+  // loose ref is gone after a `git gc`, the commit is in packed-refs as "<sha> <ref>"
+  // a repo with many tags has a big one, stream it
+  char packed[BYTECODE_PACKED_REFS_CHUNK];
+  struct FileReader reader;
+  snprintf(path, sizeof(path), "%s/.git/packed-refs", root);
+  if(!open_file_reader(&reader, path, packed, sizeof(packed), Fileio_Advice_Sequential)) { return 0; }
+
+  uint64_t commit = 0;
+  uint ref_len = strlen(ref);
+  char const *line;
+  uint line_len;
+  while(commit == 0 && read_line_file_reader(&reader, &line, &line_len))
+  {
+    char const *space = memchr(line, ' ', line_len);
+    if(space == NULL) { continue; }
+    uint name_len = line_len - (uint)(space + 1 - line);
+    if(name_len == ref_len && memcmp(space + 1, ref, ref_len) == 0)
+    {
+      commit = snapshot_hash(SNAPSHOT_FNV_OFFSET, line, space - line);
+    }
+  }
+  close_file_reader(&reader);
+  return commit;
+}
+
+static inline uint
+bytecode_slot(
+    char const *name,
+    uint name_len)
+{
+  return snapshot_hash(SNAPSHOT_FNV_OFFSET, name, name_len) & (BYTECODE_SLOTS - 1);
+}
+
+static inline int
+bytecode_find(
+    struct BytecodePack const *restrict pack,
+    char const *restrict name,
+    uint name_len)
+{
+  for(uint slot = bytecode_slot(name, name_len);
+      pack->slots[slot] != 0;
+      slot = (slot + 1) & (BYTECODE_SLOTS - 1))
+  {
+    struct BytecodeModule const *m = &pack->modules[pack->slots[slot] - 1];
+    if(m->name_len == name_len && memcmp(m->name, name, name_len) == 0) { return pack->slots[slot] - 1; }
+  }
+  return -1;
+}
+
+// a newer module of the same name takes over the slot
+static inline void
+bytecode_insert(
+    struct BytecodePack *pack,
+    uint idx)
+{
+  struct BytecodeModule const *m = &pack->modules[idx];
+  uint slot = bytecode_slot(m->name, m->name_len);
+  for(;
+      pack->slots[slot] != 0;
+      slot = (slot + 1) & (BYTECODE_SLOTS - 1))
+  {
+    struct BytecodeModule const *other = &pack->modules[pack->slots[slot] - 1];
+    if(other->name_len == m->name_len && memcmp(other->name, m->name, m->name_len) == 0) { break; }
+  }
+  pack->slots[slot] = idx + 1;
+}
+
+// the first use of a plugin in a session compares its checkout against the pack
+static inline bool
+bytecode_plugin_valid(
+    struct BytecodePack *pack,
+    uint plugin)
+{
+  struct BytecodePlugin *p = &pack->plugins[plugin];
+  if(p->state != Bytecode_Plugin_State_Unchecked) { return p->state == Bytecode_Plugin_State_Valid; }
+
+  uint64_t commit = bytecode_plugin_commit(p->root);
+  if(commit != p->commit)
+  {
+    for(uint i = 0;
+        i < pack->modules_len;
+        i += 1)
+    {
+      if(pack->modules[i].plugin == plugin) { pack->modules[i].dead = true; }
+    }
+    p->commit = commit;
+    pack->dirty = true;
+  }
+  p->state = commit == 0 ? Bytecode_Plugin_State_Unversioned : Bytecode_Plugin_State_Valid;
+  return p->state == Bytecode_Plugin_State_Valid;
+}
+
+static inline int
+bytecode_plugin_get(
+    struct BytecodePack *restrict pack,
+    char const *restrict root,
+    uint root_len)
+{
+  for(uint i = 0;
+      i < pack->plugins_len;
+      i += 1)
+  {
+    if(pack->plugins[i].root_len == root_len && memcmp(pack->plugins[i].root, root, root_len) == 0) { return i; }
+  }
+
+  if(pack->plugins_len >= BYTECODE_PLUGINS_MAX || root_len >= PATH_MAX) { return -1; }
+  struct BytecodePlugin *p = &pack->plugins[pack->plugins_len];
+  memcpy(p->root, root, root_len);
+  p->root[root_len] = 0;
+  p->root_len = root_len;
+  p->commit = 0;
+  p->state = Bytecode_Plugin_State_Unchecked;
+  return pack->plugins_len++;
+}
+
+static int
+bytecode_dump_writer(
+    lua_State *L,
+    void const *p,
+    size_t sz,
+    void *ud)
+{
+  (void)L;
+  struct BytecodeBuffer *b = ud;
+  if(b->len + sz > b->cap)
+  {
+    size_t cap = Max(b->cap * 2, b->len + sz);
+    char *data = realloc(b->data, cap);
+    if(data == NULL) { return 1; }
+    b->data = data;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, p, sz);
+  b->len += sz;
+  return 0;
+}
+
+// dumps the function on top of the stack into a new module, the stack is unchanged
+static inline void
+bytecode_record(
+    struct BytecodePack *restrict pack,
+    lua_State *L,
+    char const *restrict name,
+    uint name_len,
+    char const *restrict path,
+    uint plugin,
+    int64_t parse_ns)
+{
+  if(pack->modules_len >= BYTECODE_MODULES_MAX) { return; }
+
+  struct BytecodeBuffer code = {0};
+  if(lua_dump(L, bytecode_dump_writer, &code) != 0 || code.len == 0)
+  {
+    free(code.data);
+    return;
+  }
+
+  // name, chunkname and code in one block
+  uint path_len = strlen(path);
+  char *block = malloc(name_len + 1 + path_len + 2 + code.len);
+  if(block == NULL)
+  {
+    free(code.data);
+    return;
+  }
+  char *chunkname = block + name_len + 1;
+  char *code_copy = chunkname + path_len + 2;
+  memcpy(block, name, name_len);
+  block[name_len] = 0;
+  chunkname[0] = '@';
+  memcpy(chunkname + 1, path, path_len + 1);
+  memcpy(code_copy, code.data, code.len);
+  free(code.data);
+
+  uint idx = pack->modules_len++;
+  pack->modules[idx] = (struct BytecodeModule){
+    .name = block,
+    .chunkname = chunkname,
+    .code = code_copy,
+    .name_len = name_len,
+    .chunkname_len = path_len + 1,
+    .code_len = code.len,
+    .plugin = plugin,
+    .parse_ns = parse_ns,
+    .owned = block,
+  };
+  bytecode_insert(pack, idx);
+  pack->dirty = true;
+}
+
+// &runtimepath, pushed as a string, what the module index selects its plugins by
+static inline void
+bytecode_push_runtimepath(
+    lua_State *L)
+{
+  lua_getglobal(L, "vim");
+  lua_getfield(L, -1, "api");
+  lua_getfield(L, -1, "nvim_get_option_value");
+  lua_pushliteral(L, "runtimepath");
+  lua_createtable(L, 0, 0);
+  lua_call(L, 2, 1);
+  lua_replace(L, -3); // over vim
+  lua_pop(L, 1);
+}
+
+// first match of lua/<mod>.lua or lua/<mod>/init.lua on the runtimepath, pushed as a string or nil
+static inline void
+bytecode_push_runtime_file(
+    lua_State *L,
+    char const *name,
+    uint name_len)
+{
+  static char const *patterns[] = { "lua/%.*s.lua", "lua/%.*s/init.lua" };
+
+  char module_path[PATH_MAX];
+  if(name_len >= sizeof(module_path)) { lua_pushnil(L); return; }
+  for(uint i = 0;
+      i < name_len;
+      i += 1)
+  {
+    module_path[i] = name[i] == '.' ? '/' : name[i];
+  }
+
+  lua_getglobal(L, "vim");
+  lua_getfield(L, -1, "api");
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(patterns);
+      i += 1)
+  {
+    char rel[PATH_MAX + 16];
+    snprintf(rel, sizeof(rel), patterns[i], (int)name_len, module_path);
+    lua_getfield(L, -1, "nvim_get_runtime_file");
+    lua_pushstring(L, rel);
+    lua_pushboolean(L, false);
+    lua_call(L, 2, 1);
+    lua_rawgeti(L, -1, 1);
+    if(lua_isstring(L, -1))
+    {
+      lua_replace(L, -4); // over vim
+      lua_pop(L, 2);
+      return;
+    }
+    lua_pop(L, 2);
+  }
+  lua_pop(L, 2);
+  lua_pushnil(L);
+}
+
+// package.loaders entry, upvalue 1 is the pack
+static int
+bytecode_loader(
+    lua_State *L)
+{
+  struct BytecodePack *pack = lua_touserdata(L, lua_upvalueindex(1));
+  size_t name_len;
+  char const *name = luaL_checklstring(L, 1, &name_len);
+  if(pack->on_load != NULL) { pack->on_load(L, name, name_len); }
+
+  int idx = bytecode_find(pack, name, name_len);
+  if(idx >= 0 && !pack->modules[idx].dead && bytecode_plugin_valid(pack, pack->modules[idx].plugin)
+      && !pack->modules[idx].dead)
+  {
+    struct BytecodeModule *m = &pack->modules[idx];
+    int64_t begin = now_ns();
+    if(luaL_loadbuffer(L, m->code, m->code_len, m->chunkname) == 0)
+    {
+      pack->hits += 1;
+      pack->saved_ns += m->parse_ns - (now_ns() - begin);
+      return 1;
+    }
+    lua_pop(L, 1); // bytecode of another LuaJIT, reload and record the source
+    m->dead = true;
+    pack->dirty = true;
+  }
+
+  pack->misses += 1;
+  char const *path;
+  int64_t begin;
+  for(;;)
+  {
+    char const *indexed = NULL;
+    if(pack->index != NULL)
+    {
+      bytecode_push_runtimepath(L);
+      size_t runtimepath_len;
+      char const *runtimepath = lua_tolstring(L, -1, &runtimepath_len);
+      indexed = runtimepath != NULL ? find_module_index(pack->index, name, name_len, runtimepath, runtimepath_len) : NULL;
+      lua_pop(L, 1);
+    }
+    if(indexed != NULL) { lua_pushstring(L, indexed); }
+    else { bytecode_push_runtime_file(L, name, name_len); }
+    if(lua_isnil(L, -1))
+    {
+      lua_pushfstring(L, "\n\tno file 'lua/%s' on the runtimepath (bytecode)", name);
+      return 1;
+    }
+    path = lua_tostring(L, -1);
+
+    begin = now_ns();
+    int err = luaL_loadfile(L, path);
+    if(err == 0) { break; }
+    if(err != LUA_ERRFILE || indexed == NULL || !stale_module_index(pack->index)) { return lua_error(L); }
+    lua_pop(L, 2); // the index was out of date, look again
+  }
+  int64_t parse_ns = now_ns() - begin;
+
+  // plugin root is everything before the last /lua/
+  uint path_len = strlen(path);
+  char const *lua_dir = NULL;
+  for(char const *p = strstr(path, "/lua/");
+      p != NULL;
+      p = strstr(p + 1, "/lua/"))
+  {
+    lua_dir = p;
+  }
+  if(lua_dir != NULL && path_len > pack->prefix_len && memcmp(path, pack->prefix, pack->prefix_len) == 0)
+  {
+    int plugin = bytecode_plugin_get(pack, path, lua_dir - path);
+    if(plugin >= 0 && bytecode_plugin_valid(pack, plugin))
+    {
+      bytecode_record(pack, L, name, name_len, path, plugin, parse_ns);
+    }
+  }
+  return 1;
+}
+
+/* API */
+// maps the pack at path, a missing or outdated pack starts out empty
+static inline void
+open_bytecode_pack(
+    struct BytecodePack *restrict pack,
+    char const *restrict path,
+    uint64_t key,
+    char const *restrict prefix,
+    uint prefix_len)
+{
+  memset(pack, 0, sizeof(*pack));
+  snprintf(pack->path, sizeof(pack->path), "%s", path);
+  pack->key = key;
+  pack->prefix_len = Min(prefix_len, sizeof(pack->prefix) - 1);
+  memcpy(pack->prefix, prefix, pack->prefix_len);
+
+  if(!open_snapshot(&pack->snapshot, path, key)) { return; }
+
+  struct Snapshot const *s = &pack->snapshot;
+  for(uint i = 0;
+      i < s->header->records_len;
+      i += 1)
+  {
+    struct SnapshotRecord const *r = &s->records[i];
+    if(r->kind == Bytecode_Kind_Plugin && pack->plugins_len < BYTECODE_PLUGINS_MAX && r->str_len[0] < PATH_MAX)
+    {
+      struct BytecodePlugin *p = &pack->plugins[pack->plugins_len++];
+      memcpy(p->root, snapshot_string(s, r, 0), r->str_len[0] + 1);
+      p->root_len = r->str_len[0];
+      p->commit = r->integer;
+      p->state = Bytecode_Plugin_State_Unchecked;
+    }
+    else if(r->kind == Bytecode_Kind_Module && pack->modules_len < BYTECODE_MODULES_MAX && r->type < pack->plugins_len)
+    {
+      uint idx = pack->modules_len++;
+      pack->modules[idx] = (struct BytecodeModule){
+        .name = snapshot_string(s, r, 0),
+        .chunkname = snapshot_string(s, r, 1),
+        .code = snapshot_string(s, r, 2),
+        .name_len = r->str_len[0],
+        .chunkname_len = r->str_len[1],
+        .code_len = r->str_len[2],
+        .plugin = r->type,
+        .parse_ns = r->integer,
+      };
+      bytecode_insert(pack, idx);
+    }
+  }
+}
+
+// require() asks the pack right after package.preload
+static inline void
+install_bytecode_pack(
+    lua_State *L,
+    struct BytecodePack *pack)
+{
+  // table.insert(package.loaders, 2, loader)
+  lua_getglobal(L, "table");
+  lua_getfield(L, -1, "insert");
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "loaders");
+  lua_remove(L, -2);
+  lua_pushinteger(L, 2);
+  lua_pushlightuserdata(L, pack);
+  lua_pushcclosure(L, bytecode_loader, 1);
+  lua_call(L, 3, 0);
+  lua_pop(L, 1);
+}
+
+// rewrites the pack when modules were recorded or thrown away, needs the mapping of the old one
+static inline uint
+write_bytecode_pack(
+    struct BytecodePack *pack)
+{
+  if(!pack->dirty || pack->key == 0) { return 1; }
+
+  uint records_len = pack->plugins_len;
+  size_t strings_len = 1;
+  for(uint i = 0;
+      i < pack->plugins_len;
+      i += 1)
+  {
+    strings_len += pack->plugins[i].root_len + 1;
+  }
+  for(uint i = 0;
+      i < pack->modules_len;
+      i += 1)
+  {
+    struct BytecodeModule const *m = &pack->modules[i];
+    if(m->dead || bytecode_find(pack, m->name, m->name_len) != (int)i) { continue; }
+    records_len += 1;
+    strings_len += m->name_len + m->chunkname_len + m->code_len + 3;
+  }
+  if(strings_len > UINT_MAX) { return 0; }
+
+  struct SnapshotWriter w;
+  if(!init_snapshot_writer(&w, records_len, strings_len)) { return 0; }
+
+  uint ok = 1;
+  for(uint i = 0;
+      ok && i < pack->plugins_len;
+      i += 1)
+  {
+    struct SnapshotSlice root = { pack->plugins[i].root, pack->plugins[i].root_len };
+    ok = push_snapshot_record(&w, Bytecode_Kind_Plugin, 0, pack->plugins[i].commit, &root, 1);
+  }
+  for(uint i = 0;
+      ok && i < pack->modules_len;
+      i += 1)
+  {
+    struct BytecodeModule const *m = &pack->modules[i];
+    if(m->dead || bytecode_find(pack, m->name, m->name_len) != (int)i) { continue; }
+    struct SnapshotSlice strs[3] = {
+      { m->name, m->name_len },
+      { m->chunkname, m->chunkname_len },
+      { m->code, m->code_len },
+    };
+    ok = push_snapshot_record(&w, Bytecode_Kind_Module, m->plugin, m->parse_ns, strs, STATIC_ARRAY_SIZE(strs));
+  }
+
+  ok = ok && write_snapshot(&w, pack->path, pack->key);
+  deinit_snapshot_writer(&w);
+  if(ok) { pack->dirty = false; }
+  return ok;
+}
+
+static inline void
+close_bytecode_pack(
+    struct BytecodePack *pack)
+{
+  for(uint i = 0;
+      i < pack->modules_len;
+      i += 1)
+  {
+    free(pack->modules[i].owned);
+  }
+  close_snapshot(&pack->snapshot);
+  pack->modules_len = 0;
+  pack->plugins_len = 0;
+  memset(pack->slots, 0, sizeof(pack->slots));
+}
+#endif
+
+#endif // BYTECODE_C
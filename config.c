@@ -4,7 +4,8 @@
 // TODO: more asserts on lua types
 // TODO: get ref for function keybinds
 // TODO: keep vim and deps add on the stack
-// TODO: the arena impl is garbage
+
+#define _GNU_SOURCE // posix_spawn, pipe2, clock_gettime under -std=c23
 
 #include <ctype.h>
 #include <lauxlib.h>
@@ -17,6 +18,16 @@
 #include "config.h"
 #include "arena.c"
 #include "fileio.c"
+#include "bootstrap.c"
+#include "snapshot.c"
+#include "modindex.c"
+#include "bytecode.c"
+#include "helptags.c"
+#include "execprobe.c"
+#include "filewatch.c"
+#include "fuzzy.c"
+#include "walk.c"
+#include "grep.c"
 
 /* TYPES */
 #if PERFORMANCE
@@ -24,7 +35,8 @@
   PERF_TIME_X(Total) \
   PERF_TIME_X(Path) \
   PERF_TIME_X(Opt) \
-  PERF_TIME_X(Download)
+  PERF_TIME_X(Download) \
+  PERF_TIME_X(Helptags) /* inside Download, 0 while eager plugins are still cloning */
 
 enum Perf_Time : int
 {
@@ -46,15 +58,147 @@ static char const *g_perf_time_strings[] =
 #else // __linux__
   #error "OS not supported yet"
 #endif // OS
+
+#include "trace.c"
+
+static char const g_trace_file[] = "config_trace.json";
+
+#define TRACE_BEGIN(cat, name) trace_begin(&g_tracer, cat, name, NULL)
+#define TRACE_BEGIN_ARG(cat, name, arg) trace_begin(&g_tracer, cat, name, arg)
+#define TRACE_END() trace_end(&g_tracer)
+#else
+#define TRACE_BEGIN(cat, name) ((void)0)
+#define TRACE_BEGIN_ARG(cat, name, arg) ((void)0)
+#define TRACE_END() ((void)0)
 #endif // PERFORMANCE
 
+// where the sources are cloned from, -DPLUGIN_URL_BASE='"file:///tmp/mirror/"' points the bootstrap at local repos
+#ifndef PLUGIN_URL_BASE
+#define PLUGIN_URL_BASE "https://github.com/"
+#endif
+
+// every repository the config can install, relative to PLUGIN_URL_BASE, the directory name is the last part of it
+#define PLUGIN_SOURCE_LIST \
+  PLUGIN_SOURCE_X(MiniNvim, "nvim-mini/mini.nvim", NULL) \
+  PLUGIN_SOURCE_X(Plenary, "nvim-lua/plenary.nvim", NULL) \
+  PLUGIN_SOURCE_X(Sleuth, "tpope/vim-sleuth", NULL) \
+  PLUGIN_SOURCE_X(Gitsigns, "lewis6991/gitsigns.nvim", NULL) \
+  PLUGIN_SOURCE_X(Oil, "stevearc/oil.nvim", NULL) \
+  PLUGIN_SOURCE_X(Undotree, "jiaoshijie/undotree", NULL) \
+  PLUGIN_SOURCE_X(WhichKey, "folke/which-key.nvim", NULL) \
+  PLUGIN_SOURCE_X(Marks, "chentoast/marks.nvim", NULL) \
+  PLUGIN_SOURCE_X(Harpoon, "ThePrimeagen/harpoon", "harpoon2") \
+  PLUGIN_SOURCE_X(Lspconfig, "neovim/nvim-lspconfig", NULL) \
+  PLUGIN_SOURCE_X(Conform, "stevearc/conform.nvim", NULL) \
+  PLUGIN_SOURCE_X(Treesitter, "nvim-treesitter/nvim-treesitter", NULL) \
+  PLUGIN_SOURCE_X(TodoComments, "folke/todo-comments.nvim", NULL) \
+  PLUGIN_SOURCE_X(RenderMarkdown, "MeanderingProgrammer/render-markdown.nvim", NULL) \
+  PLUGIN_SOURCE_X(Colorizer, "catgoose/nvim-colorizer.lua", NULL) \
+  PLUGIN_SOURCE_X(Colortils, "max397574/colortils.nvim", NULL) \
+  PLUGIN_SOURCE_X(Ibl, "lukas-reineke/indent-blankline.nvim", NULL) \
+  PLUGIN_SOURCE_X(Zenbones, "zenbones-theme/zenbones.nvim", NULL) \
+  PLUGIN_SOURCE_X(Lush, "rktjmp/lush.nvim", NULL) \
+  PLUGIN_SOURCE_X(Nightfox, "EdenEast/nightfox.nvim", NULL) \
+  PLUGIN_SOURCE_X(Mellifluous, "ramojus/mellifluous.nvim", NULL) \
+  PLUGIN_SOURCE_X(Blossom, "rayes0/blossom.vim", NULL) \
+  PLUGIN_SOURCE_X(Flexoki, "kepano/flexoki-neovim", NULL) \
+  PLUGIN_SOURCE_X(Naysayer, "RostislavArts/naysayer.nvim", NULL) \
+  PLUGIN_SOURCE_X(Kanagawa, "rebelot/kanagawa.nvim", NULL)
+
+enum Plugin_Source : int
+{
+#define PLUGIN_SOURCE_X(n, url, checkout) Plugin_Source_##n,
+  PLUGIN_SOURCE_LIST
+#undef PLUGIN_SOURCE_X
+  Plugin_Source_Count,
+};
+
+static_assert(Plugin_Source_Count <= 64, "plugin sources are tracked in a 64 bit mask");
+static_assert(Plugin_Source_Count <= BOOTSTRAP_JOBS_MAX, "not enough bootstrap jobs for every plugin");
+
+static struct { char *url; char *checkout; } const g_plugin_sources[] =
+{
+#define PLUGIN_SOURCE_X(n, url, checkout) { PLUGIN_URL_BASE url, checkout },
+  PLUGIN_SOURCE_LIST
+#undef PLUGIN_SOURCE_X
+};
+
+#define PLUGIN_SOURCE(n) (1ULL << Plugin_Source_##n)
+
+// needed before the plugin section of the config can run
+#if MODE_THEME
+#define PLUGIN_SOURCES_EAGER ( \
+    PLUGIN_SOURCE(MiniNvim) | \
+    PLUGIN_SOURCE(Zenbones) | PLUGIN_SOURCE(Lush) | PLUGIN_SOURCE(Nightfox) | PLUGIN_SOURCE(Mellifluous) | \
+    PLUGIN_SOURCE(Blossom) | PLUGIN_SOURCE(Flexoki) | PLUGIN_SOURCE(Naysayer) | PLUGIN_SOURCE(Kanagawa))
+#else
+#define PLUGIN_SOURCES_EAGER PLUGIN_SOURCE(MiniNvim)
+#endif
+
+#define BOOTSTRAP_PARALLEL 8
+#define BOOTSTRAP_POLL_MS 50
+
+// compile time api values for the static tables, lengths come from sizeof instead of strlen
+#define NVIM_STRING_LIT(s) { .data = "" s, .size = sizeof("" s) - 1 }
+#define NVIM_OBJ_STRING_LIT(s) { .type = kObjectTypeString, .data.string = NVIM_STRING_LIT(s) }
+#define NVIM_OBJ_BOOL_LIT(b) { .type = kObjectTypeBoolean, .data.boolean = (b) }
+#define NVIM_OBJ_INT_LIT(i) { .type = kObjectTypeInteger, .data.integer = (i) }
+#define NVIM_KEY_BIT(typ, key) (1ULL << KEYSET_OPTIDX_##typ##__##key)
+
+struct NvimSetting
+{
+  String key;
+  Object val;
+};
+
+struct NvimKeymap
+{
+  String mode;
+  String key;
+  String action;
+};
+
+struct NvimHighlight
+{
+  String group;
+  Dict(highlight) opts;
+};
+
+#define NVIM_SETTING(k, v) { .key = NVIM_STRING_LIT(k), .val = v }
+#define NVIM_KEYMAP(m, k, a) { .mode = NVIM_STRING_LIT(m), .key = NVIM_STRING_LIT(k), .action = NVIM_STRING_LIT(a) }
+#define NVIM_KEYMAP_CMD(m, k, a) NVIM_KEYMAP(m, k, "<cmd>" a "<cr>")
+#define NVIM_HIGHLIGHT(g, keys, ...) { .group = NVIM_STRING_LIT(g), .opts = { .is_set__highlight_ = (keys), __VA_ARGS__ } }
+
 /* GLOBALS */
 static char const g_package_dir[] = "site/";
-static char const g_mini_plugin_dir[] = "pack/deps/opt/mini.nvim";
-static char const g_install_mini_nvim_command[] =
-  "git clone --filter=blob:none https://github.com/nvim-mini/mini.nvim ";
+static char const g_plugin_dir[] = "pack/deps/opt";
+static char const g_bytecode_file[] = "/config.bytecode"; // under stdpath("cache")
+static char const g_modindex_file[] = "/config.modules"; // under stdpath("cache")
+static char const g_helptags_file[] = "helptags.stamps"; // under stdpath("data")
 static uint8_t g_lua_macro_latch;
 
+static char *g_package_path;
+static uint g_package_path_len;
+
+// sources that are still being cloned by the bootstrap
+static struct Bootstrap g_bootstrap;
+static uint64_t g_plugin_sources_pending;
+static int g_bootstrap_timer = LUA_NOREF;
+static bool g_config_plugins_done;
+
+static struct BytecodePack g_bytecode_pack;
+static struct ModuleIndex g_module_index;
+
+// autoread, the uv poll handle on the inotify fd stays referenced for the whole session
+static struct FileWatch g_file_watch;
+static int g_file_watch_poll = LUA_NOREF;
+static bool g_file_watch_scheduled;
+
+#if PERFORMANCE
+static struct Tracer g_tracer;
+static struct timespec g_perf_times[Perf_Time_Count][2];
+#endif
+
 static char const *g_lsp_servers[] =
 {
   "lua_ls",
@@ -65,6 +209,248 @@ static char const *g_lsp_servers[] =
   "cssls",
 };
 
+#if MODE_FORMATTER
+// every formatter conform may run: name in conform, executable it needs on $PATH
+// NOTE: within a filetype conform runs them in this order (isort before black)
+#define FORMATTER_LIST \
+  FORMATTER_X(ClangFormat, "clang-format", "clang-format") \
+  FORMATTER_X(Odinfmt, "odinfmt", "odinfmt") \
+  FORMATTER_X(Rustfmt, "rustfmt", "rustfmt") \
+  FORMATTER_X(Fourmolu, "fourmolu", "fourmolu") \
+  FORMATTER_X(Ormolu, "ormolu", "ormolu") \
+  FORMATTER_X(Cljfmt, "cljfmt", "cljfmt") \
+  FORMATTER_X(GoogleJavaFormat, "google-java-format", "google-java-format") \
+  FORMATTER_X(Csharpier, "csharpier", "csharpier") \
+  FORMATTER_X(Stylua, "stylua", "stylua") \
+  FORMATTER_X(PurescriptTidy, "purescript-tidy", "purs-tidy") \
+  FORMATTER_X(Prettier, "prettier", "prettier") \
+  FORMATTER_X(Biome, "biome", "biome") \
+  FORMATTER_X(RuffFormat, "ruff_format", "ruff") \
+  FORMATTER_X(Isort, "isort", "isort") \
+  FORMATTER_X(Black, "black", "black")
+
+enum Formatter : int
+{
+#define FORMATTER_X(n, name, exe) Formatter_##n,
+  FORMATTER_LIST
+#undef FORMATTER_X
+  Formatter_Count,
+};
+
+static_assert(Formatter_Count <= EXECPROBE_NAMES_MAX, "one probe bit per formatter");
+
+static char const *const g_formatter_names[] =
+{
+#define FORMATTER_X(n, name, exe) name,
+  FORMATTER_LIST
+#undef FORMATTER_X
+};
+
+static char const *const g_formatter_executables[] =
+{
+#define FORMATTER_X(n, name, exe) exe,
+  FORMATTER_LIST
+#undef FORMATTER_X
+};
+
+#define FORMATTER(n) (1ULL << Formatter_##n)
+#define FORMATTER_FT_CHOICES_MAX 2
+
+// the first choice with all of its executables on $PATH wins
+static struct { char const *ft; uint64_t choices[FORMATTER_FT_CHOICES_MAX]; } const g_formatters_by_ft[] =
+{
+  { "c", { FORMATTER(ClangFormat) } },
+  { "cpp", { FORMATTER(ClangFormat) } },
+  { "odin", { FORMATTER(Odinfmt) } },
+  { "rust", { FORMATTER(Rustfmt) } },
+  { "haskell", { FORMATTER(Fourmolu), FORMATTER(Ormolu) } },
+  { "clojure", { FORMATTER(Cljfmt) } },
+  { "java", { FORMATTER(GoogleJavaFormat) } },
+  { "cs", { FORMATTER(Csharpier) } },
+  { "lua", { FORMATTER(Stylua) } },
+  { "purescript", { FORMATTER(PurescriptTidy) } },
+  { "html", { FORMATTER(Prettier) } },
+  { "typescript", { FORMATTER(Biome) } },
+  { "javascript", { FORMATTER(Biome) } },
+  { "python", { FORMATTER(RuffFormat), FORMATTER(Isort) | FORMATTER(Black) } },
+};
+
+// started by luaopen_config, it probes while the rest of startup runs
+static struct ExecProbe g_formatter_probe;
+#endif // MODE_FORMATTER
+
+static struct NvimSetting const g_vars[] =
+{
+  NVIM_SETTING("mapleader", NVIM_OBJ_STRING_LIT(" ")),
+  NVIM_SETTING("maplocalleader", NVIM_OBJ_STRING_LIT(",")),
+};
+
+static struct NvimSetting const g_options[] =
+{
+  // Make line numbers default
+  NVIM_SETTING("number", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("relativenumber", NVIM_OBJ_BOOL_LIT(true)),
+
+  // Enable mouse mode (useful for resizing splits)
+  NVIM_SETTING("mouse", NVIM_OBJ_STRING_LIT("a")),
+
+  // Save undo history
+  NVIM_SETTING("undofile", NVIM_OBJ_BOOL_LIT(true)),
+
+  // Case-insensitive searching UNLESS \C or one or more capital letters in the search term
+  NVIM_SETTING("ignorecase", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("smartcase", NVIM_OBJ_BOOL_LIT(true)),
+
+  // Keep signcolumn on by default
+  NVIM_SETTING("signcolumn", NVIM_OBJ_STRING_LIT("yes")),
+
+  // Decrease update time
+  NVIM_SETTING("updatetime", NVIM_OBJ_INT_LIT(50)),
+
+  // Increase time before timeout
+  NVIM_SETTING("timeout", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("timeoutlen", NVIM_OBJ_INT_LIT(1'000)),
+
+  // Configure how new splits should be opened
+  NVIM_SETTING("splitright", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("splitbelow", NVIM_OBJ_BOOL_LIT(true)),
+
+  // See `:help 'list'` and `:help 'listchars'`
+  NVIM_SETTING("list", NVIM_OBJ_BOOL_LIT(true)),
+  // maybe useful: 'precedes:⟨'
+  NVIM_SETTING("listchars", NVIM_OBJ_STRING_LIT("tab:» ,trail:·,nbsp:␣,extends:⟩")),
+
+  // Preview substitutions live, as you type!
+  NVIM_SETTING("inccommand", NVIM_OBJ_STRING_LIT("split")),
+
+  // Show which line your cursor is on
+  // NVIM_SETTING("cursorline", NVIM_OBJ_BOOL_LIT(true)),
+
+  // Minimal number of screen lines to keep above and below the cursor.
+  // NVIM_SETTING("scrolloff", NVIM_OBJ_INT_LIT(1)),
+  NVIM_SETTING("sidescrolloff", NVIM_OBJ_INT_LIT(20)),
+
+  // Tabs
+  NVIM_SETTING("tabstop", NVIM_OBJ_INT_LIT(4)),
+  NVIM_SETTING("softtabstop", NVIM_OBJ_INT_LIT(4)),
+  NVIM_SETTING("shiftwidth", NVIM_OBJ_INT_LIT(4)),
+  NVIM_SETTING("expandtab", NVIM_OBJ_BOOL_LIT(true)),
+
+  // Dont pass this marker
+  NVIM_SETTING("colorcolumn", NVIM_OBJ_STRING_LIT("80")),
+
+  // Linewraps
+  NVIM_SETTING("showbreak", NVIM_OBJ_STRING_LIT("└▶")),
+  NVIM_SETTING("wrap", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("linebreak", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("breakindent", NVIM_OBJ_BOOL_LIT(true)),
+  NVIM_SETTING("breakindentopt", NVIM_OBJ_STRING_LIT("list:-1")),
+
+  // Disable cursor changing
+  NVIM_SETTING("guicursor", NVIM_OBJ_STRING_LIT("n-v-c:block")),
+
+  // cinkeys
+  NVIM_SETTING("cinkeys", NVIM_OBJ_STRING_LIT("0{,0},0),0],:,!^F,o,O,e")),
+
+  // cinoptions
+  NVIM_SETTING("cinoptions", NVIM_OBJ_STRING_LIT(":0,l1,b1,=0")),
+
+  // autoread
+  NVIM_SETTING("autoread", NVIM_OBJ_BOOL_LIT(true)),
+
+  // completion
+  NVIM_SETTING("wildmode", NVIM_OBJ_STRING_LIT("longest:full")),
+  NVIM_SETTING("wildmenu", NVIM_OBJ_BOOL_LIT(true)),
+
+  NVIM_SETTING("completeopt", NVIM_OBJ_STRING_LIT("longest,noselect")),
+
+  // Set highlight on search, but clear on pressing <Esc> in normal mode
+  NVIM_SETTING("hlsearch", NVIM_OBJ_BOOL_LIT(true)),
+};
+
+static struct NvimKeymap const g_keymaps[] =
+{
+  // Auto Completion
+  NVIM_KEYMAP("i", "<c-space>", "<c-x><c-o>"),
+
+  // Terminal Binds
+  NVIM_KEYMAP("t", "<C-w>", "<c-\\><c-n><C-w>"),
+
+  // Navigation
+  /// Center Screen When Scrolling
+  // NVIM_KEYMAP("n", "<C-d>", "<C-d>zz"),
+  // NVIM_KEYMAP("n", "<C-u>", "<C-u>zz"),
+
+  /// Navigate Wrapped Lines
+  NVIM_KEYMAP("n", "j", "gj"),
+  NVIM_KEYMAP("n", "k", "gk"),
+  NVIM_KEYMAP("v", "j", "gj"),
+  NVIM_KEYMAP("v", "k", "gk"),
+
+  // Yanks
+  NVIM_KEYMAP("n", "<leader>y", "\"+y"),
+  NVIM_KEYMAP("v", "<leader>y", "\"+y"),
+  NVIM_KEYMAP("n", "<leader>Y", "\"+Y"),
+
+  // clear hlsearch
+  NVIM_KEYMAP("n", "<esc>", "<cmd>nohlsearch<cr><esc>"),
+
+  // Diagnostics
+  NVIM_KEYMAP_CMD("n", "<leader>uq", "copen"),
+  NVIM_KEYMAP_CMD("n", "<leader>ul", "lopen"),
+
+  // Code
+  NVIM_KEYMAP_CMD("n", "<leader>cw", "cd %:p:h"), // move nvim base path to current buffer
+  NVIM_KEYMAP_CMD("n", "<leader>cm", "Man"),
+  NVIM_KEYMAP_CMD("n", "<leader>cW", "lua g_trim_trailing_whitespace()"), // remove trailing whitespace
+
+  // Toggle
+  NVIM_KEYMAP_CMD("n", "<leader>tw", "lua vim.o.wrap = not vim.o.wrap"),
+
+  // Make
+  NVIM_KEYMAP_CMD("n", "<leader>mm", "make"),
+  // TODO: handle windows and mac
+  NVIM_KEYMAP_CMD("n", "<leader>mb",
+      "lua if vim.loop.os_uname().sysname == 'Linux' then vim.o.makeprg = 'bash build.sh' end"),
+  NVIM_KEYMAP_CMD("n", "<leader>mc",
+    "lua vim.ui.input({ prompt = 'Make Command: ', default = vim.o.makeprg }, "
+      "function(usr_input) if usr_input ~= nil and usr_input ~= '' then vim.o.makeprg = usr_input end end)"),
+
+  // UI
+  NVIM_KEYMAP_CMD("n", "<leader>um", "messages"),
+
+  // Toggle
+  NVIM_KEYMAP_CMD("n", "<leader>th", "ColorizerToggle"),
+
+  // Windows
+  NVIM_KEYMAP_CMD("n", "<leader>v", "vsp"),
+  NVIM_KEYMAP_CMD("n", "<leader>wv", "vsp"),
+  NVIM_KEYMAP_CMD("n", "<leader>x", "sp"),
+  NVIM_KEYMAP_CMD("n", "<leader>wx", "sp"),
+  NVIM_KEYMAP_CMD("n", "<leader>wt", "tab split"),
+
+  NVIM_KEYMAP_CMD("n", "<leader>w|", "vertical resize"),
+  NVIM_KEYMAP_CMD("n", "<leader>w_", "horizontal resize"),
+  NVIM_KEYMAP_CMD("n", "<leader>ws", "wincmd ="),
+  NVIM_KEYMAP("n", "<leader>wf", "<cmd>horizontal resize<cr><cmd>vertical resize<cr>"),
+
+  NVIM_KEYMAP_CMD("n", "<leader>wN", "setlocal buftype=nofile"), // turn off ability to save
+};
+
+// applied after the colorscheme
+static struct NvimHighlight const g_highlights[] =
+{
+  NVIM_HIGHLIGHT("ColorColumn", NVIM_KEY_BIT(highlight, bg), .bg = NVIM_OBJ_STRING_LIT("#CFCFDA")),
+  NVIM_HIGHLIGHT("Whitespace", NVIM_KEY_BIT(highlight, fg), .fg = NVIM_OBJ_STRING_LIT("#D0D1D8")),
+  NVIM_HIGHLIGHT("Comment", NVIM_KEY_BIT(highlight, italic), .italic = true),
+};
+
+// every group below these prefixes is cleared, the lsp semantic tokens lose to treesitter
+static String const g_highlight_clears[] =
+{
+  NVIM_STRING_LIT("@lsp"),
+};
+
 /* HELPERS */
 // Variable Type Constructors
 static inline String
@@ -139,9 +525,11 @@ nvim_set_g(
     char *key,
     Object val)
 {
+  TRACE_BEGIN("var", key);
   Error e = ERROR_INIT;
   nvim_set_var(nvim_mk_string(key), val, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
 }
 
 static inline void
@@ -150,10 +538,12 @@ nvim_set_o(
     char *key,
     Object val)
 {
+  TRACE_BEGIN("option", key);
   Dict(option) o = {0};
   Error e = ERROR_INIT;
   nvim_set_option_value(0, nvim_mk_string(key), val, &o, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
 }
 
 static inline Object
@@ -177,12 +567,14 @@ nvim_map_bufnr(
     char *key,
     char *action)
 {
+  TRACE_BEGIN_ARG("map", key, mode);
   Dict(keymap) o = {0};
   PUT_KEY(o, keymap, noremap, true);
   PUT_KEY(o, keymap, silent, true);
   Error e = ERROR_INIT;
   nvim_buf_set_keymap(0, bufnr, nvim_mk_string(mode), nvim_mk_string(key), nvim_mk_string(action), &o, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
 }
 
 static inline void
@@ -192,25 +584,263 @@ nvim_map(
     char *key,
     char *action)
 {
+  TRACE_BEGIN_ARG("map", key, mode);
   Dict(keymap) o = {0};
   PUT_KEY(o, keymap, noremap, true);
   PUT_KEY(o, keymap, silent, true);
   Error e = ERROR_INIT;
   nvim_set_keymap(0, nvim_mk_string(mode), nvim_mk_string(key), nvim_mk_string(action), &o, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
 }
 
 #define NVIM_MAP_CMD(L, mode, key, action) nvim_map(L, mode, key, "<cmd>" action "<cr>")
 
 static inline void
-nvim_highlight(
+nvim_map_callback(
+    lua_State *L,
+    char *mode,
+    char *key,
+    char *desc,
+    LuaRef callback)
+{
+  TRACE_BEGIN_ARG("map", key, mode);
+  Dict(keymap) o = {0};
+  PUT_KEY(o, keymap, noremap, true);
+  PUT_KEY(o, keymap, silent, true);
+  PUT_KEY(o, keymap, desc, nvim_mk_string(desc));
+  PUT_KEY(o, keymap, callback, callback);
+  Error e = ERROR_INIT;
+  nvim_set_keymap(0, nvim_mk_string(mode), nvim_mk_string(key), nvim_mk_string(""), &o, &e);
+  if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
+}
+
+// Static Tables
+static inline void
+nvim_set_g_table(
+    lua_State *L,
+    struct NvimSetting const *vars,
+    uint vars_len)
+{
+  Error e = ERROR_INIT;
+  for(uint i = 0;
+      i < vars_len;
+      i += 1)
+  {
+    TRACE_BEGIN("var", vars[i].key.data);
+    nvim_set_var(vars[i].key, vars[i].val, &e);
+    if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+    TRACE_END();
+  }
+}
+
+static inline void
+nvim_set_o_table(
     lua_State *L,
-    char *group,
-    Dict(highlight) opts)
+    struct NvimSetting const *opts,
+    uint opts_len)
+{
+  Dict(option) o = {0};
+  Error e = ERROR_INIT;
+  for(uint i = 0;
+      i < opts_len;
+      i += 1)
+  {
+    TRACE_BEGIN("option", opts[i].key.data);
+    nvim_set_option_value(0, opts[i].key, opts[i].val, &o, &e);
+    if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+    TRACE_END();
+  }
+}
+
+static inline void
+nvim_map_table(
+    lua_State *L,
+    struct NvimKeymap const *maps,
+    uint maps_len)
+{
+  Dict(keymap) o = {0};
+  PUT_KEY(o, keymap, noremap, true);
+  PUT_KEY(o, keymap, silent, true);
+  Error e = ERROR_INIT;
+  for(uint i = 0;
+      i < maps_len;
+      i += 1)
+  {
+    TRACE_BEGIN_ARG("map", maps[i].key.data, maps[i].mode.data);
+    nvim_set_keymap(0, maps[i].mode, maps[i].key, maps[i].action, &o, &e);
+    if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+    TRACE_END();
+  }
+}
+
+// Highlights
+// The desired state is g_highlights (exactly those keys) and every group under g_highlight_clears empty.
+// One nvim_get_hl reads every definition, the groups that already match are skipped and the rest
+// are set in one pass after the diff, nvim recomputes the highlights once on the next redraw.
+#define HIGHLIGHT_BOOL_LIST \
+  HIGHLIGHT_BOOL_X(bold) \
+  HIGHLIGHT_BOOL_X(standout) \
+  HIGHLIGHT_BOOL_X(strikethrough) \
+  HIGHLIGHT_BOOL_X(underline) \
+  HIGHLIGHT_BOOL_X(undercurl) \
+  HIGHLIGHT_BOOL_X(underdouble) \
+  HIGHLIGHT_BOOL_X(underdotted) \
+  HIGHLIGHT_BOOL_X(underdashed) \
+  HIGHLIGHT_BOOL_X(italic) \
+  HIGHLIGHT_BOOL_X(reverse) \
+  HIGHLIGHT_BOOL_X(altfont) \
+  HIGHLIGHT_BOOL_X(nocombine)
+
+#define HIGHLIGHT_COLOR_LIST \
+  HIGHLIGHT_COLOR_X(fg) \
+  HIGHLIGHT_COLOR_X(bg) \
+  HIGHLIGHT_COLOR_X(sp)
+
+#define HIGHLIGHT_CTERM_KEYS \
+  (NVIM_KEY_BIT(highlight, cterm) | NVIM_KEY_BIT(highlight, ctermfg) | NVIM_KEY_BIT(highlight, ctermbg))
+
+static struct { uint syncs; uint groups; uint applied; } g_highlight_stats;
+
+// nvim_get_hl gives colors as integers, the tables use "#rrggbb"
+static inline int64_t
+nvim_highlight_color(
+    Object color)
+{
+  if(color.type == kObjectTypeInteger) { return color.data.integer; }
+  if(color.type == kObjectTypeString && color.data.string.size == 7 && color.data.string.data[0] == '#')
+  {
+    char *end;
+    long rgb = strtol(color.data.string.data + 1, &end, 16);
+    if(end == color.data.string.data + 7) { return rgb; }
+  }
+  return -1; // a color name, never equal so it is always set
+}
+
+// nvim_set_hl replaces the whole definition, so every key of current has to be wanted
+static inline bool
+nvim_highlight_equal(
+    Dict current,
+    Dict(highlight) const *want)
+{
+  uint matched = 0;
+  for(size_t i = 0;
+      i < current.size;
+      i += 1)
+  {
+    char const *key = current.items[i].key.data;
+    Object value = current.items[i].value;
+    bool ok = false;
+    if(strncmp(key, "cterm", 5) == 0 && (want->is_set__highlight_ & HIGHLIGHT_CTERM_KEYS) == 0)
+    {
+      continue; // derived from the gui attributes
+    }
+#define HIGHLIGHT_BOOL_X(k) \
+    else if(strcmp(key, #k) == 0) \
+    { \
+      ok = HAS_KEY(want, highlight, k) && value.type == kObjectTypeBoolean && value.data.boolean == want->k; \
+    }
+    HIGHLIGHT_BOOL_LIST
+#undef HIGHLIGHT_BOOL_X
+#define HIGHLIGHT_COLOR_X(k) \
+    else if(strcmp(key, #k) == 0) \
+    { \
+      ok = HAS_KEY(want, highlight, k) && nvim_highlight_color(value) == nvim_highlight_color(want->k); \
+    }
+    HIGHLIGHT_COLOR_LIST
+#undef HIGHLIGHT_COLOR_X
+    if(!ok) { return false; }
+    matched += 1;
+  }
+  return matched == (uint)__builtin_popcountll(want->is_set__highlight_);
+}
+
+static inline bool
+nvim_highlight_cleared(
+    String group)
+{
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(g_highlight_clears);
+      i += 1)
+  {
+    String prefix = g_highlight_clears[i];
+    if(group.size >= prefix.size && memcmp(group.data, prefix.data, prefix.size) == 0) { return true; }
+  }
+  return false;
+}
+
+// diffs the desired state against the current definitions and applies the difference
+static inline void
+highlight_sync(
+    lua_State *L)
 {
+  TRACE_BEGIN("highlight", "sync");
+  Arena arena = ARENA_EMPTY;
   Error e = ERROR_INIT;
-  nvim_set_hl(0, 0, nvim_mk_string(group), &opts, &e);
+  Dict(get_highlight) get = {0};
+  Dict all = nvim_get_hl(0, &get, &arena, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+
+  // diff
+  String *clears = malloc(Max(all.size, 1) * sizeof(*clears));
+  ASSERT(L, clears != NULL);
+  uint clears_len = 0;
+  bool override_equal[STATIC_ARRAY_SIZE(g_highlights)] = {0};
+  for(size_t i = 0;
+      i < all.size;
+      i += 1)
+  {
+    String group = all.items[i].key;
+    Object def = all.items[i].value;
+    bool empty = def.type != kObjectTypeDict || def.data.dict.size == 0;
+    if(nvim_highlight_cleared(group))
+    {
+      if(!empty) { clears[clears_len++] = group; }
+      continue;
+    }
+
+    for(uint j = 0;
+        j < STATIC_ARRAY_SIZE(g_highlights);
+        j += 1)
+    {
+      if(group.size != g_highlights[j].group.size || memcmp(group.data, g_highlights[j].group.data, group.size) != 0)
+      {
+        continue;
+      }
+      override_equal[j] = !empty && nvim_highlight_equal(def.data.dict, &g_highlights[j].opts);
+      break;
+    }
+  }
+
+  // apply
+  Dict(highlight) cleared = {0};
+  for(uint i = 0;
+      i < clears_len;
+      i += 1)
+  {
+    nvim_set_hl(0, 0, clears[i], &cleared, &e);
+    if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  }
+  uint applied = clears_len;
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(g_highlights);
+      i += 1)
+  {
+    if(override_equal[i]) { continue; }
+    Dict(highlight) opts = g_highlights[i].opts;
+    nvim_set_hl(0, 0, g_highlights[i].group, &opts, &e);
+    if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+    applied += 1;
+  }
+
+  g_highlight_stats.syncs += 1;
+  g_highlight_stats.groups += all.size;
+  g_highlight_stats.applied += applied;
+
+  free(clears);
+  arena_mem_free(arena_finish(&arena));
+  TRACE_END();
 }
 
 // Auto Cmds
@@ -223,6 +853,7 @@ nvim_mk_autocmd_callback(
     bool augroup_clear,
     Union(String, LuaRefOf((DictAs(create_autocmd__callback_args) args), *Boolean)) callback)
 {
+  TRACE_BEGIN_ARG("autocmd", augroup_name, name);
   Arena arena = ARENA_EMPTY;
   Error e = ERROR_INIT;
 
@@ -237,12 +868,14 @@ nvim_mk_autocmd_callback(
 
   Integer n = nvim_create_autocmd(0, nvim_mk_obj_string(name), &autocmd, &arena, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
   return n;
 }
 
 #define NVIM_MK_AUTOCMD_CALLBACK(L, name, desc, augroup_name, augroup_clear, callback) do { \
-  lua_register(L, "g_" STRINGIFY(callback), callback); \
-  lua_getglobal(L, "g_" STRINGIFY(callback)); \
+  MLUA_PUSH_CALLBACK(L, callback); \
+  lua_pushvalue(L, -1); \
+  lua_setglobal(L, "g_" STRINGIFY(callback)); \
   int lua_ref_##callback = luaL_ref(L, LUA_REGISTRYINDEX); \
   nvim_mk_autocmd_callback(L, name, desc, augroup_name, augroup_clear, \
       nvim_mk_obj_luaref(lua_ref_##callback)); \
@@ -257,6 +890,7 @@ nvim_mk_autocmd_command(
     bool augroup_clear,
     String command)
 {
+  TRACE_BEGIN_ARG("autocmd", augroup_name, name);
   Arena arena = ARENA_EMPTY;
   Error e = ERROR_INIT;
 
@@ -271,6 +905,7 @@ nvim_mk_autocmd_command(
 
   Integer n = nvim_create_autocmd(0, nvim_mk_obj_string(name), &autocmd, &arena, &e);
   if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+  TRACE_END();
   return n;
 }
 
@@ -307,6 +942,20 @@ mlua_stack_dump_temp(
 }
 
 // lua api
+static inline void
+mlua_push_plugin_source(
+    lua_State *L,
+    enum Plugin_Source n)
+{
+  lua_pushstring(L, g_plugin_sources[n].url);
+  lua_setfield(L, -2, "source");
+  if(g_plugin_sources[n].checkout != NULL)
+  {
+    lua_pushstring(L, g_plugin_sources[n].checkout);
+    lua_setfield(L, -2, "checkout");
+  }
+}
+
 #define MLUA_PCALL(L, in, out) ASSERT(L, lua_pcall(L, in, out, 0) == 0)
 
 #define MLUA_PCALL_VOID(L, in) do { MLUA_PCALL(L, in, 0); lua_pop(L, 1); } while(0)
@@ -321,13 +970,18 @@ mlua_stack_dump_temp(
 
 #define MLUA_REQUIRE_SETUP(L, name) do { MLUA_REQUIRE(L, name); ASSERT(L, lua_istable(L, -1)); lua_getfield(L, -1, "setup"); } while(0)
 
-#define MLUA_REQUIRE_SETUP_CALL(L, name) do { MLUA_REQUIRE_SETUP(L, name); MLUA_PCALL_VOID(L, 0); } while(0)
+#define MLUA_REQUIRE_SETUP_CALL(L, name) do { \
+  TRACE_BEGIN("setup", name); MLUA_REQUIRE_SETUP(L, name); MLUA_PCALL_VOID(L, 0); TRACE_END(); \
+} while(0)
 
-#define MLUA_REQUIRE_SETUP_TABLE_CALL(L, name) do { MLUA_REQUIRE_SETUP(L, name); lua_createtable(L, 0, 0); MLUA_PCALL_VOID(L, 1); } while(0)
+#define MLUA_REQUIRE_SETUP_TABLE_CALL(L, name) do { \
+  TRACE_BEGIN("setup", name); MLUA_REQUIRE_SETUP(L, name); lua_createtable(L, 0, 0); MLUA_PCALL_VOID(L, 1); TRACE_END(); \
+} while(0)
 
 #define MLUA_REQUIRE_SETUP_TABLE(L, name, an, tn) \
   for( \
       g_lua_macro_latch = 1, \
+        TRACE_BEGIN("setup", name), \
         lua_getglobal(L, "require"), \
         lua_pushstring(L, name), \
         MLUA_PCALL(L, 1, 1), \
@@ -337,19 +991,24 @@ mlua_stack_dump_temp(
       g_lua_macro_latch; \
       g_lua_macro_latch = 0, \
         MLUA_PCALL(L, 1, 0), \
-        lua_pop(L, 1))
+        lua_pop(L, 1), \
+        TRACE_END())
 
-#define MLUA_MINIDEPS_ADD(L, an, tn) \
+// the spec gets the source (and checkout) of PLUGIN_SOURCE_LIST entry n, the body adds the rest
+#define MLUA_MINIDEPS_ADD(L, n, an, tn) \
   for( \
       g_lua_macro_latch = 1, \
+        TRACE_BEGIN("deps", bootstrap_url_name(g_plugin_sources[Plugin_Source_##n].url)), \
         lua_getglobal(L, "MiniDeps"), \
         ASSERT(L, lua_istable(L, -1)), \
         lua_getfield(L, -1, "add"), \
-        lua_createtable(L, an, tn); \
+        lua_createtable(L, an, tn), \
+        mlua_push_plugin_source(L, Plugin_Source_##n); \
       g_lua_macro_latch; \
       g_lua_macro_latch = 0, \
         MLUA_PCALL(L, 1, 0), \
-        lua_pop(L, 1))
+        lua_pop(L, 1), \
+        TRACE_END())
 
 #define MLUA_PUSH_KV(L, k) \
   for( \
@@ -404,490 +1063,2064 @@ mlua_stack_dump_temp(
       g_lua_macro_latch = 0, \
         lua_rawseti(L, -2, i))
 
-/* MAIN */
-static struct { char *filetype; char *comment; } const g_mini_comment_custom_commentstring_strings[] =
-{
-  {"v", "/* %s */"},
-};
-
-int
-mini_comment_custom_commentstring(
-    lua_State *L)
+static inline void
+mlua_echo(
+    lua_State *L,
+    bool history,
+    char const *msg)
 {
   lua_getglobal(L, "vim");
-  lua_getfield(L, -1, "bo");
-  lua_getfield(L, -1, "ft");
-  ASSERT(L, lua_isstring(L, -1));
-  char const *ft = lua_tostring(L, -1);
-  lua_pop(L, 4);
-
-  for(int i = 0;
-      i < (int)STATIC_ARRAY_SIZE(g_mini_comment_custom_commentstring_strings);
-      i += 1)
+  lua_getfield(L, -1, "api");
+  lua_getfield(L, -1, "nvim_echo");
+  lua_createtable(L, 1, 0);
   {
-    if(strcmp(ft, g_mini_comment_custom_commentstring_strings[i].filetype)
-        == 0)
+    MLUA_PUSH_IDX_TABLE(L, 1, 1, 0)
     {
-      lua_pushlstring(
-          L,
-          g_mini_comment_custom_commentstring_strings[i].comment,
-          sizeof(g_mini_comment_custom_commentstring_strings[i].comment));
-      return 1;
+      MLUA_PUSH_IDX(L, 1) { lua_pushstring(L, msg); }
     }
   }
-
-  lua_pushnil(L);
-  return 1;
+  lua_pushboolean(L, history);
+  lua_createtable(L, 0, 0);
+  MLUA_PCALL(L, 3, 0);
+  lua_pop(L, 2);
 }
 
-int
-mini_pick_window_config(
-    lua_State *L)
+#define MLUA_ECHO_FMT(L, history, ...) do { \
+  char mlua_echo_buf[512]; \
+  if(snprintf(mlua_echo_buf, sizeof(mlua_echo_buf), __VA_ARGS__) >= 0) { mlua_echo(L, history, mlua_echo_buf); } \
+} while(0)
+
+/* LUA REFS */
+// Hot paths through lua globals, resolved on first use and kept as registry refs after that.
+// A ref that belongs to a module is dropped (with everything below it) when the module loader
+// sees that module load again. nil is never kept, a module that is not loaded yet is looked up next time.
+// NO_LUA_REFS walks every path on every use, to compare callback latencies against
+#define MLUA_REF_LIST \
+  MLUA_REF_X(Vim, Global, "vim", NULL) \
+  MLUA_REF_X(VimBo, Vim, "bo", NULL) \
+  MLUA_REF_X(VimApi, Vim, "api", NULL) \
+  MLUA_REF_X(VimFn, Vim, "fn", NULL) \
+  MLUA_REF_X(VimSchedule, Vim, "schedule", NULL) \
+  MLUA_REF_X(VimFnMode, VimFn, "mode", NULL) \
+  MLUA_REF_X(NvimInput, VimApi, "nvim_input", NULL) \
+  MLUA_REF_X(VimLsp, Vim, "lsp", "vim.lsp") \
+  MLUA_REF_X(VimLspGetClientById, VimLsp, "get_client_by_id", "vim.lsp") \
+  MLUA_REF_X(VimLspCompletion, VimLsp, "completion", "vim.lsp.completion") \
+  MLUA_REF_X(VimLspCompletionEnable, VimLspCompletion, "enable", "vim.lsp.completion") \
+  MLUA_REF_X(MiniPick, Global, "MiniPick", "mini.pick") \
+  MLUA_REF_X(MiniPickGetPickerOpts, MiniPick, "get_picker_opts", "mini.pick") \
+  MLUA_REF_X(MiniPickDefaultMatch, MiniPick, "default_match", "mini.pick") \
+  MLUA_REF_X(MiniPickStart, MiniPick, "start", "mini.pick") \
+  MLUA_REF_X(MiniPickIsPickerActive, MiniPick, "is_picker_active", "mini.pick") \
+  MLUA_REF_X(MiniPickSetPickerItems, MiniPick, "set_picker_items", "mini.pick")
+
+// a parent always comes before its children
+enum Mlua_Ref : int
 {
-  Object lines = nvim_get_o(L, "lines");
-  Object columns = nvim_get_o(L, "columns");
-  ASSERT(L, lines.type == kObjectTypeInteger);
-  ASSERT(L, columns.type == kObjectTypeInteger);
-  lua_createtable(L, 0, 4);
+  Mlua_Ref_Global = -1,
+#define MLUA_REF_X(n, parent, field, module) Mlua_Ref_##n,
+  MLUA_REF_LIST
+#undef MLUA_REF_X
+  Mlua_Ref_Count,
+};
+
+static struct { enum Mlua_Ref parent; char const *field; char const *module; } const g_mlua_ref_paths[] =
+{
+#define MLUA_REF_X(n, parent, field, module) { Mlua_Ref_##parent, field, module },
+  MLUA_REF_LIST
+#undef MLUA_REF_X
+};
+
+static int g_mlua_refs[Mlua_Ref_Count]; // 0 is unresolved, luaL_ref never hands it out
+
+// always pushes one value, false when it is nil
+static inline bool
+mlua_push_ref(
+    lua_State *L,
+    enum Mlua_Ref r)
+{
+#if !NO_LUA_REFS
+  if(g_mlua_refs[r] != 0)
   {
-    MLUA_PUSH_KV(L, "row") { lua_pushnumber(L, 0); }
-    MLUA_PUSH_KV(L, "col") { lua_pushnumber(L, 0); }
-    MLUA_PUSH_KV(L, "height") { lua_pushinteger(L, lines.data.integer); }
-    MLUA_PUSH_KV(L, "width") { lua_pushinteger(L, columns.data.integer); }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_mlua_refs[r]);
+    return true;
   }
-  return 1;
+#endif
+
+  if(g_mlua_ref_paths[r].parent == Mlua_Ref_Global)
+  {
+    lua_getglobal(L, g_mlua_ref_paths[r].field);
+  }
+  else
+  {
+    if(!mlua_push_ref(L, g_mlua_ref_paths[r].parent)) { return false; }
+    lua_getfield(L, -1, g_mlua_ref_paths[r].field);
+    lua_remove(L, -2);
+  }
+  if(lua_isnil(L, -1)) { return false; }
+
+#if !NO_LUA_REFS
+  lua_pushvalue(L, -1);
+  g_mlua_refs[r] = luaL_ref(L, LUA_REGISTRYINDEX);
+#endif
+  return true;
 }
 
-int
-mini_pick_choose_all(
-    lua_State *L)
+// module loader hook, name is about to be (re)loaded
+static void
+mlua_drop_refs(
+    lua_State *L,
+    char const *name,
+    uint name_len)
 {
-  lua_getglobal(L, "MiniPick");
-  lua_getfield(L, -1, "get_picker_opts");
-  MLUA_PCALL(L, 0, 1);
-  lua_getfield(L, -1, "mappings");
-  int mappings_idx = lua_gettop(L);
+  bool dropped[Mlua_Ref_Count] = {0};
+  for(int i = 0;
+      i < Mlua_Ref_Count;
+      i += 1)
+  {
+    char const *module = g_mlua_ref_paths[i].module;
+    enum Mlua_Ref parent = g_mlua_ref_paths[i].parent;
+    dropped[i] = (module != NULL && strlen(module) == name_len && memcmp(module, name, name_len) == 0)
+      || (parent != Mlua_Ref_Global && dropped[parent]);
+    if(dropped[i] && g_mlua_refs[i] != 0)
+    {
+      luaL_unref(L, LUA_REGISTRYINDEX, g_mlua_refs[i]);
+      g_mlua_refs[i] = 0;
+    }
+  }
+}
 
-  lua_getfield(L, mappings_idx, "mark_all");
-  lua_getfield(L, mappings_idx, "choose_marked");
+// PERFORMANCE builds time every callback pushed through MLUA_PUSH_CALLBACK, see :ConfigCallbackTimes
+#if PERFORMANCE
+#define PERF_CALLBACKS_MAX 32
 
-  lua_getglobal(L, "vim");
-  lua_getfield(L, -1, "api");
-  lua_getfield(L, -1, "nvim_input");
-  lua_pushfstring(L, "%s%s", lua_tostring(L, mappings_idx + 1), lua_tostring(L, mappings_idx + 2));
-  MLUA_PCALL_VOID(L, 1);
+struct PerfCallback
+{
+  char const *name;
+  uint64_t calls;
+  int64_t total_ns;
+  int64_t max_ns;
+};
 
-  return 0;
-}
+static struct PerfCallback g_perf_callbacks[PERF_CALLBACKS_MAX];
+static uint g_perf_callbacks_len;
 
-int
-conform_formatters_by_ft_python(
+// upvalue 1 is the callback, upvalue 2 its PerfCallback
+static int
+perf_callback_timed(
     lua_State *L)
 {
-  MLUA_REQUIRE(L, "conform");
-  lua_getfield(L, -1, "get_formatter_info");
-    lua_pushstring(L, "ruff_format");
-    lua_pushvalue(L, -4);
-    MLUA_PCALL(L, 2, 1);
-
-    ASSERT(L, lua_istable(L, -1));
-    lua_getfield(L, -1, "available");
-
-  ASSERT(L, lua_isboolean(L, -1));
-  bool has_ruff = lua_toboolean(L, -1);
-  lua_pop(L, 4);
+  struct PerfCallback *c = lua_touserdata(L, lua_upvalueindex(2));
+  int nargs = lua_gettop(L);
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_insert(L, 1);
+
+  struct timespec t[1][2];
+  START_PERF_TIME(t, 0);
+  lua_call(L, nargs, LUA_MULTRET);
+  END_PERF_TIME(t, 0);
+
+  int64_t ns = PERF_TIME_NS(t, 0);
+  c->calls += 1;
+  c->total_ns += ns;
+  c->max_ns = Max(c->max_ns, ns);
+  return lua_gettop(L);
+}
 
-  lua_createtable(L, 2, 0);
-  if(has_ruff)
+static inline void
+mlua_push_timed_callback(
+    lua_State *L,
+    lua_CFunction f,
+    char const *name)
+{
+  struct PerfCallback *c = NULL;
+  for(uint i = 0;
+      i < g_perf_callbacks_len && c == NULL;
+      i += 1)
   {
-    MLUA_PUSH_IDX(L, 1) { lua_pushstring(L, "ruff_format"); };
+    if(strcmp(g_perf_callbacks[i].name, name) == 0) { c = &g_perf_callbacks[i]; }
   }
-  else
+  if(c == NULL && g_perf_callbacks_len < PERF_CALLBACKS_MAX)
   {
-    MLUA_PUSH_IDX(L, 1) { lua_pushstring(L, "isort"); }
-    MLUA_PUSH_IDX(L, 2) { lua_pushstring(L, "black"); }
+    c = &g_perf_callbacks[g_perf_callbacks_len++];
+    c->name = name;
   }
 
-  return 1;
+  lua_pushcfunction(L, f);
+  if(c == NULL) { return; }
+  lua_pushlightuserdata(L, c);
+  lua_pushcclosure(L, perf_callback_timed, 2);
 }
 
-int
-lsp_on_attach(
-    lua_State *L)
+#define MLUA_PUSH_CALLBACK(L, f) mlua_push_timed_callback(L, f, #f)
+#else
+#define MLUA_PUSH_CALLBACK(L, f) lua_pushcfunction(L, f)
+#endif // PERFORMANCE
+
+/* LAZY LOADING */
+// A plugin is declared with a list of triggers, a stub keymap/command/autocmd is installed for each one,
+// the first stub to fire removes every stub of that plugin and runs the real setup.
+// A trigger that fires while the plugin is still cloning is replayed by the bootstrap once it is loaded.
+#define LAZY_TRIGGER_LIST \
+  LAZY_TRIGGER_X(Key) \
+  LAZY_TRIGGER_X(Cmd) \
+  LAZY_TRIGGER_X(Event)
+
+enum Lazy_Trigger : int
 {
-  int nargs = lua_gettop(L);
-  if(nargs < 1)
+#define LAZY_TRIGGER_X(n) Lazy_Trigger_##n,
+  LAZY_TRIGGER_LIST
+#undef LAZY_TRIGGER_X
+  Lazy_Trigger_Count,
+};
+
+#define LAZY_TRIGGERS_MAX 16
+
+struct LazyTrigger
+{
+  enum Lazy_Trigger type;
+  char *mode; // Key: map mode
+  char *name; // Key: lhs, Cmd: user command, Event: autocmd event
+  char *pattern; // Event: autocmd pattern, NULL matches everything
+  bool retrigger; // Event: fire the event again on the buffer, after the plugin has registered its autocmds
+};
+
+struct LazyPlugin
+{
+  char *name;
+  lua_CFunction setup;
+  uint64_t sources; // PLUGIN_SOURCE mask, the setup waits for the bootstrap to clone these
+  struct LazyTrigger const *triggers;
+  uint triggers_len;
+
+  bool loaded;
+  bool deferred; // triggered while its sources were still being cloned
+  bool replay; // replay_trigger fired while deferred: Key feeds its keys, Cmd runs replay_cmd, Event fires again on replay_buf
+  uint replay_trigger;
+  Buffer replay_buf;
+  int replay_cmd; // registry ref of the cmdline, set when replay_trigger is a Cmd
+  Integer autocmds[LAZY_TRIGGERS_MAX];
+};
+
+#define LAZY_KEY(m, k) { .type = Lazy_Trigger_Key, .mode = m, .name = k }
+#define LAZY_CMD(c) { .type = Lazy_Trigger_Cmd, .name = c }
+#define LAZY_EVENT(ev, pat) { .type = Lazy_Trigger_Event, .name = ev, .pattern = pat }
+#define LAZY_FT(ft) { .type = Lazy_Trigger_Event, .name = "FileType", .pattern = ft, .retrigger = true }
+
+#define LAZY_TRIGGERS(...) \
+  .triggers = (struct LazyTrigger const[]){ __VA_ARGS__ }, \
+  .triggers_len = STATIC_ARRAY_SIZE(((struct LazyTrigger const[]){ __VA_ARGS__ }))
+
+static char g_lazy_augroup_name[] = "my-lazy";
+
+static inline void
+lazy_load(
+    lua_State *L,
+    struct LazyPlugin *plugin)
+{
+  if(plugin->loaded) { return; }
+  if((plugin->sources & g_plugin_sources_pending) != 0)
   {
-    PANIC(L, "lsp_on_attach: expected at least 1 arg");
-    return 0;
+    // the bootstrap loads it as soon as the clone is done
+    if(!plugin->deferred) { MLUA_ECHO_FMT(L, true, "%s: still installing", plugin->name); }
+    plugin->deferred = true;
+    return;
   }
+  plugin->loaded = true;
 
-  lua_getfield(L, -1, "buf");
-  Buffer bufnr = lua_tointeger(L, -1);
+  // remove the stubs, the setup is free to install the real keymaps/commands in their place
+  for(uint i = 0;
+      i < plugin->triggers_len;
+      i += 1)
+  {
+    struct LazyTrigger const *t = &plugin->triggers[i];
+    Error e = ERROR_INIT;
+    switch(t->type)
+    {
+    default: {
+      PANIC_FMT(L, "lazy_load: %s: unknown trigger type %d\n", plugin->name, t->type);
+    } break;
+
+    // errors are fine here, the stub may already be gone
+    case Lazy_Trigger_Key: {
+      nvim_del_keymap(0, nvim_mk_string(t->mode), nvim_mk_string(t->name), &e);
+      api_clear_error(&e);
+    } break;
+
+    case Lazy_Trigger_Cmd: {
+      lua_getglobal(L, "vim");
+      lua_getfield(L, -1, "api");
+      lua_getfield(L, -1, "nvim_del_user_command");
+      lua_pushstring(L, t->name);
+      if(lua_pcall(L, 1, 0, 0) != 0) { lua_pop(L, 1); }
+      lua_pop(L, 2);
+    } break;
+
+    case Lazy_Trigger_Event: {
+      nvim_del_autocmd(plugin->autocmds[i], &e);
+      api_clear_error(&e);
+    } break;
+    }
+  }
 
-  // setup lsp omnifunc completion
+  TRACE_BEGIN("lazy", plugin->name);
+  lua_pushcfunction(L, plugin->setup);
+  MLUA_PCALL(L, 0, 0);
+  TRACE_END();
+}
+
+// the keys again, so they hit the mapping the setup installed
+static inline void
+lazy_replay_key(
+    lua_State *L,
+    struct LazyTrigger const *t)
+{
   lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "bo"); ASSERT(L, lua_istable(L, -1));
-  lua_pushinteger(L, bufnr);
-  lua_gettable(L, -2);
-  lua_pushstring(L, "v:lua.vim.lsp.omnifunc");
-  lua_setfield(L, -2, "omnifunc");
+  lua_getfield(L, -1, "api");
+  lua_getfield(L, -1, "nvim_feedkeys");
+  lua_getfield(L, -3, "keycode");
+  lua_pushstring(L, t->name);
+  MLUA_PCALL(L, 1, 1);
+  lua_pushstring(L, "m");
+  lua_pushboolean(L, false);
+  MLUA_PCALL(L, 3, 0);
   lua_pop(L, 2);
+}
 
-  // setup lsp completion
-  lua_getfield(L, -1, "lsp"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "get_client_by_id");
-  lua_getfield(L, 1, "data"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "client_id");
-  lua_remove(L, -2);
-  MLUA_PCALL(L, 1, 1);
+// the event again on buf, after the plugin has registered its autocmds
+static inline void
+lazy_replay_event(
+    lua_State *L,
+    struct LazyTrigger const *t,
+    Buffer buf)
+{
+  if(!nvim_buf_is_valid(buf)) { return; }
 
-  MLUA_SELF(L, "supports_method");
-  lua_pushstring(L,"textDocument/completion");
-  MLUA_PCALL(L, 2, 1);
-  if(lua_toboolean(L, -1))
+  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "api");
+  lua_getfield(L, -1, "nvim_exec_autocmds");
+  lua_pushstring(L, t->name);
+  lua_createtable(L, 0, 2);
   {
-    lua_getfield(L, 4, "completion"); ASSERT(L, lua_istable(L, -1));
-    lua_getfield(L, -1, "enable");
-    lua_pushboolean(L, true);
-    lua_getfield(L, 5, "id");
-    lua_pushvalue(L, 2);
-    MLUA_PCALL_VOID(L, 3);
-    NVIM_MAP_CMD(L, "i", "<c-space>", "lua vim.lsp.completion.get()");
+    MLUA_PUSH_KV(L, "buffer") { lua_pushinteger(L, buf); }
+    MLUA_PUSH_KV(L, "modeline") { lua_pushboolean(L, false); }
   }
+  MLUA_PCALL(L, 2, 0);
+  lua_pop(L, 2);
+}
 
-  // lsp keybinds
-  nvim_map_bufnr(L, bufnr, "n", "gD", "<cmd>lua vim.lsp.buf.declaration()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "gd", "<cmd>lua vim.lsp.buf.definition()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "gi", "<cmd>lua vim.lsp.buf.implementation()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "gr", "<cmd>lua vim.lsp.buf.references()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "K", "<cmd>lua vim.lsp.buf.hover()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "<c-k>", "<cmd>lua vim.lsp.buf.signature_help()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "<leader>cr", "<cmd>lua vim.lsp.buf.rename()<cr>");
-  nvim_map_bufnr(L, bufnr, "n", "<leader>ca", "<cmd>lua vim.lsp.buf.code_action()<cr>");
-  return 0;
+// trigger fired while plugin is deferred, the last one is replayed
+static inline void
+lazy_defer(
+    lua_State *L,
+    struct LazyPlugin *plugin,
+    uint trigger)
+{
+  if(plugin->replay && plugin->triggers[plugin->replay_trigger].type == Lazy_Trigger_Cmd)
+  {
+    luaL_unref(L, LUA_REGISTRYINDEX, plugin->replay_cmd);
+  }
+  plugin->replay = true;
+  plugin->replay_trigger = trigger;
+}
+
+// the trigger that fired while plugin was deferred, once it is loaded
+static inline void
+lazy_replay(
+    lua_State *L,
+    struct LazyPlugin *plugin)
+{
+  if(!plugin->loaded || !plugin->replay) { return; }
+  plugin->replay = false;
+
+  struct LazyTrigger const *t = &plugin->triggers[plugin->replay_trigger];
+  if(t->type == Lazy_Trigger_Key) { lazy_replay_key(L, t); }
+  else if(t->type == Lazy_Trigger_Event) { lazy_replay_event(L, t, plugin->replay_buf); }
+  else if(t->type == Lazy_Trigger_Cmd)
+  {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, plugin->replay_cmd);
+    luaL_unref(L, LUA_REGISTRYINDEX, plugin->replay_cmd);
+    do_cmdline_cmd(lua_tostring(L, -1));
+    lua_pop(L, 1);
+  }
 }
 
 int
-lsp_disable_semantic_highlights(
+lazy_trigger_key(
     lua_State *L)
 {
-  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "fn"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "getcompletion");
-  lua_pushstring(L, "@lsp");
-  lua_pushstring(L, "highlight");
-  MLUA_PCALL(L, 2, 1);
-
-  int table_idx = lua_gettop(L);
-  Dict(highlight) hl = {0};
-  for(lua_pushnil(L);
-      lua_next(L, table_idx);
-      lua_pop(L, 1))
+  struct LazyPlugin *plugin = lua_touserdata(L, lua_upvalueindex(1));
+  uint trigger = lua_tointeger(L, lua_upvalueindex(2));
+  lazy_load(L, plugin);
+  if(!plugin->loaded)
   {
-    nvim_highlight(L, (char *)lua_tostring(L, -1), hl);
+    lazy_defer(L, plugin, trigger);
+    return 0;
   }
 
-  lua_pop(L, 3);
+  lazy_replay_key(L, &plugin->triggers[trigger]);
   return 0;
 }
 
 int
-treesitter_update(
+lazy_trigger_cmd(
     lua_State *L)
 {
-  (void)L;
-  do_cmdline_cmd("TSUpdate");
+  struct LazyPlugin *plugin = lua_touserdata(L, lua_upvalueindex(1));
+  uint trigger = lua_tointeger(L, lua_upvalueindex(2));
+  struct LazyTrigger const *t = &plugin->triggers[trigger];
+  lazy_load(L, plugin);
+
+  // replay the command, with the same modifiers, range, bang and arguments
+  ASSERT(L, lua_istable(L, 1));
+  char range[64] = {0};
+  lua_getfield(L, 1, "range");
+  if(lua_tointeger(L, -1) > 0)
+  {
+    lua_getfield(L, 1, "line1");
+    lua_getfield(L, 1, "line2");
+    snprintf(range, sizeof(range), "%ld,%ld", (long)lua_tointeger(L, -2), (long)lua_tointeger(L, -1));
+    lua_pop(L, 2);
+  }
+  lua_getfield(L, 1, "mods");
+  lua_getfield(L, 1, "bang");
+  lua_getfield(L, 1, "args");
+  lua_pushfstring(L, "%s %s%s%s %s",
+      lua_tostring(L, -3), range, t->name, lua_toboolean(L, -2) ? "!" : "", lua_tostring(L, -1));
+  if(!plugin->loaded)
+  {
+    lazy_defer(L, plugin, trigger);
+    plugin->replay_cmd = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pop(L, 4);
+    return 0;
+  }
+  do_cmdline_cmd(lua_tostring(L, -1));
+  lua_pop(L, 5);
   return 0;
 }
 
 int
-disable_conceallevel(
+lazy_trigger_event(
     lua_State *L)
 {
-  nvim_set_o(L, "conceallevel", nvim_mk_obj_int(0));
+  struct LazyPlugin *plugin = lua_touserdata(L, lua_upvalueindex(1));
+  uint trigger = lua_tointeger(L, lua_upvalueindex(2));
+  struct LazyTrigger const *t = &plugin->triggers[trigger];
+  lazy_load(L, plugin);
+  if(!t->retrigger) { return 0; }
+
+  ASSERT(L, lua_istable(L, 1));
+  lua_getfield(L, 1, "buf");
+  Buffer buf = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  if(!plugin->loaded)
+  {
+    // the autocmd was `once`, nothing fires it again for this buffer
+    lazy_defer(L, plugin, trigger);
+    plugin->replay_buf = buf;
+    return 0;
+  }
+
+  lazy_replay_event(L, t, buf);
   return 0;
 }
 
+// MiniDeps only knows the plugins that were added, so before a MiniDeps function that works on all of them
+// (clean deletes the others from disk, update skips them) every lazy plugin is loaded
+// upvalues: plugins, plugins_len, the MiniDeps function
 int
-luaopen_config(
+lazy_minideps_all(
     lua_State *L)
 {
-#if PERFORMANCE
-  struct timespec perf_times[Perf_Time_Count][2] = {0};
-
-  START_PERF_TIME(perf_times, Perf_Time_Total);
+  struct LazyPlugin *plugins = lua_touserdata(L, lua_upvalueindex(1));
+  uint plugins_len = lua_tointeger(L, lua_upvalueindex(2));
+  for(uint i = 0;
+      i < plugins_len;
+      i += 1)
+  {
+    lazy_load(L, &plugins[i]);
+    if(!plugins[i].loaded) { return luaL_error(L, "%s is still installing, try again once it is done", plugins[i].name); }
+  }
 
-  perf_times[Perf_Time_Path][0] = perf_times[Perf_Time_Total][0];
-#endif
-  // setup command string creator, useful for temporary strings
-  struct Arena string_arena;
-  ASSERT(L, init_arena(&string_arena, 4096 * 4)); // arbitrary size
+  lua_pushvalue(L, lua_upvalueindex(3));
+  lua_insert(L, 1);
+  lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+  return lua_gettop(L);
+}
 
-  // RUNTIME
-  char *package_path = stdpaths_user_data_subpath(g_package_dir);
-  uint package_path_len = strlen(package_path);
-  ASSERT(L, package_path_len > 0);
+// MiniDeps.update/clean/snap_save behind lazy_minideps_all, the Deps* commands call them through the global
+static inline void
+lazy_wrap_minideps(
+    lua_State *L,
+    struct LazyPlugin *plugins,
+    uint plugins_len)
+{
+  static char const *const functions[] = { "update", "clean", "snap_save" };
 
-  // get runtime path
-  char *runtimepath_default_string = runtimepath_default(false);
-  uint runtimepath_default_string_len = strlen(runtimepath_default_string); // WARN: unsafe string length
-  ASSERT(L, runtimepath_default_string_len > 0);
+  lua_getglobal(L, "MiniDeps"); ASSERT(L, lua_istable(L, -1));
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(functions);
+      i += 1)
+  {
+    lua_pushlightuserdata(L, plugins);
+    lua_pushinteger(L, plugins_len);
+    lua_getfield(L, -3, functions[i]); ASSERT(L, lua_isfunction(L, -1));
+    lua_pushcclosure(L, lazy_minideps_all, 3);
+    lua_setfield(L, -2, functions[i]);
+  }
+  lua_pop(L, 1);
+}
 
-  // create the new runtimepath
-  ASSERT(L, copy_alloc_arena(&string_arena, (uint8_t *)runtimepath_default_string, runtimepath_default_string_len));
-  ASSERT(L, copy_alloc_arena(&string_arena, (uint8_t *)",", 1));
+static inline void
+lazy_register(
+    lua_State *L,
+    struct LazyPlugin *plugins,
+    uint plugins_len)
+{
+  Arena arena = ARENA_EMPTY;
+  Error e = ERROR_INIT;
 
-  char *plugin_path = string_arena.buffer + string_arena.length;
+  Dict(create_augroup) augroup = {0};
+  PUT_KEY(augroup, create_augroup, clear, true);
+  Integer group = nvim_create_augroup(0, nvim_mk_string(g_lazy_augroup_name), &augroup, &e);
+  if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
 
-  ASSERT(L, copy_alloc_arena(&string_arena, (uint8_t *)package_path, package_path_len));
+  for(uint p = 0;
+      p < plugins_len;
+      p += 1)
+  {
+    struct LazyPlugin *plugin = &plugins[p];
+    ASSERT(L, plugin->triggers_len <= LAZY_TRIGGERS_MAX);
 
-  uint plugin_path_len = string_arena.buffer + string_arena.length - plugin_path;
-  ASSERT(L, plugin_path_len > 0);
+    for(uint i = 0;
+        i < plugin->triggers_len;
+        i += 1)
+    {
+      struct LazyTrigger const *t = &plugin->triggers[i];
+      switch(t->type)
+      {
+      default: {
+        PANIC_FMT(L, "lazy_register: %s: unknown trigger type %d\n", plugin->name, t->type);
+      } break;
+
+      case Lazy_Trigger_Key: {
+        lua_pushlightuserdata(L, plugin);
+        lua_pushinteger(L, i);
+        lua_pushcclosure(L, lazy_trigger_key, 2);
+        nvim_map_callback(L, t->mode, t->name, plugin->name, luaL_ref(L, LUA_REGISTRYINDEX));
+      } break;
+
+      case Lazy_Trigger_Cmd: {
+        lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
+        lua_getfield(L, -1, "api");
+        lua_getfield(L, -1, "nvim_create_user_command");
+        lua_pushstring(L, t->name);
+        lua_pushlightuserdata(L, plugin);
+        lua_pushinteger(L, i);
+        lua_pushcclosure(L, lazy_trigger_cmd, 2);
+        lua_createtable(L, 0, 4);
+        {
+          MLUA_PUSH_KV(L, "nargs") { lua_pushstring(L, "*"); }
+          MLUA_PUSH_KV(L, "bang") { lua_pushboolean(L, true); }
+          MLUA_PUSH_KV(L, "range") { lua_pushboolean(L, true); }
+          MLUA_PUSH_KV(L, "desc") { lua_pushstring(L, plugin->name); }
+        }
+        MLUA_PCALL(L, 3, 0);
+        lua_pop(L, 2);
+      } break;
+
+      case Lazy_Trigger_Event: {
+        lua_pushlightuserdata(L, plugin);
+        lua_pushinteger(L, i);
+        lua_pushcclosure(L, lazy_trigger_event, 2);
+
+        Dict(create_autocmd) autocmd = {0};
+        PUT_KEY(autocmd, create_autocmd, desc, nvim_mk_string(plugin->name));
+        PUT_KEY(autocmd, create_autocmd, group, nvim_mk_obj_int(group));
+        PUT_KEY(autocmd, create_autocmd, once, true);
+        PUT_KEY(autocmd, create_autocmd, callback, nvim_mk_obj_luaref(luaL_ref(L, LUA_REGISTRYINDEX)));
+        if(t->pattern != NULL)
+        {
+          PUT_KEY(autocmd, create_autocmd, pattern, nvim_mk_obj_string(t->pattern));
+        }
+
+        plugin->autocmds[i] = nvim_create_autocmd(0, nvim_mk_obj_string(t->name), &autocmd, &arena, &e);
+        if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+      } break;
+      }
+    }
+  }
+}
 
-  // set runtimepath
-  nvim_set_o(L, "runtimepath",
-      nvim_mk_obj_string_from_slice(string_arena.buffer, string_arena.length));
+/* MAIN */
+// filetype -> commentstring, every other filetype gets nil (mini.comment falls back to 'commentstring')
+#define COMMENTSTRING_LIST \
+  COMMENTSTRING_X("v", "/* %s */")
 
-  /* SETUP THE PACKAGE MANAGER */
-  // setup plugin_path for mini.nvim
-  ASSERT(L, copy_alloc_arena(&string_arena, (uint8_t *)g_mini_plugin_dir, sizeof(g_mini_plugin_dir) - 1));
+#define COMMENTSTRING_CACHE_SLOTS 64 // power of 2, direct mapped by buffer number
+#define COMMENTSTRING_NONE -1
 
-  // try installing mini.deps
-  if(!os_isdir(plugin_path))
-  {
-    ASSERT(L, replace_range_arena(
-          &string_arena,
-          0, plugin_path - string_arena.buffer,
-          (uint8_t *)g_install_mini_nvim_command, sizeof(g_install_mini_nvim_command) - 1));
+static_assert((COMMENTSTRING_CACHE_SLOTS & (COMMENTSTRING_CACHE_SLOTS - 1)) == 0, "slots are masked, not divided");
 
-    plugin_path = string_arena.buffer + sizeof(g_install_mini_nvim_command) - 1;
+static String const g_commentstrings[] =
+{
+#define COMMENTSTRING_X(ft, comment) NVIM_STRING_LIT(comment),
+  COMMENTSTRING_LIST
+#undef COMMENTSTRING_X
+};
 
-    // null terminate
-    ASSERT(L, string_arena.length < string_arena.capacity);
-    string_arena.buffer[string_arena.length] = 0;
+// resolved commentstring of a buffer, buf 0 is an empty slot (buffer numbers start at 1)
+static struct { Buffer buf; int idx; } g_commentstring_cache[COMMENTSTRING_CACHE_SLOTS];
 
-    system(string_arena.buffer);
-  }
-  clear_arena(&string_arena);
+// every key is a literal, so this is a chain of fixed size compares the compiler
+// turns into a length switch and integer compares, no hashing or table walk at runtime
+static inline int
+commentstring_find(
+    char const *ft,
+    size_t ft_len)
+{
+  int i = 0;
+#define COMMENTSTRING_X(f, comment) \
+  if(ft_len == sizeof(f) - 1 && memcmp(ft, f, sizeof(f) - 1) == 0) { return i; } \
+  i += 1;
+  COMMENTSTRING_LIST
+#undef COMMENTSTRING_X
+  return COMMENTSTRING_NONE;
+}
 
-  // require the package manager
-  do_cmdline_cmd("packadd mini.nvim | helptags ALL");
-  MLUA_REQUIRE_SETUP_TABLE(L, "mini.deps", 0, 1)
+// called by mini.comment for every comment operation, after the first call for a buffer
+// this is a cache hit without touching lua
+int
+mini_comment_custom_commentstring(
+    lua_State *L)
+{
+  Buffer buf = nvim_get_current_buf();
+  uint slot = (uint)buf & (COMMENTSTRING_CACHE_SLOTS - 1);
+  if(g_commentstring_cache[slot].buf != buf)
   {
-    MLUA_PUSH_KV_TABLE_KV(L, "path", "package") { lua_pushlstring(L, plugin_path, plugin_path_len); }
+    Dict(option) o = {0};
+    PUT_KEY(o, option, buf, buf);
+    Error e = ERROR_INIT;
+    Object ft = nvim_get_option_value(nvim_mk_string("filetype"), &o, &e);
+    if(e.type != kErrorTypeNone) { PANIC_FMT(L, "ERROR(%d): %s\n", e.type, e.msg); }
+    ASSERT(L, ft.type == kObjectTypeString);
+
+    g_commentstring_cache[slot].buf = buf;
+    g_commentstring_cache[slot].idx = commentstring_find(ft.data.string.data, ft.data.string.size);
+    api_free_object(ft);
   }
 
-#if PERFORMANCE
-  END_PERF_TIME(perf_times, Perf_Time_Path);
+  int idx = g_commentstring_cache[slot].idx;
+  if(idx == COMMENTSTRING_NONE) { lua_pushnil(L); }
+  else { lua_pushlstring(L, g_commentstrings[idx].data, g_commentstrings[idx].size); }
+  return 1;
+}
 
-  perf_times[Perf_Time_Opt][0] = perf_times[Perf_Time_Path][1];
-#endif
+// FileType autocmd, the filetype of args.buf changed
+int
+commentstring_invalidate(
+    lua_State *L)
+{
+  lua_getfield(L, 1, "buf");
+  Buffer buf = lua_tointeger(L, -1);
+  lua_pop(L, 1);
 
-  /* OPTIONS */
-  nvim_set_g(L, "mapleader", nvim_mk_obj_string(" "));
-  nvim_set_g(L, "maplocalleader", nvim_mk_obj_string(","));
+  uint slot = (uint)buf & (COMMENTSTRING_CACHE_SLOTS - 1);
+  if(g_commentstring_cache[slot].buf == buf) { g_commentstring_cache[slot].buf = 0; }
+  return 0;
+}
 
-  // Make line numbers default
-  nvim_set_o(L, "number", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "relativenumber", nvim_mk_obj_bool(true));
+// Trailing whitespace
+// <leader>cW without :%s/\s\+$//: the lines come in chunks, only the ones that end in blanks are
+// edited, each by a nvim_buf_set_text of just its blanks. The edits of one call are one undo step
+// that holds the changed lines only, and no regex runs over the rest.
+#define TRIM_CHUNK_LINES 4096
 
-  // Enable mouse mode (useful for resizing splits)
-  nvim_set_o(L, "mouse", nvim_mk_obj_string("a"));
+typedef uint8_t TrimVec __attribute__((vector_size(32), aligned(1)));
+typedef uint64_t TrimLanes __attribute__((vector_size(32), aligned(1)));
 
-  // Save undo history
-  nvim_set_o(L, "undofile", nvim_mk_obj_bool(true));
+// the length of s without its trailing spaces and tabs, \s of a vim pattern
+static inline size_t
+trim_trailing_len(
+    char const *s,
+    size_t len)
+{
+  if(len == 0 || (s[len - 1] != ' ' && s[len - 1] != '\t')) { return len; }
 
-  // Case-insensitive searching UNLESS \C or one or more capital letters in the search term
-  nvim_set_o(L, "ignorecase", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "smartcase", nvim_mk_obj_bool(true));
+  // a long run (a padded table, an indented empty line) a vector at a time
+  TrimVec space = (TrimVec){0} + ' ';
+  TrimVec tab = (TrimVec){0} + '\t';
+  while(len >= sizeof(TrimVec))
+  {
+    TrimVec x;
+    memcpy(&x, s + len - sizeof(x), sizeof(x));
+    TrimLanes blank = (TrimLanes)((x == space) | (x == tab));
+    if((blank[0] & blank[1] & blank[2] & blank[3]) != ~0ULL) { break; }
+    len -= sizeof(TrimVec);
+  }
+  while(len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t')) { len -= 1; }
+  return len;
+}
 
-  // Keep signcolumn on by default
-  nvim_set_o(L, "signcolumn", nvim_mk_obj_string("yes"));
+// g_trim_trailing_whitespace(), the current buffer
+int
+trim_trailing_whitespace(
+    lua_State *L)
+{
+  TRACE_BEGIN("edit", "trim_trailing_whitespace");
+  Error e = ERROR_INIT;
+  Buffer buf = nvim_get_current_buf();
+  Integer lines = nvim_buf_line_count(buf, &e);
+  if(e.type != kErrorTypeNone)
+  {
+    TRACE_END();
+    MLUA_ECHO_FMT(L, true, "trim: %s", e.msg);
+    api_clear_error(&e);
+    return 0;
+  }
 
-  // Decrease update time
-  nvim_set_o(L, "updatetime", nvim_mk_obj_int(50));
+  Object empty = nvim_mk_obj_string("");
+  Array replacement = { .size = 1, .capacity = 1, .items = &empty };
 
-  // Increase time before timeout
-  nvim_set_o(L, "timeout", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "timeoutlen", nvim_mk_obj_int(1'000));
+  uint trimmed = 0;
+  for(Integer start = 0;
+      start < lines && e.type == kErrorTypeNone;
+      start += TRIM_CHUNK_LINES)
+  {
+    Arena arena = ARENA_EMPTY;
+    Integer end = Min(start + TRIM_CHUNK_LINES, lines);
+    Array chunk = nvim_buf_get_lines(0, buf, start, end, true, &arena, NULL, &e);
+    for(size_t i = 0;
+        i < chunk.size && e.type == kErrorTypeNone;
+        i += 1)
+    {
+      String line = chunk.items[i].data.string;
+      size_t keep = trim_trailing_len(line.data, line.size);
+      if(keep == line.size) { continue; }
 
-  // Configure how new splits should be opened
-  nvim_set_o(L, "splitright", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "splitbelow", nvim_mk_obj_bool(true));
+      Integer row = start + i;
+      nvim_buf_set_text(0, buf, row, keep, row, line.size, replacement, &arena, &e);
+      trimmed += e.type == kErrorTypeNone;
+    }
+    arena_mem_free(arena_finish(&arena));
+  }
+  TRACE_END();
 
-  // See `:help 'list'` and `:help 'listchars'`
-  nvim_set_o(L, "list", nvim_mk_obj_bool(true));
-  // maybe useful: 'precedes:⟨'
-  nvim_set_o(L, "listchars", nvim_mk_obj_string("tab:» ,trail:·,nbsp:␣,extends:⟩"));
+  if(e.type != kErrorTypeNone) { MLUA_ECHO_FMT(L, true, "trim: %s", e.msg); api_clear_error(&e); }
+  else if(trimmed > 0) { MLUA_ECHO_FMT(L, false, "trim: %u lines", trimmed); }
+  return 0;
+}
 
-  // Preview substitutions live, as you type!
-  nvim_set_o(L, "inccommand", nvim_mk_obj_string("split"));
+// Fuzzy match
+// source.match of every picker (fuzzy.c). The strings of stritems are read once per items table and
+// kept while the table is referenced (lua strings do not move), the last result is kept the same way:
+// mini.pick narrows by handing it back as inds on the next keystroke, so no index is read from lua.
+// Queries with mini.pick's special characters (exact, anchors, grouping) go to its lua matcher.
+static struct
+{
+  int items_ref;
+  void const *items_id;
+  uint items_len;
+  struct FuzzyItem *items;
+
+  int result_ref;
+  void const *result_id;
+  uint *result; // item indices of the last result, 0 based
+  uint result_len;
+
+  uint *cands;
+  struct FuzzyMatch *matches;
+  uint capacity;
+} g_fuzzy = { .items_ref = LUA_NOREF, .result_ref = LUA_NOREF };
+
+static inline bool
+fuzzy_reserve(
+    uint len)
+{
+  if(len <= g_fuzzy.capacity) { return true; }
+  uint capacity = Max(len, g_fuzzy.capacity * 2);
+  uint *result = realloc(g_fuzzy.result, capacity * sizeof(*result));
+  if(result != NULL) { g_fuzzy.result = result; }
+  uint *cands = realloc(g_fuzzy.cands, capacity * sizeof(*cands));
+  if(cands != NULL) { g_fuzzy.cands = cands; }
+  struct FuzzyMatch *matches = realloc(g_fuzzy.matches, capacity * sizeof(*matches));
+  if(matches != NULL) { g_fuzzy.matches = matches; }
+  if(result == NULL || cands == NULL || matches == NULL) { return false; }
+  g_fuzzy.capacity = capacity;
+  return true;
+}
 
-  // Show which line your cursor is on
-  // nvim_set_o(L, "cursorline", nvim_mk_obj_bool(true));
+// false when an item is not a string
+static inline bool
+fuzzy_load_items(
+    lua_State *L,
+    int stritems_idx)
+{
+  void const *id = lua_topointer(L, stritems_idx);
+  uint len = lua_objlen(L, stritems_idx);
+  if(id == g_fuzzy.items_id && len == g_fuzzy.items_len) { return true; }
+
+  luaL_unref(L, LUA_REGISTRYINDEX, g_fuzzy.items_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, g_fuzzy.result_ref);
+  g_fuzzy.items_ref = LUA_NOREF;
+  g_fuzzy.items_id = NULL;
+  g_fuzzy.items_len = 0;
+  g_fuzzy.result_ref = LUA_NOREF;
+  g_fuzzy.result_id = NULL;
+  g_fuzzy.result_len = 0;
+  struct FuzzyItem *items = realloc(g_fuzzy.items, Max(len, 1) * sizeof(*items));
+  if(items == NULL || !fuzzy_reserve(len)) { return false; }
+  g_fuzzy.items = items;
+
+  for(uint i = 0;
+      i < len;
+      i += 1)
+  {
+    lua_rawgeti(L, stritems_idx, i + 1);
+    bool is_string = lua_type(L, -1) == LUA_TSTRING; // a number would be converted on the stack only
+    size_t str_len;
+    char const *str = lua_tolstring(L, -1, &str_len);
+    lua_pop(L, 1);
+    if(!is_string) { return false; }
+    items[i] = (struct FuzzyItem){ str, str_len };
+  }
 
-  // Minimal number of screen lines to keep above and below the cursor.
-  // nvim_set_o(L, "scrolloff", nvim_mk_obj_int(1));
-  nvim_set_o(L, "sidescrolloff", nvim_mk_obj_int(20));
+  lua_pushvalue(L, stritems_idx);
+  g_fuzzy.items_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  g_fuzzy.items_id = id;
+  g_fuzzy.items_len = len;
+  return true;
+}
 
-  // Tabs
-  nvim_set_o(L, "tabstop", nvim_mk_obj_int(4));
-  nvim_set_o(L, "softtabstop", nvim_mk_obj_int(4));
-  nvim_set_o(L, "shiftwidth", nvim_mk_obj_int(4));
-  nvim_set_o(L, "expandtab", nvim_mk_obj_bool(true));
+// the query is an array of characters, false for one that needs mini.pick's own matcher
+static inline bool
+fuzzy_load_query(
+    lua_State *L,
+    int query_idx,
+    struct FuzzyQuery *q)
+{
+  char query[FUZZY_QUERY_MAX];
+  uint query_len = 0;
+  uint len = lua_objlen(L, query_idx);
+  for(uint i = 0;
+      i < len;
+      i += 1)
+  {
+    lua_rawgeti(L, query_idx, i + 1);
+    size_t c_len;
+    char const *c = lua_tolstring(L, -1, &c_len);
+    lua_pop(L, 1);
+    if(c == NULL || query_len + c_len > sizeof(query)) { return false; }
+    if(c_len == 1 && strchr("'^$* ", c[0]) != NULL) { return false; }
+    memcpy(query + query_len, c, c_len);
+    query_len += c_len;
+  }
+  return init_fuzzy_query(q, query, query_len);
+}
 
-  // Dont pass this marker
-  nvim_set_o(L, "colorcolumn", nvim_mk_obj_string("80"));
+// source.match(stritems, inds, query)
+int
+fuzzy_pick_match(
+    lua_State *L)
+{
+  struct FuzzyQuery q;
+  if(!lua_istable(L, 1) || !lua_istable(L, 2) || !lua_istable(L, 3)
+      || !fuzzy_load_query(L, 3, &q) || !fuzzy_load_items(L, 1))
+  {
+    ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickDefaultMatch));
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    lua_createtable(L, 0, 1);
+    {
+      MLUA_PUSH_KV(L, "sync") { lua_pushboolean(L, true); }
+    }
+    MLUA_PCALL(L, 4, 1);
+    return 1;
+  }
+  if(q.len == 0)
+  {
+    lua_pushvalue(L, 2);
+    return 1;
+  }
 
-  // Linewraps
-  nvim_set_o(L, "showbreak", nvim_mk_obj_string("└▶"));
-  nvim_set_o(L, "wrap", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "linebreak", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "breakindent", nvim_mk_obj_bool(true));
-  nvim_set_o(L, "breakindentopt", nvim_mk_obj_string("list:-1"));
+  // candidates: the last result, every item, or whatever mini.pick passed
+  uint cands_len = lua_objlen(L, 2);
+  if(lua_topointer(L, 2) == g_fuzzy.result_id)
+  {
+    cands_len = g_fuzzy.result_len;
+    memcpy(g_fuzzy.cands, g_fuzzy.result, cands_len * sizeof(*g_fuzzy.cands));
+  }
+  else if(cands_len == g_fuzzy.items_len)
+  {
+    // a subset as long as the items is all of them, the order is the score's anyway
+    for(uint i = 0;
+        i < cands_len;
+        i += 1)
+    {
+      g_fuzzy.cands[i] = i;
+    }
+  }
+  else
+  {
+    cands_len = Min(cands_len, g_fuzzy.items_len);
+    for(uint i = 0;
+        i < cands_len;
+        i += 1)
+    {
+      lua_rawgeti(L, 2, i + 1);
+      lua_Integer idx = lua_tointeger(L, -1);
+      lua_pop(L, 1);
+      ASSERT(L, idx >= 1 && idx <= g_fuzzy.items_len);
+      g_fuzzy.cands[i] = idx - 1;
+    }
+  }
 
-  // Enable break indent
-  nvim_set_o(L, "breakindent", nvim_mk_obj_bool(true));
+  TRACE_BEGIN("pick", "fuzzy_match");
+  uint matches_len = fuzzy_match(&q, g_fuzzy.items, g_fuzzy.cands, cands_len, g_fuzzy.matches, 0);
+  TRACE_END();
 
-  // Disable cursor changing
-  nvim_set_o(L, "guicursor", nvim_mk_obj_string("n-v-c:block"));
+  lua_createtable(L, matches_len, 0);
+  for(uint i = 0;
+      i < matches_len;
+      i += 1)
+  {
+    uint idx = g_fuzzy.cands[g_fuzzy.matches[i].idx];
+    g_fuzzy.result[i] = idx;
+    lua_pushinteger(L, idx + 1);
+    lua_rawseti(L, -2, i + 1);
+  }
+  g_fuzzy.result_len = matches_len;
+  g_fuzzy.result_id = lua_topointer(L, -1);
+  luaL_unref(L, LUA_REGISTRYINDEX, g_fuzzy.result_ref);
+  lua_pushvalue(L, -1);
+  g_fuzzy.result_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  return 1;
+}
 
-  // cinkeys
-  nvim_set_o(L, "cinkeys", nvim_mk_obj_string("0{,0},0),0],:,!^F,o,O,e"));
+// Files
+// <leader>sf, `fd -t f -H -E.git` without the process: walk.c lists the cwd on its threads while the
+// picker is open, every PICK_FILES_POLL_MS the paths found so far are appended to the items and
+// handed to mini.pick again. The walk is cancelled when the picker is gone.
+#define PICK_FILES_POLL_MS 30
 
-  // cinoptions
-  nvim_set_o(L, "cinoptions", nvim_mk_obj_string(":0,l1,b1,=0"));
+static char const *const g_pick_files_excludes[] = { ".git" };
 
-  // input formatting
-  nvim_mk_autocmd_command(L, "BufEnter", "Setup format options", "my-formatoptions", true,
-      nvim_mk_string("set formatoptions-=ro"));
+static struct
+{
+  struct Walk walk;
+  bool walking;
+  int items;
+  uint items_len;
+  int timer;
+} g_pick_files = { .items = LUA_NOREF, .timer = LUA_NOREF };
 
-  // conceal options (syntax visibility)
-  NVIM_MK_AUTOCMD_CALLBACK(
-      L, "BufEnter", // NOTE: maybe you would put this on another event
-                     // ... but, the once flag is not exposed in my api lol
-      "Disable Conceal on All Buffers", "my-conceallevel", true,
-      disable_conceallevel);
+static inline void
+pick_files_stop(
+    lua_State *L)
+{
+  if(g_pick_files.timer != LUA_NOREF)
+  {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_pick_files.timer);
+    MLUA_SELF_PCALL_VOID(L, "stop", 1);
+    MLUA_SELF_PCALL_VOID(L, "close", 1);
+    lua_pop(L, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, g_pick_files.timer);
+    g_pick_files.timer = LUA_NOREF;
+  }
+  if(g_pick_files.walking)
+  {
+    cancel_walk(&g_pick_files.walk);
+    deinit_walk(&g_pick_files.walk);
+    g_pick_files.walking = false;
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, g_pick_files.items);
+  g_pick_files.items = LUA_NOREF;
+  g_pick_files.items_len = 0;
+}
 
-  // autoread
-  nvim_set_o(L, "autoread", nvim_mk_obj_bool(true));
+int
+pick_files_tick(
+    lua_State *L)
+{
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickIsPickerActive));
+  MLUA_PCALL(L, 0, 1);
+  bool active = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  if(!active || !g_pick_files.walking) { pick_files_stop(L); return 0; }
+
+  // finished first: whatever is taken after it is the last of it
+  bool finished = finished_walk(&g_pick_files.walk);
+  struct WalkBatch *batches = take_walk(&g_pick_files.walk);
+  if(batches != NULL)
   {
-    static char *autoread_events[] =
+    TRACE_BEGIN("pick", "files_batch");
+    ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickSetPickerItems));
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_pick_files.items);
+    for(struct WalkBatch const *b = batches;
+        b != NULL;
+        b = b->next)
     {
-      "BufEnter",
-      "CursorHold",
-      "CursorHoldI",
-      "FocusGained",
-    };
-    int arena_pos = string_arena.length;
+      char const *path = b->data;
+      for(uint i = 0;
+          i < b->len;
+          i += 1)
+      {
+        size_t path_len = strlen(path);
+        lua_pushlstring(L, path, path_len);
+        lua_rawseti(L, -2, ++g_pick_files.items_len);
+        path += path_len + 1;
+      }
+    }
+    free_walk_batches(batches);
+    MLUA_PCALL(L, 1, 0);
+    TRACE_END();
+  }
+
+  if(finished) { pick_files_stop(L); }
+  return 0;
+}
+
+// source.items, mini.pick calls it once the picker is active
+int
+pick_files_start(
+    lua_State *L)
+{
+  struct WalkOptions options = {
+    .hidden = true,
+    .ignore_files = true,
+    .excludes = g_pick_files_excludes,
+    .excludes_len = STATIC_ARRAY_SIZE(g_pick_files_excludes),
+  };
+  if(!start_walk(&g_pick_files.walk, ".", &options, 0))
+  {
+    MLUA_ECHO_FMT(L, true, "files: cannot read the current directory");
+    return 0;
+  }
+  g_pick_files.walking = true;
+
+  lua_createtable(L, 1024, 0);
+  g_pick_files.items = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  // vim.uv.new_timer():start(0, PICK_FILES_POLL_MS, vim.schedule_wrap(pick_files_tick))
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_Vim));
+  int vim_idx = lua_gettop(L);
+  lua_getfield(L, vim_idx, "uv");
+  lua_getfield(L, -1, "new_timer");
+  MLUA_PCALL(L, 0, 1);
+  lua_pushvalue(L, -1);
+  g_pick_files.timer = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  MLUA_SELF(L, "start");
+  lua_pushinteger(L, 0);
+  lua_pushinteger(L, PICK_FILES_POLL_MS);
+  lua_getfield(L, vim_idx, "schedule_wrap");
+  lua_pushcfunction(L, pick_files_tick);
+  MLUA_PCALL(L, 1, 1);
+  MLUA_PCALL(L, 4, 0);
+  lua_settop(L, vim_idx - 1);
+  return 0;
+}
+
+int
+pick_files(
+    lua_State *L)
+{
+  pick_files_stop(L); // a walk of a picker that was closed before its next tick
+
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickStart));
+  lua_createtable(L, 0, 1);
+  {
+    MLUA_PUSH_KV_TABLE(L, "source", 0, 2)
+    {
+      MLUA_PUSH_KV(L, "name") { lua_pushstring(L, "Files"); }
+      MLUA_PUSH_KV(L, "items") { MLUA_PUSH_CALLBACK(L, pick_files_start); }
+    }
+  }
+  MLUA_PCALL(L, 1, 0);
+  return 0;
+}
+
+// Grep
+// :Pick grep_live without a process per keystroke: grep.c keeps its threads and the file list for
+// as long as the picker is open, source.match starts a search (cancelling the last one) and every
+// PICK_GREP_POLL_MS the results of the current one are appended and handed to mini.pick.
+#define PICK_GREP_POLL_MS 30
+
+static struct
+{
+  struct Grep grep;
+  bool running;
+  int items;
+  uint items_len;
+  int timer;
+} g_pick_grep = { .items = LUA_NOREF, .timer = LUA_NOREF };
+
+static inline void
+pick_grep_items_reset(
+    lua_State *L)
+{
+  luaL_unref(L, LUA_REGISTRYINDEX, g_pick_grep.items);
+  lua_createtable(L, 256, 0);
+  g_pick_grep.items = luaL_ref(L, LUA_REGISTRYINDEX);
+  g_pick_grep.items_len = 0;
+}
+
+// the items are not matched again, they are what the pattern found
+static inline void
+pick_grep_set_items(
+    lua_State *L)
+{
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickSetPickerItems));
+  lua_rawgeti(L, LUA_REGISTRYINDEX, g_pick_grep.items);
+  lua_createtable(L, 0, 1);
+  {
+    MLUA_PUSH_KV(L, "do_match") { lua_pushboolean(L, false); }
+  }
+  MLUA_PCALL(L, 2, 0);
+}
+
+static inline void
+pick_grep_stop(
+    lua_State *L)
+{
+  if(g_pick_grep.timer != LUA_NOREF)
+  {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_pick_grep.timer);
+    MLUA_SELF_PCALL_VOID(L, "stop", 1);
+    MLUA_SELF_PCALL_VOID(L, "close", 1);
+    lua_pop(L, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, g_pick_grep.timer);
+    g_pick_grep.timer = LUA_NOREF;
+  }
+  if(g_pick_grep.running)
+  {
+    deinit_grep(&g_pick_grep.grep);
+    g_pick_grep.running = false;
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, g_pick_grep.items);
+  g_pick_grep.items = LUA_NOREF;
+  g_pick_grep.items_len = 0;
+}
+
+int
+pick_grep_tick(
+    lua_State *L)
+{
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickIsPickerActive));
+  MLUA_PCALL(L, 0, 1);
+  bool active = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  if(!active || !g_pick_grep.running) { pick_grep_stop(L); return 0; }
 
-    char *augroup_name_str = "my-autoread";
-    uint augroup_name = string_arena.length;
-    ASSERT(L, copy_alloc_arena(&string_arena, (uint8_t *)augroup_name_str, sizeof(augroup_name_str) - 1));
+  struct GrepBatch *batches = take_grep(&g_pick_grep.grep);
+  if(batches == NULL) { return 0; }
 
-    for(int i = 0;
-        i < (int)STATIC_ARRAY_SIZE(autoread_events);
+  TRACE_BEGIN("pick", "grep_batch");
+  lua_rawgeti(L, LUA_REGISTRYINDEX, g_pick_grep.items);
+  for(struct GrepBatch const *b = batches;
+      b != NULL;
+      b = b->next)
+  {
+    char const *item = b->data;
+    for(uint i = 0;
+        i < b->len;
         i += 1)
     {
-      ASSERT(L, copy_alloc_arena(&string_arena, (uint8_t *)autoread_events[i], sizeof(augroup_name_str)));
-      nvim_mk_autocmd_command(
-          L, autoread_events[i], // NOTE: maybe you would put this on another event
-                         // ... but, the once flag is not exposed in my api lol
-          "Enabled checking if file has been modified", string_arena.buffer + augroup_name, true,
-          nvim_mk_string("if mode() != 'c' | checktime | endif"));
+      uint32_t item_len;
+      memcpy(&item_len, item, sizeof(item_len));
+      lua_pushlstring(L, item + sizeof(item_len), item_len);
+      lua_rawseti(L, -2, ++g_pick_grep.items_len);
+      item += sizeof(item_len) + item_len;
     }
+  }
+  lua_pop(L, 1);
+  free_grep_batches(batches);
+  pick_grep_set_items(L);
+  TRACE_END();
+  return 0;
+}
 
-    string_arena.length = arena_pos;
+// source.match(stritems, inds, query), nothing is returned: the results come from pick_grep_tick
+int
+pick_grep_match(
+    lua_State *L)
+{
+  if(!g_pick_grep.running) { return 0; }
+
+  char pattern[GREP_PATTERN_MAX];
+  uint pattern_len = 0;
+  bool too_long = false;
+  uint len = lua_objlen(L, 3);
+  for(uint i = 0;
+      i < len && !too_long;
+      i += 1)
+  {
+    lua_rawgeti(L, 3, i + 1);
+    size_t c_len;
+    char const *c = lua_tolstring(L, -1, &c_len);
+    lua_pop(L, 1);
+    if(c == NULL) { continue; }
+    too_long = pattern_len + c_len >= sizeof(pattern);
+    if(too_long) { break; }
+    memcpy(pattern + pattern_len, c, c_len);
+    pattern_len += c_len;
+  }
+  if(too_long)
+  {
+    // a prefix would show its matches as the ones of the whole query
+    MLUA_ECHO_FMT(L, true, "grep: the query is longer than %d bytes", GREP_PATTERN_MAX - 1);
+    pattern_len = 0;
   }
 
-  // completion
-  nvim_set_o(L, "wildmode", nvim_mk_obj_string("longest:full"));
-  nvim_set_o(L, "wildmenu", nvim_mk_obj_bool(true));
+  TRACE_BEGIN("pick", "grep_search");
+  grep_search(&g_pick_grep.grep, pattern, pattern_len);
+  TRACE_END();
+  pick_grep_items_reset(L);
+  pick_grep_set_items(L);
+  return 0;
+}
 
-  nvim_set_o(L, "completeopt", nvim_mk_obj_string("longest,noselect"));
+// source.items, mini.pick calls it once the picker is active
+int
+pick_grep_start(
+    lua_State *L)
+{
+  pick_grep_items_reset(L);
+  pick_grep_set_items(L);
+  if(!init_grep(&g_pick_grep.grep, ".", 0))
+  {
+    MLUA_ECHO_FMT(L, true, "grep: cannot read the current directory");
+    return 0;
+  }
+  g_pick_grep.running = true;
 
-  /* Keymaps */
-  // Auto Completion
-  nvim_map(L, "i", "<c-space>", "<c-x><c-o>");
+  // vim.uv.new_timer():start(0, PICK_GREP_POLL_MS, vim.schedule_wrap(pick_grep_tick))
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_Vim));
+  int vim_idx = lua_gettop(L);
+  lua_getfield(L, vim_idx, "uv");
+  lua_getfield(L, -1, "new_timer");
+  MLUA_PCALL(L, 0, 1);
+  lua_pushvalue(L, -1);
+  g_pick_grep.timer = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  MLUA_SELF(L, "start");
+  lua_pushinteger(L, 0);
+  lua_pushinteger(L, PICK_GREP_POLL_MS);
+  lua_getfield(L, vim_idx, "schedule_wrap");
+  lua_pushcfunction(L, pick_grep_tick);
+  MLUA_PCALL(L, 1, 1);
+  MLUA_PCALL(L, 4, 0);
+  lua_settop(L, vim_idx - 1);
+  return 0;
+}
 
-  // Terminal Binds
-  nvim_map(L, "t", "<C-w>", "<c-\\><c-n><C-w>");
+// MiniPick.registry.grep_live(local_opts, opts), with local_opts.tool or local_opts.globs it is
+// MiniPick.builtin.grep_live: grep.c has no tool to pick and walks every file the ignore files allow
+int
+pick_grep_live(
+    lua_State *L)
+{
+  bool builtin = false;
+  if(lua_istable(L, 1))
+  {
+    lua_getfield(L, 1, "tool");
+    lua_getfield(L, 1, "globs");
+    builtin = !lua_isnil(L, -2) || (lua_istable(L, -1) && lua_objlen(L, -1) > 0);
+    lua_pop(L, 2);
+  }
+  if(builtin)
+  {
+    lua_settop(L, 2);
+    lua_getglobal(L, "MiniPick"); ASSERT(L, lua_istable(L, -1));
+    lua_getfield(L, -1, "builtin");
+    lua_getfield(L, -1, "grep_live");
+    lua_insert(L, 1);
+    lua_settop(L, 3);
+    lua_call(L, 2, 1);
+    return 1;
+  }
 
-  // Navigation
-  /// Center Screen When Scrolling
-  // nvim_map(L, "n", "<C-d>", "<C-d>zz");
-  // nvim_map(L, "n", "<C-u>", "<C-u>zz");
+  pick_grep_stop(L); // the pool of a picker that was closed before its next tick
 
-  /// Navigate Wrapped Lines
-  nvim_map(L, "n", "j", "gj");
-  nvim_map(L, "n", "k", "gk");
-  nvim_map(L, "v", "j", "gj");
-  nvim_map(L, "v", "k", "gk");
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickStart));
+  lua_createtable(L, 0, 1);
+  {
+    MLUA_PUSH_KV_TABLE(L, "source", 0, 3)
+    {
+      MLUA_PUSH_KV(L, "name") { lua_pushstring(L, "Grep live"); }
+      MLUA_PUSH_KV(L, "items") { MLUA_PUSH_CALLBACK(L, pick_grep_start); }
+      MLUA_PUSH_KV(L, "match") { MLUA_PUSH_CALLBACK(L, pick_grep_match); }
+    }
+  }
+  MLUA_PCALL(L, 1, 0);
+  return 0;
+}
 
-  // Yanks
-  nvim_map(L, "n", "<leader>y", "\"+y");
-  nvim_map(L, "v", "<leader>y", "\"+y");
-  nvim_map(L, "n", "<leader>Y", "\"+Y");
+// the picker covers the editor, its config only changes with the editor size
+// the table is built once and rewritten by VimResized/UIEnter, the picker reads it with no api call
+// NOTE: mini.pick copies the config (tbl_deep_extend), so handing out the same table is safe
+static struct { Integer lines; Integer columns; bool dirty; int table; } g_pick_geometry = { .table = LUA_NOREF };
 
-  // Set highlight on search, but clear on pressing <Esc> in normal mode
-  nvim_set_o(L, "hlsearch", nvim_mk_obj_bool(true));
-  nvim_map(L, "n", "<esc>", "<cmd>nohlsearch<cr><esc>");
+static inline void
+pick_geometry_refresh(
+    lua_State *L)
+{
+  Object lines = nvim_get_o(L, "lines");
+  Object columns = nvim_get_o(L, "columns");
+  ASSERT(L, lines.type == kObjectTypeInteger);
+  ASSERT(L, columns.type == kObjectTypeInteger);
+  if(lines.data.integer == g_pick_geometry.lines && columns.data.integer == g_pick_geometry.columns) { return; }
+  g_pick_geometry.lines = lines.data.integer;
+  g_pick_geometry.columns = columns.data.integer;
+  g_pick_geometry.dirty = true;
+}
 
-  // Diagnostics
-  NVIM_MAP_CMD(L, "n", "<leader>uq", "copen");
-  NVIM_MAP_CMD(L, "n", "<leader>ul", "lopen");
+// VimResized, UIEnter
+int
+pick_geometry_update(
+    lua_State *L)
+{
+  pick_geometry_refresh(L);
+  return 0;
+}
 
-  // Code
-  NVIM_MAP_CMD(L, "n", "<leader>cw", "cd %:p:h"); // move nvim base path to current buffer
-  NVIM_MAP_CMD(L, "n", "<leader>cm", "Man");
-  NVIM_MAP_CMD(L, "n", "<leader>cW", "%s/\\s\\+$//g"); // remove trailing whitespace
+int
+mini_pick_window_config(
+    lua_State *L)
+{
+  if(g_pick_geometry.table == LUA_NOREF)
+  {
+    lua_createtable(L, 0, 4);
+    {
+      MLUA_PUSH_KV(L, "row") { lua_pushnumber(L, 0); }
+      MLUA_PUSH_KV(L, "col") { lua_pushnumber(L, 0); }
+    }
+    g_pick_geometry.table = luaL_ref(L, LUA_REGISTRYINDEX);
+    pick_geometry_refresh(L);
+    g_pick_geometry.dirty = true;
+  }
 
-  // Toggle
-  NVIM_MAP_CMD(L, "n", "<leader>tw", "lua vim.o.wrap = not vim.o.wrap");
+  lua_rawgeti(L, LUA_REGISTRYINDEX, g_pick_geometry.table);
+  if(g_pick_geometry.dirty)
+  {
+    MLUA_PUSH_KV(L, "height") { lua_pushinteger(L, g_pick_geometry.lines); }
+    MLUA_PUSH_KV(L, "width") { lua_pushinteger(L, g_pick_geometry.columns); }
+    g_pick_geometry.dirty = false;
+  }
+  return 1;
+}
 
-  // Make
-  NVIM_MAP_CMD(L, "n", "<leader>mm", "make");
-  // TODO: handle windows and mac
-  NVIM_MAP_CMD(L, "n", "<leader>mb",
-      "lua if vim.loop.os_uname().sysname == 'Linux' then vim.o.makeprg = 'bash build.sh' end");
-  NVIM_MAP_CMD(L, "n", "<leader>mc",
-    "lua vim.ui.input({ prompt = 'Make Command: ', default = vim.o.makeprg }, "
-      "function(usr_input) if usr_input ~= nil and usr_input ~= '' then vim.o.makeprg = usr_input end end)");
+int
+mini_pick_choose_all(
+    lua_State *L)
+{
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPickGetPickerOpts));
+  MLUA_PCALL(L, 0, 1);
+  lua_getfield(L, -1, "mappings");
+  int mappings_idx = lua_gettop(L);
+
+  lua_getfield(L, mappings_idx, "mark_all");
+  lua_getfield(L, mappings_idx, "choose_marked");
+
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_NvimInput));
+  lua_pushfstring(L, "%s%s", lua_tostring(L, mappings_idx + 1), lua_tostring(L, mappings_idx + 2));
+  MLUA_PCALL(L, 1, 0);
+
+  return 0;
+}
+
+#if MODE_FORMATTER
+// resolves the formatters of a filetype from g_formatters_by_ft against the probed $PATH,
+// conform calls it for every format request so nothing here may touch the filesystem
+int
+conform_formatters_by_ft(
+    lua_State *L)
+{
+  uint64_t const *choices = g_formatters_by_ft[lua_tointeger(L, lua_upvalueindex(1))].choices;
+  uint64_t available = exec_probe_available(&g_formatter_probe);
+
+  // none available: the last choice, conform reports what is missing
+  uint64_t pick = 0;
+  for(uint i = 0;
+      i < FORMATTER_FT_CHOICES_MAX && choices[i] != 0;
+      i += 1)
+  {
+    pick = choices[i];
+    if((pick & available) == pick) { break; }
+  }
+
+  lua_createtable(L, __builtin_popcountll(pick), 0);
+  int idx = 1;
+  for(uint i = 0;
+      i < Formatter_Count;
+      i += 1)
+  {
+    if((pick & (1ULL << i)) == 0) { continue; }
+    MLUA_PUSH_IDX(L, idx) { lua_pushstring(L, g_formatter_names[i]); }
+    idx += 1;
+  }
+
+  return 1;
+}
+#endif // MODE_FORMATTER
+
+int
+lsp_on_attach(
+    lua_State *L)
+{
+  int nargs = lua_gettop(L);
+  if(nargs < 1)
+  {
+    PANIC(L, "lsp_on_attach: expected at least 1 arg");
+    return 0;
+  }
+
+  lua_getfield(L, 1, "buf");
+  Buffer bufnr = lua_tointeger(L, -1);
+  int bufnr_idx = lua_gettop(L);
+
+  // setup lsp omnifunc completion
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_VimBo));
+  lua_pushinteger(L, bufnr);
+  lua_gettable(L, -2);
+  lua_pushstring(L, "v:lua.vim.lsp.omnifunc");
+  lua_setfield(L, -2, "omnifunc");
+  lua_pop(L, 2);
+
+  // setup lsp completion
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_VimLspGetClientById));
+  lua_getfield(L, 1, "data"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "client_id");
+  lua_remove(L, -2);
+  MLUA_PCALL(L, 1, 1);
+  int client_idx = lua_gettop(L);
+
+  MLUA_SELF(L, "supports_method");
+  lua_pushstring(L,"textDocument/completion");
+  MLUA_PCALL(L, 2, 1);
+  if(lua_toboolean(L, -1))
+  {
+    ASSERT(L, mlua_push_ref(L, Mlua_Ref_VimLspCompletionEnable));
+    lua_pushboolean(L, true);
+    lua_getfield(L, client_idx, "id");
+    lua_pushvalue(L, bufnr_idx);
+    MLUA_PCALL(L, 3, 0);
+    NVIM_MAP_CMD(L, "i", "<c-space>", "lua vim.lsp.completion.get()");
+  }
+
+  // lsp keybinds
+  nvim_map_bufnr(L, bufnr, "n", "gD", "<cmd>lua vim.lsp.buf.declaration()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "gd", "<cmd>lua vim.lsp.buf.definition()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "gi", "<cmd>lua vim.lsp.buf.implementation()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "gr", "<cmd>lua vim.lsp.buf.references()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "K", "<cmd>lua vim.lsp.buf.hover()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "<c-k>", "<cmd>lua vim.lsp.buf.signature_help()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "<leader>cr", "<cmd>lua vim.lsp.buf.rename()<cr>");
+  nvim_map_bufnr(L, bufnr, "n", "<leader>ca", "<cmd>lua vim.lsp.buf.code_action()<cr>");
+  return 0;
+}
+
+// ColorScheme, the colorscheme replaced every definition
+int
+highlight_sync_callback(
+    lua_State *L)
+{
+  highlight_sync(L);
+  return 0;
+}
+
+int
+treesitter_update(
+    lua_State *L)
+{
+  (void)L;
+  do_cmdline_cmd("TSUpdate");
+  return 0;
+}
+
+int
+disable_conceallevel(
+    lua_State *L)
+{
+  nvim_set_o(L, "conceallevel", nvim_mk_obj_int(0));
+  return 0;
+}
+
+#if PERFORMANCE
+// :ConfigCallbackTimes, build with -DNO_LUA_REFS for the numbers without the ref cache
+int
+perf_callback_report(
+    lua_State *L)
+{
+#if NO_LUA_REFS
+  char const *note = " (no ref cache)";
+#else
+  char const *note = "";
+#endif
+  for(uint i = 0;
+      i < g_perf_callbacks_len;
+      i += 1)
+  {
+    struct PerfCallback const *c = &g_perf_callbacks[i];
+    if(c->calls == 0) { continue; }
+    MLUA_ECHO_FMT(L, true, "%s: %lu calls, avg %ld ns, max %ld ns%s", c->name, (unsigned long)c->calls,
+        (long)(c->total_ns / (int64_t)c->calls), (long)c->max_ns, note);
+  }
+  return 0;
+}
+
+int
+trace_dump(
+    lua_State *L)
+{
+  char *path = stdpaths_user_data_subpath(g_trace_file);
+  if(!write_trace(&g_tracer, path))
+  {
+    MLUA_ECHO_FMT(L, true, "trace: failed to write %s", path);
+    free(path);
+    return 0;
+  }
+  MLUA_ECHO_FMT(L, true, "trace: %u spans (%u dropped) -> %s", g_tracer.length, g_tracer.dropped, path);
+  free(path);
+
+  MLUA_ECHO_FMT(L, true, "bytecode: %u hits, %u misses, parse time saved %ld ns",
+      g_bytecode_pack.hits, g_bytecode_pack.misses, (long)g_bytecode_pack.saved_ns);
+  MLUA_ECHO_FMT(L, true, "modules: %u indexed, %u on the runtimepath, %u rebuilds",
+      g_module_index.modules_len, g_module_index.selected_len, g_module_index.rebuilds);
+  MLUA_ECHO_FMT(L, true, "autoread: %u watches, %u inotify events", g_file_watch.entries_len, g_file_watch.events);
+  MLUA_ECHO_FMT(L, true, "highlights: %u syncs, %u groups read, %u set",
+      g_highlight_stats.syncs, g_highlight_stats.groups, g_highlight_stats.applied);
+#if MODE_FORMATTER
+  MLUA_ECHO_FMT(L, true, "formatters: %u probes", atomic_load(&g_formatter_probe.probes));
+#endif
+
+  // the slowest leaf-level work, phases are the sum of everything else
+  struct TraceEvent const *slowest[3] = {0};
+  for(uint i = 0;
+      i < g_tracer.length;
+      i += 1)
+  {
+    struct TraceEvent const *e = &g_tracer.events[i];
+    if(strcmp(e->cat, "phase") == 0) { continue; }
+    for(uint j = 0;
+        j < STATIC_ARRAY_SIZE(slowest);
+        j += 1)
+    {
+      if(slowest[j] != NULL && trace_duration_ns(slowest[j]) >= trace_duration_ns(e)) { continue; }
+      memmove(&slowest[j + 1], &slowest[j], (STATIC_ARRAY_SIZE(slowest) - j - 1) * sizeof(*slowest));
+      slowest[j] = e;
+      break;
+    }
+  }
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(slowest) && slowest[i] != NULL;
+      i += 1)
+  {
+    uint64_t ns = trace_duration_ns(slowest[i]);
+    MLUA_ECHO_FMT(L, true, "trace: %lu.%06lums %s %s",
+        (unsigned long)(ns / 1'000'000), (unsigned long)(ns % 1'000'000), slowest[i]->cat, slowest[i]->name);
+  }
+  return 0;
+}
+#endif
+
+/* LAZY PLUGINS */
+int
+lazy_setup_sleuth(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Sleuth, 0, 1) { }
+  return 0;
+}
+
+int
+lazy_setup_gitsigns(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Gitsigns, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "gitsigns", 0, 1)
+  {
+    MLUA_PUSH_KV_TABLE(L, "signs", 0, 5)
+    {
+      MLUA_PUSH_KV_TABLE_KV(L, "add", "text") { lua_pushstring(L, "+"); }
+      MLUA_PUSH_KV_TABLE_KV(L, "change", "text") { lua_pushstring(L, "~"); }
+      MLUA_PUSH_KV_TABLE_KV(L, "delete", "text") { lua_pushstring(L, "_"); }
+      MLUA_PUSH_KV_TABLE_KV(L, "topdelete", "text") { lua_pushstring(L, "‾"); }
+      MLUA_PUSH_KV_TABLE_KV(L, "changedelete", "text") { lua_pushstring(L, "~"); }
+    }
+  }
+
+  NVIM_MAP_CMD(L, "n", "]h", "lua require('gitsigns').nav_hunk('next')");
+  NVIM_MAP_CMD(L, "n", "[h", "lua require('gitsigns').nav_hunk('prev')");
+  return 0;
+}
+
+int
+lazy_setup_oil(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Oil, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "oil", 0, 5)
+  {
+    static char const *nvim_oil_columns[] =
+    {
+      // "permissions",
+      // "size",
+      "mtime",
+      "icon",
+    };
+    int nvim_oil_columns_length = (int)STATIC_ARRAY_SIZE(nvim_oil_columns);
+
+    MLUA_PUSH_KV_TABLE(L, "columns", nvim_oil_columns_length, 0)
+    {
+      for(int i = 0;
+          i < nvim_oil_columns_length;
+          i += 1)
+      {
+        MLUA_PUSH_IDX(L, i + 1) { lua_pushstring(L, nvim_oil_columns[i]); }
+      }
+    }
+
+    MLUA_PUSH_KV(L, "natural_order") { lua_pushboolean(L, true); }
+    MLUA_PUSH_KV(L, "delete_to_trash") { lua_pushboolean(L, true); }
+
+    MLUA_PUSH_KV_TABLE_KV(L, "view_options", "show_hidden") { lua_pushboolean(L, true); }
+
+    MLUA_PUSH_KV_TABLE(L, "keymaps", 0, 8)
+    {
+      MLUA_PUSH_KV(L, "g?") { lua_pushstring(L, "actions.show_help"); }
+      MLUA_PUSH_KV(L, "<CR>") { lua_pushstring(L, "actions.select"); }
+      MLUA_PUSH_KV(L, "L") { lua_pushstring(L, "actions.select"); }
+      MLUA_PUSH_KV(L, "H") { lua_pushstring(L, "actions.parent"); }
+      MLUA_PUSH_KV(L, "<C-c>") { lua_pushstring(L, "actions.close"); }
+      MLUA_PUSH_KV(L, "<C-l>") { lua_pushstring(L, "actions.refresh"); }
+      MLUA_PUSH_KV(L, "g.") { lua_pushstring(L, "actions.toggle_hidden"); }
+      MLUA_PUSH_KV(L, "g\\") { lua_pushstring(L, "actions.toggle_trash"); }
+    }
+  }
+  return 0;
+}
+
+int
+lazy_setup_undotree(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Undotree, 0, 2)
+  {
+    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "nvim-lua/plenary.nvim"); }
+  }
+
+  MLUA_REQUIRE_SETUP_CALL(L, "undotree");
+  NVIM_MAP_CMD(L, "n", "<leader>cu", "lua require('undotree').toggle()");
+  return 0;
+}
+
+int
+lazy_setup_which_key(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, WhichKey, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "which-key", 0, 1)
+  {
+    MLUA_PUSH_KV(L, "delay") { lua_pushinteger(L, 300); }
+  }
+  return 0;
+}
+
+int
+lazy_setup_mini_pick(
+    lua_State *L)
+{
+  MLUA_REQUIRE_SETUP_TABLE(L, "mini.pick", 0, 3)
+  {
+    MLUA_PUSH_KV_TABLE_KV(L, "window", "config") { MLUA_PUSH_CALLBACK(L, mini_pick_window_config); }
+    MLUA_PUSH_KV_TABLE_KV(L, "source", "match") { lua_getglobal(L, "g_fuzzy_pick_match"); }
+    MLUA_PUSH_KV_TABLE(L, "mappings", 0, 1)
+    {
+      MLUA_PUSH_KV_TABLE(L, "choose_all", 0, 2)
+      {
+        MLUA_PUSH_KV(L, "char") { lua_pushstring(L, "<C-q>"); }
+        MLUA_PUSH_KV(L, "func") { MLUA_PUSH_CALLBACK(L, mini_pick_choose_all); }
+      }
+    }
+  }
+
+  MLUA_PUSH_CALLBACK(L, pick_files);
+  nvim_map_callback(L, "n", "<leader>sf", "Files", luaL_ref(L, LUA_REGISTRYINDEX));
+
+  // :Pick grep_live and <leader>sg
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_MiniPick));
+  lua_getfield(L, -1, "registry"); ASSERT(L, lua_istable(L, -1));
+  MLUA_PUSH_KV(L, "grep_live") { MLUA_PUSH_CALLBACK(L, pick_grep_live); }
+  lua_pop(L, 2);
+  NVIM_MAP_CMD(L, "n", "<leader>sd", "lua if not pcall(MiniExtra.pickers.git_files) then MiniPick.builtin.files() end");
+  NVIM_MAP_CMD(L, "n", "<leader>sn", "lua MiniPick.start({ source = { cwd = vim.fn.stdpath('config') } }))");
+  NVIM_MAP_CMD(L, "n", "<leader>sm",
+      "lua MiniPick.start({ source = { items = "
+      "vim.fn.systemlist('man -k ' .. vim.fn.input('Man page: ')) } })");
+  return 0;
+}
+
+int
+lazy_setup_marks(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Marks, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "marks", 0, 2)
+  {
+    MLUA_PUSH_KV(L, "default_mappings") { lua_pushboolean(L, true); }
+
+    MLUA_PUSH_KV_TABLE(L, "mappings", 0, 1) { }
+  }
+  return 0;
+}
+
+int
+lazy_setup_harpoon(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Harpoon, 0, 3)
+  {
+    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "nvim-lua/plenary.nvim"); }
+  }
+
+  TRACE_BEGIN("setup", "harpoon");
+  MLUA_REQUIRE(L, "harpoon"); MLUA_SELF_PCALL_VOID(L, "setup", 1);
+  TRACE_END();
+
+  NVIM_MAP_CMD(L, "n", "<M-m>", "lua require('harpoon'):list():add()");
+  NVIM_MAP_CMD(L, "n", "<leader>hm", "lua require('harpoon'):list():add()");
+  NVIM_MAP_CMD(L, "n", "<M-l>", "lua require('harpoon').ui:toggle_quick_menu(require('harpoon'):list())");
+  NVIM_MAP_CMD(L, "n", "<leader>hl", "lua require('harpoon').ui:toggle_quick_menu(require('harpoon'):list())");
+  NVIM_MAP_CMD(L, "n", "<M-f>", "lua require('harpoon'):list():select(1)");
+  NVIM_MAP_CMD(L, "n", "<leader>hf", "lua require('harpoon'):list():select(1)");
+  NVIM_MAP_CMD(L, "n", "<M-d>", "lua require('harpoon'):list():select(2)");
+  NVIM_MAP_CMD(L, "n", "<leader>hd", "lua require('harpoon'):list():select(2)");
+  NVIM_MAP_CMD(L, "n", "<M-s>", "lua require('harpoon'):list():select(3)");
+  NVIM_MAP_CMD(L, "n", "<leader>hs", "lua require('harpoon'):list():select(3)");
+  NVIM_MAP_CMD(L, "n", "<M-a>", "lua require('harpoon'):list():select(4)");
+  NVIM_MAP_CMD(L, "n", "<leader>ha", "lua require('harpoon'):list():select(4)");
+  return 0;
+}
+
+int
+lazy_setup_lspconfig(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Lspconfig, 0, 1) { }
+  return 0;
+}
+
+#if MODE_FORMATTER
+int
+lazy_setup_conform(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Conform, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "conform", 0, 2)
+  {
+    MLUA_PUSH_KV_TABLE(L, "formatters_by_ft", 0, STATIC_ARRAY_SIZE(g_formatters_by_ft))
+    {
+      for(uint i = 0;
+          i < STATIC_ARRAY_SIZE(g_formatters_by_ft);
+          i += 1)
+      {
+        MLUA_PUSH_KV(L, g_formatters_by_ft[i].ft)
+        {
+          lua_pushinteger(L, i);
+          lua_pushcclosure(L, conform_formatters_by_ft, 1);
+        }
+      }
+    }
+
+    MLUA_PUSH_KV_TABLE_KV(L, "formatters", "odinfmt")
+    {
+      lua_createtable(L, 0, 3);
+      {
+        MLUA_PUSH_KV(L, "command") { lua_pushstring(L, "odinfmt"); }
+        MLUA_PUSH_KV(L, "stdin") { lua_pushboolean(L, true); }
+
+        MLUA_PUSH_KV_TABLE_IDX(L, "args") { lua_pushstring(L, "odinfmt"); }
+      }
+    }
+  }
+
+  NVIM_MAP_CMD(L, "n", "<leader>cf", "lua require('conform').format({ async = true, lsp_format = 'fallback' })");
+  return 0;
+}
+#endif // MODE_FORMATTER
+
+int
+lazy_setup_treesitter(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Treesitter, 0, 2)
+  {
+    MLUA_PUSH_KV_TABLE(L, "hooks", 0, 1)
+    {
+      MLUA_PUSH_KV(L, "post_checkout") { lua_pushcfunction(L, treesitter_update); }
+    }
+  }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "nvim-treesitter", 0, 1)
+  {
+    MLUA_PUSH_KV(L, "auto_install") { lua_pushboolean(L, true); }
+    MLUA_PUSH_KV_TABLE_KV(L, "highlight", "enable") { lua_pushboolean(L, false); }
+    MLUA_PUSH_KV_TABLE_KV(L, "indent", "enable") { lua_pushboolean(L, false); }
+  }
+  return 0;
+}
+
+int
+lazy_setup_todo_comments(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, TodoComments, 0, 2)
+  {
+    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "nvim-lua/plenary.nvim"); }
+  }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "todo-comments", 0, 3)
+  {
+    MLUA_PUSH_KV(L, "signs") { lua_pushboolean(L, false); }
+
+    MLUA_PUSH_KV_TABLE_KV(L, "search", "pattern") { lua_pushstring(L, "\\b(KEYWORDS)(\\([^\\)]*\\))?:"); }
+
+    MLUA_PUSH_KV_TABLE(L, "highlight", 0, 4)
+    {
+      MLUA_PUSH_KV(L, "before") { lua_pushstring(L, ""); }
+      MLUA_PUSH_KV(L, "keyword") { lua_pushstring(L, "bg"); }
+      MLUA_PUSH_KV(L, "after") { lua_pushstring(L, ""); }
+      MLUA_PUSH_KV(L, "pattern") { lua_pushstring(L, ".*<((KEYWORDS)%(\\(.{-1,}\\))?):"); }
+    }
+  }
+  return 0;
+}
+
+#if MODE_DESIGN
+int
+lazy_setup_render_markdown(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, RenderMarkdown, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "render-markdown", 0, 2)
+  {
+    MLUA_PUSH_KV_TABLE(L, "code", 0, 1)
+    {
+      MLUA_PUSH_KV(L, "border") { lua_pushstring(L, "thick"); }
+    }
+
+    MLUA_PUSH_KV_TABLE(L, "pipe_table", 0, 1)
+    {
+      MLUA_PUSH_KV(L, "border_enabled") { lua_pushboolean(L, false); }
+    }
+  }
+  return 0;
+}
+
+int
+lazy_setup_colorizer(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Colorizer, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "colorizer", 0, 1)
+  {
+    MLUA_PUSH_KV_TABLE_KV(L, "user_default_options", "names") { lua_pushboolean(L, false); }
+  }
+  return 0;
+}
+
+int
+lazy_setup_colortils(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Colortils, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_CALL(L, "colortils");
+  return 0;
+}
+#endif // MODE_DESIGN
+
+int
+lazy_setup_ibl(
+    lua_State *L)
+{
+  MLUA_MINIDEPS_ADD(L, Ibl, 0, 1) { }
+
+  MLUA_REQUIRE_SETUP_TABLE(L, "ibl", 0, 2)
+  {
+    MLUA_PUSH_KV_TABLE_KV(L, "scope", "enabled") { lua_pushboolean(L, false); }
+    MLUA_PUSH_KV_TABLE_KV(L, "indent", "char") { lua_pushstring(L, "▏"); }
+  }
+  return 0;
+}
 
-  // UI
-  NVIM_MAP_CMD(L, "n", "<leader>um", "messages");
+#if MODE_THEME
+int
+lazy_setup_flexoki(
+    lua_State *L)
+{
+  MLUA_REQUIRE_SETUP_CALL(L, "flexoki");
+  return 0;
+}
 
-  // Toggle
-  NVIM_MAP_CMD(L, "n", "<leader>th", "ColorizerToggle");
+int
+lazy_setup_nightfox(
+    lua_State *L)
+{
+  MLUA_REQUIRE_SETUP_CALL(L, "nightfox");
+  return 0;
+}
 
-  // Windows
-  NVIM_MAP_CMD(L, "n", "<leader>v", "vsp");
-  NVIM_MAP_CMD(L, "n", "<leader>wv", "vsp");
-  NVIM_MAP_CMD(L, "n", "<leader>x", "sp");
-  NVIM_MAP_CMD(L, "n", "<leader>wx", "sp");
-  NVIM_MAP_CMD(L, "n", "<leader>wt", "tab split");
+int
+lazy_setup_mellifluous(
+    lua_State *L)
+{
+  MLUA_REQUIRE_SETUP_TABLE_CALL(L, "mellifluous");
+  return 0;
+}
+#endif // MODE_THEME
+
+static struct LazyPlugin g_lazy_plugins[] =
+{
+  { .name = "vim-sleuth", .setup = lazy_setup_sleuth, .sources = PLUGIN_SOURCE(Sleuth),
+    LAZY_TRIGGERS(LAZY_EVENT("BufReadPre", NULL), LAZY_EVENT("BufNewFile", NULL)) },
+  { .name = "gitsigns", .setup = lazy_setup_gitsigns, .sources = PLUGIN_SOURCE(Gitsigns),
+    LAZY_TRIGGERS(LAZY_EVENT("BufReadPre", NULL), LAZY_EVENT("BufNewFile", NULL)) },
+  { .name = "oil", .setup = lazy_setup_oil, .sources = PLUGIN_SOURCE(Oil),
+    LAZY_TRIGGERS(LAZY_CMD("Oil")) },
+  { .name = "undotree", .setup = lazy_setup_undotree, .sources = PLUGIN_SOURCE(Undotree) | PLUGIN_SOURCE(Plenary),
+    LAZY_TRIGGERS(LAZY_KEY("n", "<leader>cu")) },
+  { .name = "which-key", .setup = lazy_setup_which_key, .sources = PLUGIN_SOURCE(WhichKey),
+    LAZY_TRIGGERS(LAZY_EVENT("UIEnter", NULL)) },
+  { .name = "mini.pick", .setup = lazy_setup_mini_pick,
+    LAZY_TRIGGERS(
+        LAZY_CMD("Pick"),
+        LAZY_KEY("n", "<leader>sf"), LAZY_KEY("n", "<leader>sd"),
+        LAZY_KEY("n", "<leader>sn"), LAZY_KEY("n", "<leader>sm")) },
+  { .name = "marks", .setup = lazy_setup_marks, .sources = PLUGIN_SOURCE(Marks),
+    LAZY_TRIGGERS(LAZY_EVENT("BufReadPost", NULL), LAZY_EVENT("BufNewFile", NULL)) },
+  { .name = "harpoon", .setup = lazy_setup_harpoon, .sources = PLUGIN_SOURCE(Harpoon) | PLUGIN_SOURCE(Plenary),
+    LAZY_TRIGGERS(
+        LAZY_KEY("n", "<M-m>"), LAZY_KEY("n", "<leader>hm"),
+        LAZY_KEY("n", "<M-l>"), LAZY_KEY("n", "<leader>hl"),
+        LAZY_KEY("n", "<M-f>"), LAZY_KEY("n", "<leader>hf"),
+        LAZY_KEY("n", "<M-d>"), LAZY_KEY("n", "<leader>hd"),
+        LAZY_KEY("n", "<M-s>"), LAZY_KEY("n", "<leader>hs"),
+        LAZY_KEY("n", "<M-a>"), LAZY_KEY("n", "<leader>ha")) },
+  // vim.lsp.enable resolves the configs on FileType, which is always after BufReadPre
+  { .name = "nvim-lspconfig", .setup = lazy_setup_lspconfig, .sources = PLUGIN_SOURCE(Lspconfig),
+    LAZY_TRIGGERS(LAZY_EVENT("BufReadPre", NULL), LAZY_EVENT("BufNewFile", NULL)) },
+#if MODE_FORMATTER
+  { .name = "conform", .setup = lazy_setup_conform, .sources = PLUGIN_SOURCE(Conform),
+    LAZY_TRIGGERS(LAZY_CMD("ConformInfo"), LAZY_KEY("n", "<leader>cf")) },
+#endif // MODE_FORMATTER
+  { .name = "nvim-treesitter", .setup = lazy_setup_treesitter, .sources = PLUGIN_SOURCE(Treesitter),
+    LAZY_TRIGGERS(
+        LAZY_EVENT("BufReadPost", NULL), LAZY_EVENT("BufNewFile", NULL),
+        LAZY_CMD("TSUpdate"), LAZY_CMD("TSInstall")) },
+  { .name = "todo-comments", .setup = lazy_setup_todo_comments, .sources = PLUGIN_SOURCE(TodoComments) | PLUGIN_SOURCE(Plenary),
+    LAZY_TRIGGERS(LAZY_EVENT("BufReadPost", NULL), LAZY_EVENT("BufNewFile", NULL)) },
+#if MODE_DESIGN
+  { .name = "render-markdown", .setup = lazy_setup_render_markdown, .sources = PLUGIN_SOURCE(RenderMarkdown),
+    LAZY_TRIGGERS(LAZY_FT("markdown"), LAZY_CMD("RenderMarkdown")) },
+  { .name = "colorizer", .setup = lazy_setup_colorizer, .sources = PLUGIN_SOURCE(Colorizer),
+    LAZY_TRIGGERS(LAZY_CMD("ColorizerToggle")) },
+  { .name = "colortils", .setup = lazy_setup_colortils, .sources = PLUGIN_SOURCE(Colortils),
+    LAZY_TRIGGERS(LAZY_CMD("Colortils")) },
+#endif // MODE_DESIGN
+  { .name = "indent-blankline", .setup = lazy_setup_ibl, .sources = PLUGIN_SOURCE(Ibl),
+    LAZY_TRIGGERS(LAZY_EVENT("BufReadPost", NULL), LAZY_EVENT("BufNewFile", NULL)) },
+#if MODE_THEME
+  // the colorschemes are on the runtimepath already, only their setup is deferred
+  { .name = "flexoki", .setup = lazy_setup_flexoki, .sources = PLUGIN_SOURCE(Flexoki),
+    LAZY_TRIGGERS(LAZY_EVENT("ColorSchemePre", "flexoki*")) },
+  { .name = "nightfox", .setup = lazy_setup_nightfox, .sources = PLUGIN_SOURCE(Nightfox),
+    LAZY_TRIGGERS(LAZY_EVENT("ColorSchemePre", "nightfox,dayfox,dawnfox,duskfox,nordfox,terafox,carbonfox")) },
+  { .name = "mellifluous", .setup = lazy_setup_mellifluous, .sources = PLUGIN_SOURCE(Mellifluous),
+    LAZY_TRIGGERS(LAZY_EVENT("ColorSchemePre", "mellifluous")) },
+#endif // MODE_THEME
+};
 
-  NVIM_MAP_CMD(L, "n", "<leader>w|", "vertical resize");
-  NVIM_MAP_CMD(L, "n", "<leader>w_", "horizontal resize");
-  NVIM_MAP_CMD(L, "n", "<leader>ws", "wincmd =");
-  nvim_map(L, "n", "<leader>wf", "<cmd>horizontal resize<cr><cmd>vertical resize<cr>");
+/* BOOTSTRAP */
+// vim.cmd({ cmd = "helptags", args = { dir }, magic = { file = false } }), a duplicate tag only echoes
+static uint
+config_helptags_generate(
+    void *ctx,
+    char const *dir)
+{
+  lua_State *L = ctx;
+  TRACE_BEGIN("helptags", "generate"); // dir does not outlive the tracer
+  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "cmd");
+  lua_createtable(L, 0, 3);
+  MLUA_PUSH_KV(L, "cmd") { lua_pushstring(L, "helptags"); }
+  MLUA_PUSH_KV_TABLE_IDX(L, "args") { lua_pushstring(L, dir); }
+  MLUA_PUSH_KV_TABLE(L, "magic", 0, 1)
+  {
+    MLUA_PUSH_KV(L, "file") { lua_pushboolean(L, false); }
+  }
+  bool ok = lua_pcall(L, 1, 0, 0) == 0;
+  if(!ok)
+  {
+    MLUA_ECHO_FMT(L, true, "helptags: %s", lua_tostring(L, -1));
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  TRACE_END();
+  return ok;
+}
 
-  NVIM_MAP_CMD(L, "n", "<leader>wN", "setlocal buftype=nofile"); // turn off ability to save
+// replaces `helptags ALL`, only doc directories that changed since the last start are regenerated
+static inline void
+config_helptags(
+    lua_State *L)
+{
+#if PERFORMANCE
+  START_PERF_TIME(g_perf_times, Perf_Time_Helptags);
+#endif
+  TRACE_BEGIN("phase", "Helptags");
 
-  /* End Keymaps */
+  char roots[2][PATH_MAX];
+  snprintf(roots[0], sizeof(roots[0]), "%.*spack/deps/opt", (int)g_package_path_len, g_package_path);
+  snprintf(roots[1], sizeof(roots[1]), "%.*spack/deps/start", (int)g_package_path_len, g_package_path);
+  char const *root_ptrs[] = { roots[0], roots[1] };
 
-  // Highlight when yanking (copying) text
-  nvim_mk_autocmd_command(L, "TextYankPost", "Highlight when yanking text", "my-highlight-yank", true,
-      nvim_mk_string("lua vim.highlight.on_yank({ on_visual = false })"));
+  char *path = stdpaths_user_data_subpath(g_helptags_file);
+  struct Helptags h = update_helptags(path, root_ptrs, STATIC_ARRAY_SIZE(root_ptrs), config_helptags_generate, L);
+  free(path);
 
+  TRACE_END();
 #if PERFORMANCE
-  END_PERF_TIME(perf_times, Perf_Time_Opt);
-
-  perf_times[Perf_Time_Download][0] = perf_times[Perf_Time_Opt][1];
+  END_PERF_TIME(g_perf_times, Perf_Time_Helptags);
+  MLUA_ECHO_FMT(L, true, "helptags: %u doc dirs, %u regenerated, %u failed", h.dirs_len, h.regenerated, h.failed);
+#else
+  (void)h;
 #endif
+}
+
+static inline void
+config_plugins(
+    lua_State *L)
+{
+  g_config_plugins_done = true;
+
+  // require the package manager
+  do_cmdline_cmd("packadd mini.nvim");
+  config_helptags(L);
+  MLUA_REQUIRE_SETUP_TABLE(L, "mini.deps", 0, 1)
+  {
+    MLUA_PUSH_KV_TABLE_KV(L, "path", "package") { lua_pushlstring(L, g_package_path, g_package_path_len); }
+  }
 
-  /* Download Packages */
   // 'a' and 'i' text movements
   MLUA_REQUIRE_SETUP_TABLE(L, "mini.ai", 0, 1)
   {
@@ -914,173 +3147,22 @@ luaopen_config(
   {
     MLUA_PUSH_KV(L, "ignore_blank_line") { lua_pushboolean(L, true); }
 
-    MLUA_PUSH_KV_TABLE_KV(L, "options", "custom_commentstring") { lua_pushcfunction(L, mini_comment_custom_commentstring); }
+    MLUA_PUSH_KV_TABLE_KV(L, "options", "custom_commentstring") { MLUA_PUSH_CALLBACK(L, mini_comment_custom_commentstring); }
   }
+  NVIM_MK_AUTOCMD_CALLBACK(
+      L, "FileType",
+      "Forget the cached commentstring", "my-commentstring", true,
+      commentstring_invalidate);
 
   // trailing spaces are highlighted
   MLUA_REQUIRE_SETUP_CALL(L, "mini.trailspace");
 
-  // detect tabbing
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/tpope/vim-sleuth"); }
-  }
-
-  // git signs
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/lewis6991/gitsigns.nvim"); }
-  }
-
-  MLUA_REQUIRE_SETUP_TABLE(L, "gitsigns", 0, 1)
-  {
-    MLUA_PUSH_KV_TABLE(L, "signs", 0, 5)
-    {
-      MLUA_PUSH_KV_TABLE_KV(L, "add", "text") { lua_pushstring(L, "+"); }
-      MLUA_PUSH_KV_TABLE_KV(L, "change", "text") { lua_pushstring(L, "~"); }
-      MLUA_PUSH_KV_TABLE_KV(L, "delete", "text") { lua_pushstring(L, "_"); }
-      MLUA_PUSH_KV_TABLE_KV(L, "topdelete", "text") { lua_pushstring(L, "‾"); }
-      MLUA_PUSH_KV_TABLE_KV(L, "changedelete", "text") { lua_pushstring(L, "~"); }
-    }
-  }
-
-  // git signs hunks
-  NVIM_MAP_CMD(L, "n", "]h", "lua require('gitsigns').nav_hunk('next')");
-  NVIM_MAP_CMD(L, "n", "[h", "lua require('gitsigns').nav_hunk('prev')");
-
   // file explorer
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/stevearc/oil.nvim"); }
-  }
-
-  MLUA_REQUIRE_SETUP_TABLE(L, "oil", 0, 5)
-  {
-    static char const *nvim_oil_columns[] =
-    {
-      // "permissions",
-      // "size",
-      "mtime",
-      "icon",
-    };
-    int nvim_oil_columns_length = (int)STATIC_ARRAY_SIZE(nvim_oil_columns);
-
-    MLUA_PUSH_KV_TABLE(L, "columns", nvim_oil_columns_length, 0)
-    {
-      for(int i = 0;
-          i < nvim_oil_columns_length;
-          i += 1)
-      {
-        MLUA_PUSH_IDX(L, i + 1) { lua_pushstring(L, nvim_oil_columns[i]); }
-      }
-    }
-
-    MLUA_PUSH_KV(L, "natural_order") { lua_pushboolean(L, true); }
-    MLUA_PUSH_KV(L, "delete_to_trash") { lua_pushboolean(L, true); }
-
-    MLUA_PUSH_KV_TABLE_KV(L, "view_options", "show_hidden") { lua_pushboolean(L, true); }
-
-    MLUA_PUSH_KV_TABLE(L, "keymaps", 0, 8)
-    {
-      MLUA_PUSH_KV(L, "g?") { lua_pushstring(L, "actions.show_help"); }
-      MLUA_PUSH_KV(L, "<CR>") { lua_pushstring(L, "actions.select"); }
-      MLUA_PUSH_KV(L, "L") { lua_pushstring(L, "actions.select"); }
-      MLUA_PUSH_KV(L, "H") { lua_pushstring(L, "actions.parent"); }
-      MLUA_PUSH_KV(L, "<C-c>") { lua_pushstring(L, "actions.close"); }
-      MLUA_PUSH_KV(L, "<C-l>") { lua_pushstring(L, "actions.refresh"); }
-      MLUA_PUSH_KV(L, "g.") { lua_pushstring(L, "actions.toggle_hidden"); }
-      MLUA_PUSH_KV(L, "g\\") { lua_pushstring(L, "actions.toggle_trash"); }
-    }
-  }
-
   NVIM_MAP_CMD(L, "n", "<leader>uf", "Oil");
 
-  // Visual Undo Tree
-  MLUA_MINIDEPS_ADD(L, 0, 2)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/jiaoshijie/undotree"); }
-    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "nvim-lua/plenary.nvim"); }
-  }
-
-  MLUA_REQUIRE_SETUP_CALL(L, "undotree");
-  NVIM_MAP_CMD(L, "n", "<leader>cu", "lua require('undotree').toggle()");
-
-  // show keybinds
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/folke/which-key.nvim"); }
-  }
-
-  MLUA_REQUIRE_SETUP_TABLE(L, "which-key", 0, 1)
-  {
-    MLUA_PUSH_KV(L, "delay") { lua_pushinteger(L, 300); }
-  }
-
   // search engine
-  MLUA_REQUIRE_SETUP_TABLE(L, "mini.pick", 0, 1)
-  {
-    MLUA_PUSH_KV_TABLE_KV(L, "window", "config") { lua_pushcfunction(L, mini_pick_window_config); }
-    MLUA_PUSH_KV_TABLE(L, "mappings", 0, 1)
-    {
-      MLUA_PUSH_KV_TABLE(L, "choose_all", 0, 2)
-      {
-        MLUA_PUSH_KV(L, "char") { lua_pushstring(L, "<C-q>"); }
-        MLUA_PUSH_KV(L, "func") { lua_pushcfunction(L, mini_pick_choose_all); }
-      }
-    }
-  }
-
-  NVIM_MAP_CMD(L, "n", "<leader>sf", "lua MiniPick.builtin.cli({ command = { 'fd', '-t', 'f', '-H', '-E.git' } })");
-  NVIM_MAP_CMD(L, "n", "<leader>sd", "lua if not pcall(MiniExtra.pickers.git_files) then MiniPick.builtin.files() end");
   NVIM_MAP_CMD(L, "n", "<leader>sg", "Pick grep_live");
   NVIM_MAP_CMD(L, "n", "<leader>so", "Pick buffers");
-  NVIM_MAP_CMD(L, "n", "<leader>sn", "lua MiniPick.start({ source = { cwd = vim.fn.stdpath('config') } }))");
-  NVIM_MAP_CMD(L, "n", "<leader>sm",
-      "lua MiniPick.start({ source = { items = "
-      "vim.fn.systemlist('man -k ' .. vim.fn.input('Man page: ')) } })");
-
-  // qol improvements for marks
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/chentoast/marks.nvim"); }
-  }
-
-  MLUA_REQUIRE_SETUP_TABLE(L, "marks", 0, 2)
-  {
-    MLUA_PUSH_KV(L, "default_mappings") { lua_pushboolean(L, true); }
-
-    MLUA_PUSH_KV_TABLE(L, "mappings", 0, 1) { }
-  }
-
-  // jump to files
-  MLUA_MINIDEPS_ADD(L, 0, 3)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/ThePrimeagen/harpoon"); }
-    MLUA_PUSH_KV(L, "checkout") { lua_pushstring(L, "harpoon2"); }
-
-    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "nvim-lua/plenary.nvim"); }
-  }
-
-  MLUA_REQUIRE(L, "harpoon"); MLUA_SELF_PCALL_VOID(L, "setup", 1);
-
-  NVIM_MAP_CMD(L, "n", "<M-m>", "lua require('harpoon'):list():add()");
-  NVIM_MAP_CMD(L, "n", "<leader>hm", "lua require('harpoon'):list():add()");
-  NVIM_MAP_CMD(L, "n", "<M-l>", "lua require('harpoon').ui:toggle_quick_menu(require('harpoon'):list())");
-  NVIM_MAP_CMD(L, "n", "<leader>hl", "lua require('harpoon').ui:toggle_quick_menu(require('harpoon'):list())");
-  NVIM_MAP_CMD(L, "n", "<M-f>", "lua require('harpoon'):list():select(1)");
-  NVIM_MAP_CMD(L, "n", "<leader>hf", "lua require('harpoon'):list():select(1)");
-  NVIM_MAP_CMD(L, "n", "<M-d>", "lua require('harpoon'):list():select(2)");
-  NVIM_MAP_CMD(L, "n", "<leader>hd", "lua require('harpoon'):list():select(2)");
-  NVIM_MAP_CMD(L, "n", "<M-s>", "lua require('harpoon'):list():select(3)");
-  NVIM_MAP_CMD(L, "n", "<leader>hs", "lua require('harpoon'):list():select(3)");
-  NVIM_MAP_CMD(L, "n", "<M-a>", "lua require('harpoon'):list():select(4)");
-  NVIM_MAP_CMD(L, "n", "<leader>ha", "lua require('harpoon'):list():select(4)");
-
-  // lsp configuration presets
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/neovim/nvim-lspconfig"); }
-  }
 
   // setup lsp
   {
@@ -1114,12 +3196,6 @@ luaopen_config(
     }
     MLUA_PCALL_VOID(L, 1);
 
-    // disable semantic highlights
-    NVIM_MK_AUTOCMD_CALLBACK(
-        L, "ColorScheme",
-        "Disable LSP Highlights", "my-colorscheme-disable-lsp", false,
-        lsp_disable_semantic_highlights);
-
     // on_attach
     NVIM_MK_AUTOCMD_CALLBACK(
         L, "LspAttach",
@@ -1129,253 +3205,588 @@ luaopen_config(
     lua_pop(L, 1);
   }
 
-#if MODE_FORMATTER
-  // auto format
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+#if MODE_DESIGN
+  // markdown editing
+  NVIM_MAP_CMD(L, "n", "<leader>tm", "RenderMarkdown toggle");
+
+  // edit color codes
+  NVIM_MAP_CMD(L, "n", "<leader>uh", "Colortils");
+#endif // MODE_DESIGN
+
+#if MODE_THEME
+  // install themes
+  MLUA_MINIDEPS_ADD(L, Zenbones, 0, 2)
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/stevearc/conform.nvim"); }
+    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "rktjmp/lush.nvim"); }
   }
 
-  MLUA_REQUIRE_SETUP_TABLE(L, "conform", 0, 2)
-  {
-    MLUA_PUSH_KV_TABLE(L, "formatters_by_ft", 0, 14)
-    {
-      MLUA_PUSH_KV_TABLE_IDX(L, "c") { lua_pushstring(L, "clang-format"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "cpp") { lua_pushstring(L, "clang-format"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "odin") { lua_pushstring(L, "odinfmt"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "rust") { lua_pushstring(L, "rustfmt"); }
+  // light modes
+  MLUA_MINIDEPS_ADD(L, Nightfox, 0, 1) { }
 
-      MLUA_PUSH_KV_TABLE(L, "haskell", 2, 1)
-      {
-        MLUA_PUSH_IDX(L, 1) { lua_pushstring(L, "fourmolu"); }
-        MLUA_PUSH_IDX(L, 2) { lua_pushstring(L, "ormolu"); }
-        MLUA_PUSH_KV(L, "stop_after_first") { lua_pushboolean(L, true); }
-      }
+  MLUA_MINIDEPS_ADD(L, Mellifluous, 0, 1) { }
 
-      MLUA_PUSH_KV_TABLE_IDX(L, "clojure") { lua_pushstring(L, "cljfmt"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "java") { lua_pushstring(L, "google-java-format"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "cs") { lua_pushstring(L, "csharpier"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "lua") { lua_pushstring(L, "stylua"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "purescript") { lua_pushstring(L, "purescript-tidy"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "html") { lua_pushstring(L, "prettier"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "typescript") { lua_pushstring(L, "biome"); }
-      MLUA_PUSH_KV_TABLE_IDX(L, "javascript") { lua_pushstring(L, "biome"); }
-      MLUA_PUSH_KV(L, "python") { lua_pushcfunction(L, conform_formatters_by_ft_python); }
-    }
+  MLUA_MINIDEPS_ADD(L, Blossom, 0, 1) { }
 
-    MLUA_PUSH_KV_TABLE_KV(L, "formatters", "odinfmt")
-    {
-      lua_createtable(L, 0, 3);
-      {
-        MLUA_PUSH_KV(L, "command") { lua_pushstring(L, "odinfmt"); }
-        MLUA_PUSH_KV(L, "stdin") { lua_pushboolean(L, true); }
+  MLUA_MINIDEPS_ADD(L, Flexoki, 0, 1) { }
 
-        MLUA_PUSH_KV_TABLE_IDX(L, "args") { lua_pushstring(L, "odinfmt"); }
-      }
-    }
-  }
+  // dark modes
+  MLUA_MINIDEPS_ADD(L, Naysayer, 0, 1) { }
 
-  NVIM_MAP_CMD(L, "n", "<leader>cf", "lua require('conform').format({ async = true, lsp_format = 'fallback' })");
-#endif // MODE_FORMATTER
+  // mixed modes
+  MLUA_MINIDEPS_ADD(L, Kanagawa, 0, 1) { }
 
-  // text semantics engine
-  MLUA_MINIDEPS_ADD(L, 0, 2)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/nvim-treesitter/nvim-treesitter"); }
+  // enable theme
+  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "cmd"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "colorscheme");
+  lua_pushstring(L, "zenwritten");
+  MLUA_PCALL_VOID(L, 1);
+  lua_pop(L, 1);
+#endif
 
-    MLUA_PUSH_KV_TABLE(L, "hooks", 0, 1)
-    {
-      MLUA_PUSH_KV(L, "post_checkout") { lua_pushcfunction(L, treesitter_update); }
-    }
-  }
+  // everything else is loaded on first use, or before MiniDeps touches every plugin
+  lazy_register(L, g_lazy_plugins, STATIC_ARRAY_SIZE(g_lazy_plugins));
+  lazy_wrap_minideps(L, g_lazy_plugins, STATIC_ARRAY_SIZE(g_lazy_plugins));
 
-  MLUA_REQUIRE_SETUP_TABLE(L, "nvim-treesitter", 0, 1)
-  {
-    MLUA_PUSH_KV(L, "auto_install") { lua_pushboolean(L, true); }
-    MLUA_PUSH_KV_TABLE_KV(L, "highlight", "enable") { lua_pushboolean(L, false); }
-    MLUA_PUSH_KV_TABLE_KV(L, "indent", "enable") { lua_pushboolean(L, false); }
-  }
+  // theme type
+  nvim_set_o(L, "background", nvim_mk_obj_string("light"));
+
+  // highlights, again after every colorscheme (semantic highlights stay disabled)
+  highlight_sync(L);
+  NVIM_MK_AUTOCMD_CALLBACK(
+      L, "ColorScheme",
+      "Apply the highlight overrides", "my-highlights", true,
+      highlight_sync_callback);
+
+#if MODE_FOCUS
+  // disable syntax highlighting
+  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "cmd"); ASSERT(L, lua_istable(L, -1));
+  lua_getfield(L, -1, "syntax");
+  lua_pushstring(L, "off");
+  MLUA_PCALL_VOID(L, 1);
+  lua_pop(L, 1);
+#endif
+}
 
-  // highlight special comments
-  MLUA_MINIDEPS_ADD(L, 0, 2)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/folke/todo-comments.nvim"); }
+static inline void
+bootstrap_on_done(
+    void *ctx,
+    struct BootstrapJob *job)
+{
+  lua_State *L = ctx;
+  g_plugin_sources_pending &= ~(1ULL << job->id);
 
-    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "nvim-lua/plenary.nvim"); }
+  char const *name = bootstrap_url_name(job->url);
+  if(job->state == Bootstrap_State_Done)
+  {
+    MLUA_ECHO_FMT(L, true, "installed %s", name);
   }
-
-  MLUA_REQUIRE_SETUP_TABLE(L, "todo-comments", 0, 3)
+  else
   {
-    MLUA_PUSH_KV(L, "signs") { lua_pushboolean(L, false); }
-
-    MLUA_PUSH_KV_TABLE_KV(L, "search", "pattern") { lua_pushstring(L, "\\b(KEYWORDS)(\\([^\\)]*\\))?:"); }
+    MLUA_ECHO_FMT(L, true, "failed to install %s: %.*s", name, (int)job->progress_len, job->progress);
 
-    MLUA_PUSH_KV_TABLE(L, "highlight", 0, 4)
-    {
-      MLUA_PUSH_KV(L, "before") { lua_pushstring(L, ""); }
-      MLUA_PUSH_KV(L, "keyword") { lua_pushstring(L, "bg"); }
-      MLUA_PUSH_KV(L, "after") { lua_pushstring(L, ""); }
-      MLUA_PUSH_KV(L, "pattern") { lua_pushstring(L, ".*<((KEYWORDS)%(\\(.{-1,}\\))?):"); }
-    }
+    // nothing in the plugin section works without the package manager
+    if(job->id == Plugin_Source_MiniNvim) { g_config_plugins_done = true; }
   }
+}
 
-#if MODE_DESIGN
-  // markdown editing
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+int
+bootstrap_tick(
+    lua_State *L)
+{
+  uint done = poll_bootstrap(&g_bootstrap, bootstrap_on_done, L);
+
+  if(!g_config_plugins_done && (g_plugin_sources_pending & PLUGIN_SOURCES_EAGER) == 0)
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/MeanderingProgrammer/render-markdown.nvim"); }
+    config_plugins(L);
   }
 
-  MLUA_REQUIRE_SETUP_TABLE(L, "render-markdown", 0, 2)
+  // plugins that were triggered while they were still cloning
+  if(done > 0 && g_config_plugins_done)
   {
-    MLUA_PUSH_KV_TABLE(L, "code", 0, 1)
+    for(uint i = 0;
+        i < STATIC_ARRAY_SIZE(g_lazy_plugins);
+        i += 1)
     {
-      MLUA_PUSH_KV(L, "border") { lua_pushstring(L, "thick"); }
+      struct LazyPlugin *plugin = &g_lazy_plugins[i];
+      if(!plugin->deferred || (plugin->sources & g_plugin_sources_pending) != 0) { continue; }
+      lazy_load(L, plugin);
+      lazy_replay(L, plugin);
     }
+  }
 
-    MLUA_PUSH_KV_TABLE(L, "pipe_table", 0, 1)
+  if(!finished_bootstrap(&g_bootstrap))
+  {
+    for(uint i = 0;
+        i < g_bootstrap.jobs_len;
+        i += 1)
     {
-      MLUA_PUSH_KV(L, "border_enabled") { lua_pushboolean(L, false); }
+      struct BootstrapJob *job = &g_bootstrap.jobs[i];
+      if(job->state != Bootstrap_State_Running) { continue; }
+
+      MLUA_ECHO_FMT(L, false, "[%u/%u] %s: %.*s",
+          g_bootstrap.finished, g_bootstrap.jobs_len,
+          bootstrap_url_name(job->url), (int)job->progress_len, job->progress);
+      break;
     }
+    return 0;
   }
-  NVIM_MAP_CMD(L, "n", "<leader>tm", "RenderMarkdown toggle");
 
-  // highlight color codes
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/catgoose/nvim-colorizer.lua"); }
-  }
+  // stop polling
+  lua_rawgeti(L, LUA_REGISTRYINDEX, g_bootstrap_timer);
+  MLUA_SELF_PCALL_VOID(L, "stop", 1);
+  MLUA_SELF_PCALL_VOID(L, "close", 1);
+  lua_pop(L, 1);
+  luaL_unref(L, LUA_REGISTRYINDEX, g_bootstrap_timer);
+  g_bootstrap_timer = LUA_NOREF;
+  deinit_bootstrap(&g_bootstrap);
+  return 0;
+}
 
-  MLUA_REQUIRE_SETUP_TABLE(L, "colorizer", 0, 1)
+static inline void
+bootstrap_missing_plugins(
+    lua_State *L)
+{
+  uint64_t sources = PLUGIN_SOURCES_EAGER;
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(g_lazy_plugins);
+      i += 1)
   {
-    MLUA_PUSH_KV_TABLE_KV(L, "user_default_options", "names") { lua_pushboolean(L, false); }
+    sources |= g_lazy_plugins[i].sources;
   }
-  NVIM_MAP_CMD(L, "n", "<leader>uh", "Colortils");
 
-  // edit color codes
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%.*s%s", (int)g_package_path_len, g_package_path, g_plugin_dir);
+
+  ASSERT(L, init_bootstrap(&g_bootstrap, BOOTSTRAP_PARALLEL));
+  for(int i = 0;
+      i < Plugin_Source_Count;
+      i += 1)
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/max397574/colortils.nvim"); }
-  }
+    if((sources & (1ULL << i)) == 0) { continue; }
 
-  MLUA_REQUIRE_SETUP_CALL(L, "colortils");
-#endif // MODE_DESIGN
+    char path[sizeof(dir) + NAME_MAX + 1];
+    int path_len = snprintf(path, sizeof(path), "%s/%s", dir, bootstrap_url_name(g_plugin_sources[i].url));
+    ASSERT(L, path_len > 0 && path_len < (int)sizeof(path));
+    if(os_isdir(path)) { continue; }
 
-  // indent guides
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/lukas-reineke/indent-blankline.nvim"); }
+    ASSERT(L, push_bootstrap(&g_bootstrap, i, g_plugin_sources[i].url, g_plugin_sources[i].checkout, dir));
+    g_plugin_sources_pending |= 1ULL << i;
   }
 
-  MLUA_REQUIRE_SETUP_TABLE(L, "ibl", 0, 2)
+  if(g_bootstrap.jobs_len == 0)
   {
-    MLUA_PUSH_KV_TABLE_KV(L, "scope", "enabled") { lua_pushboolean(L, false); }
-    MLUA_PUSH_KV_TABLE_KV(L, "indent", "char") { lua_pushstring(L, "▏"); }
+    deinit_bootstrap(&g_bootstrap);
+    return;
   }
 
-#if MODE_THEME
-  // install themes
-  MLUA_MINIDEPS_ADD(L, 0, 2)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/zenbones-theme/zenbones.nvim"); }
-    MLUA_PUSH_KV_TABLE_IDX(L, "depends") { lua_pushstring(L, "rktjmp/lush.nvim"); }
-  }
+  // vim.uv.new_timer():start(0, BOOTSTRAP_POLL_MS, vim.schedule_wrap(bootstrap_tick))
+  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
+  int vim_idx = lua_gettop(L);
+  lua_getfield(L, vim_idx, "uv");
+  lua_getfield(L, -1, "new_timer");
+  MLUA_PCALL(L, 0, 1);
+  lua_pushvalue(L, -1);
+  g_bootstrap_timer = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  MLUA_SELF(L, "start");
+  lua_pushinteger(L, 0);
+  lua_pushinteger(L, BOOTSTRAP_POLL_MS);
+  lua_getfield(L, vim_idx, "schedule_wrap");
+  lua_pushcfunction(L, bootstrap_tick);
+  MLUA_PCALL(L, 1, 1);
+  MLUA_PCALL(L, 4, 0);
+  lua_settop(L, vim_idx - 1);
+}
 
-  // light modes
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/EdenEast/nightfox.nvim"); }
-  }
+/* FILE WATCH */
+// watches (or stops watching) the file of buf under its current name
+static inline void
+filewatch_buf(
+    Buffer buf)
+{
+  Error e = ERROR_INIT;
+  String name = nvim_buf_get_name(buf, &e);
+  if(e.type != kErrorTypeNone || name.size == 0) { unwatch_file(&g_file_watch, buf); return; }
+  watch_file(&g_file_watch, buf, name.data);
+}
+
+// vim.schedule'd by filewatch_on_readable
+int
+filewatch_flush(
+    lua_State *L)
+{
+  g_file_watch_scheduled = false;
 
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+  // checktime would prompt over the command line, CmdlineLeave schedules this again
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_VimFnMode));
+  MLUA_PCALL(L, 0, 1);
+  bool cmdline = lua_tostring(L, -1)[0] == 'c';
+  lua_pop(L, 1);
+  if(cmdline) { return 0; }
+
+  int bufs[FILEWATCH_MAX];
+  uint bufs_len = take_file_watch(&g_file_watch, bufs, STATIC_ARRAY_SIZE(bufs));
+  TRACE_BEGIN("autoread", "checktime");
+  for(uint i = 0;
+      i < bufs_len;
+      i += 1)
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/ramojus/mellifluous.nvim"); }
+    if(!nvim_buf_is_loaded(bufs[i])) { unwatch_file(&g_file_watch, bufs[i]); continue; }
+
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "checktime %d", bufs[i]);
+    do_cmdline_cmd(cmd);
+    filewatch_buf(bufs[i]); // a file replaced by rename is a new inode
   }
+  TRACE_END();
+  return 0;
+}
+
+static inline void
+filewatch_schedule(
+    lua_State *L)
+{
+  if(g_file_watch_scheduled || g_file_watch.changed_len == 0) { return; }
+  g_file_watch_scheduled = true;
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_VimSchedule));
+  lua_pushcfunction(L, filewatch_flush);
+  MLUA_PCALL(L, 1, 0);
+}
+
+// uv poll callback, a fast context: drains the fd and leaves the nvim api to filewatch_flush
+int
+filewatch_on_readable(
+    lua_State *L)
+{
+  read_file_watch(&g_file_watch);
+  filewatch_schedule(L);
+  return 0;
+}
+
+// BufReadPost, BufWritePost (a write may replace the file), BufFilePost
+int
+filewatch_on_buf(
+    lua_State *L)
+{
+  lua_getfield(L, 1, "buf");
+  filewatch_buf(lua_tointeger(L, -1));
+  lua_pop(L, 1);
+  return 0;
+}
+
+int
+filewatch_on_unload(
+    lua_State *L)
+{
+  lua_getfield(L, 1, "buf");
+  unwatch_file(&g_file_watch, lua_tointeger(L, -1));
+  lua_pop(L, 1);
+  return 0;
+}
+
+int
+filewatch_on_cmdline_leave(
+    lua_State *L)
+{
+  filewatch_schedule(L);
+  return 0;
+}
+
+// vim.uv.new_poll(fd):start("r", filewatch_on_readable)
+static inline void
+filewatch_start(
+    lua_State *L)
+{
+  ASSERT(L, mlua_push_ref(L, Mlua_Ref_Vim));
+  lua_getfield(L, -1, "uv");
+  lua_getfield(L, -1, "new_poll");
+  lua_pushinteger(L, g_file_watch.fd);
+  MLUA_PCALL(L, 1, 1);
+  lua_pushvalue(L, -1);
+  g_file_watch_poll = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  MLUA_SELF(L, "start");
+  lua_pushstring(L, "r");
+  lua_pushcfunction(L, filewatch_on_readable);
+  MLUA_PCALL(L, 3, 0);
+  lua_pop(L, 2);
+}
+
+/* CACHE */
+static inline uint
+config_cache_path(
+    char *out,
+    uint out_len,
+    char const *file)
+{
+  char *cache_home = get_xdg_home(kXDGCacheHome);
+  int len = snprintf(out, out_len, "%s%s", cache_home, file);
+  free(cache_home);
+  return len > 0 && len < (int)out_len;
+}
+
+/* BYTECODE */
+// the pack only holds bytecode of this LuaJIT
+static inline uint64_t
+config_bytecode_key(
+    lua_State *L)
+{
+  uint64_t h = snapshot_key_module(SNAPSHOT_FNV_OFFSET, &g_lua_macro_latch);
+  if(h == 0) { return 0; }
 
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+  lua_getglobal(L, "jit");
+  if(!lua_istable(L, -1))
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/rayes0/blossom.vim"); }
+    lua_pop(L, 1);
+    return 0;
   }
+  lua_getfield(L, -1, "version");
+  h = snapshot_hash_string(h, lua_tostring(L, -1));
+  lua_pop(L, 2);
+  return h == 0 ? 1 : h;
+}
 
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+int
+bytecode_pack_save(
+    lua_State *L)
+{
+  if(!write_bytecode_pack(&g_bytecode_pack))
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/kepano/flexoki-neovim"); }
+    MLUA_ECHO_FMT(L, true, "bytecode: failed to write %s", g_bytecode_pack.path);
   }
+  return 0;
+}
 
-  MLUA_REQUIRE_SETUP_CALL(L, "flexoki");
-  MLUA_REQUIRE_SETUP_CALL(L, "nightfox");
-  MLUA_REQUIRE_SETUP_TABLE_CALL(L, "mellifluous");
+// VimLeavePre, after bytecode_pack_save (registered later): joins the probe thread, stops the inotify watch and unmaps the caches
+int
+config_teardown(
+    lua_State *L)
+{
+#if MODE_FORMATTER
+  stop_exec_probe(&g_formatter_probe);
+#endif
 
-  // dark modes
-  MLUA_MINIDEPS_ADD(L, 0, 1)
+  if(g_file_watch_poll != LUA_NOREF)
   {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/RostislavArts/naysayer.nvim"); }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_file_watch_poll);
+    MLUA_SELF_PCALL(L, "close", 1, 0); // before its fd is closed
+    lua_pop(L, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, g_file_watch_poll);
+    g_file_watch_poll = LUA_NOREF;
+    deinit_file_watch(&g_file_watch);
   }
 
-  // mixed modes
-  MLUA_MINIDEPS_ADD(L, 0, 1)
-  {
-    MLUA_PUSH_KV(L, "source") { lua_pushstring(L, "https://github.com/rebelot/kanagawa.nvim"); }
-  }
+  // a require after this misses both and searches the runtimepath
+  close_bytecode_pack(&g_bytecode_pack);
+  close_module_index(&g_module_index);
+  return 0;
+}
 
-  // enable theme
-  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "cmd"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "colorscheme");
-  lua_pushstring(L, "zenwritten");
-  MLUA_PCALL_VOID(L, 1);
-  lua_pop(L, 1);
+__attribute__((visibility("default"))) // what require looks up, the only export of make_c release-lean
+int
+luaopen_config(
+    lua_State *L)
+{
+#if PERFORMANCE
+  START_PERF_TIME(g_perf_times, Perf_Time_Total);
+
+  g_perf_times[Perf_Time_Path][0] = g_perf_times[Perf_Time_Total][0];
 #endif
+  TRACE_BEGIN("phase", "Total");
+  TRACE_BEGIN("phase", "Path");
 
-  // theme type
-  nvim_set_o(L, "background", nvim_mk_obj_string("light"));
+#if MODE_FORMATTER
+  start_exec_probe(&g_formatter_probe, g_formatter_executables, Formatter_Count);
+#endif
+
+  // the picker matcher, a global for fuzzy_bench.lua
+  MLUA_PUSH_CALLBACK(L, fuzzy_pick_match);
+  lua_setglobal(L, "g_fuzzy_pick_match");
+  MLUA_PUSH_CALLBACK(L, trim_trailing_whitespace);
+  lua_setglobal(L, "g_trim_trailing_whitespace");
+
+  // setup command string creator, useful for temporary strings
+  struct Arena string_arena;
+  ASSERT(L, init_arena(&string_arena, 4096 * 4)); // first block, more are chained on demand
+
+  // RUNTIME
+  g_package_path = stdpaths_user_data_subpath(g_package_dir);
+  g_package_path_len = strlen(g_package_path);
+  ASSERT(L, g_package_path_len > 0);
+
+  // get runtime path
+  char *runtimepath_default_string = runtimepath_default(false);
+  uint runtimepath_default_string_len = strlen(runtimepath_default_string); // WARN: unsafe string length
+  ASSERT(L, runtimepath_default_string_len > 0);
 
-  // highlights
+  // create the new runtimepath
+  uint runtimepath_len = 0;
+  char *runtimepath_str = printf_arena(&string_arena, &runtimepath_len, "%.*s,%.*s",
+      (int)runtimepath_default_string_len, runtimepath_default_string, (int)g_package_path_len, g_package_path);
+  ASSERT(L, runtimepath_str != NULL);
+
+  // set runtimepath
+  nvim_set_o(L, "runtimepath", nvim_mk_obj_string_from_slice(runtimepath_str, runtimepath_len));
+
+  // plugin modules are required out of the bytecode pack, the rest is found through the module index
   {
-    Dict(highlight) hl = {0};
-    PUT_KEY(hl, highlight, bg, nvim_mk_obj_string("#CFCFDA"));
-    nvim_highlight(L, "ColorColumn", hl);
+    char modindex_path[PATH_MAX];
+    char roots[2][PATH_MAX];
+    snprintf(roots[0], sizeof(roots[0]), "%.*spack/deps/opt", (int)g_package_path_len, g_package_path);
+    snprintf(roots[1], sizeof(roots[1]), "%.*spack/deps/start", (int)g_package_path_len, g_package_path);
+    char const *root_ptrs[] = { roots[0], roots[1] };
+    uint64_t modindex_key = config_cache_path(modindex_path, sizeof(modindex_path), g_modindex_file)
+      ? snapshot_hash(SNAPSHOT_FNV_OFFSET, g_package_path, g_package_path_len)
+      : 0;
+    open_module_index(&g_module_index, modindex_path, modindex_key, root_ptrs, STATIC_ARRAY_SIZE(root_ptrs));
+
+    char bytecode_path[PATH_MAX];
+    uint64_t bytecode_key = config_cache_path(bytecode_path, sizeof(bytecode_path), g_bytecode_file)
+      ? config_bytecode_key(L)
+      : 0;
+    open_bytecode_pack(&g_bytecode_pack, bytecode_path, bytecode_key, g_package_path, g_package_path_len);
+    g_bytecode_pack.index = &g_module_index;
+    g_bytecode_pack.on_load = mlua_drop_refs;
+    install_bytecode_pack(L, &g_bytecode_pack);
+    NVIM_MK_AUTOCMD_CALLBACK(L, "VimLeavePre", "Write the bytecode pack", "my-bytecode", true, bytecode_pack_save);
   }
+
+  /* SETUP THE PACKAGE MANAGER */
+  // missing plugins are cloned in the background, the plugin section runs once mini.nvim is there
+  bootstrap_missing_plugins(L);
+
+  TRACE_END();
+#if PERFORMANCE
+  END_PERF_TIME(g_perf_times, Perf_Time_Path);
+
+  g_perf_times[Perf_Time_Opt][0] = g_perf_times[Perf_Time_Path][1];
+#endif
+  TRACE_BEGIN("phase", "Opt");
+
+  /* OPTIONS */
+  nvim_set_g_table(L, g_vars, STATIC_ARRAY_SIZE(g_vars));
+  nvim_set_o_table(L, g_options, STATIC_ARRAY_SIZE(g_options));
+
+  // input formatting
+  nvim_mk_autocmd_command(L, "BufEnter", "Setup format options", "my-formatoptions", true,
+      nvim_mk_string("set formatoptions-=ro"));
+
+  // conceal options (syntax visibility)
+  NVIM_MK_AUTOCMD_CALLBACK(
+      L, "BufEnter", // NOTE: maybe you would put this on another event
+                     // ... but, the once flag is not exposed in my api lol
+      "Disable Conceal on All Buffers", "my-conceallevel", true,
+      disable_conceallevel);
+
+  // picker geometry, here and not in lazy_setup_mini_pick: UIEnter is long gone when mini.pick loads
+  NVIM_MK_AUTOCMD_CALLBACK(L, "VimResized", "Picker window geometry", "my-pick-geometry", true, pick_geometry_update);
+  NVIM_MK_AUTOCMD_CALLBACK(L, "UIEnter", "Picker window geometry", "my-pick-geometry", false, pick_geometry_update);
+
+  // autoread, checktime only for the buffers whose files changed
+  if(init_file_watch(&g_file_watch))
   {
-    Dict(highlight) hl = {0};
-    PUT_KEY(hl, highlight, fg, nvim_mk_obj_string("#D0D1D8"));
-    nvim_highlight(L, "Whitespace", hl);
+    NVIM_MK_AUTOCMD_CALLBACK(L, "BufReadPost", "Watch the file of the buffer", "my-autoread", true, filewatch_on_buf);
+    NVIM_MK_AUTOCMD_CALLBACK(L, "BufWritePost", "Watch the file of the buffer", "my-autoread", false, filewatch_on_buf);
+    NVIM_MK_AUTOCMD_CALLBACK(L, "BufFilePost", "Watch the file of the buffer", "my-autoread", false, filewatch_on_buf);
+    NVIM_MK_AUTOCMD_CALLBACK(L, "BufUnload", "Stop watching the file of the buffer", "my-autoread", false,
+        filewatch_on_unload);
+    NVIM_MK_AUTOCMD_CALLBACK(L, "CmdlineLeave", "Check the files that changed in the command line", "my-autoread", false,
+        filewatch_on_cmdline_leave);
+    filewatch_start(L);
   }
+  else
   {
-    Dict(highlight) hl = {0};
-    PUT_KEY(hl, highlight, italic, true);
-    nvim_highlight(L, "Comment", hl);
+    // no inotify (limits, sandbox), poll like before
+    static char *autoread_events[] =
+    {
+      "BufEnter",
+      "CursorHold",
+      "CursorHoldI",
+      "FocusGained",
+    };
+    ARENA_SCOPE(&string_arena)
+    {
+      char augroup_name_str[] = "my-autoread";
+      char *augroup_name = push_string_arena(&string_arena, augroup_name_str, sizeof(augroup_name_str) - 1);
+      ASSERT(L, augroup_name != NULL);
+
+      for(int i = 0;
+          i < (int)STATIC_ARRAY_SIZE(autoread_events);
+          i += 1)
+      {
+        nvim_mk_autocmd_command(
+            L, autoread_events[i],
+            "Enabled checking if file has been modified", augroup_name, i == 0,
+            nvim_mk_string("if mode() != 'c' | checktime | endif"));
+      }
+    }
   }
 
-#if MODE_FOCUS
-  // disable syntax highlighting
-  lua_getglobal(L, "vim"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "cmd"); ASSERT(L, lua_istable(L, -1));
-  lua_getfield(L, -1, "syntax");
-  lua_pushstring(L, "off");
-  MLUA_PCALL_VOID(L, 1);
-  lua_pop(L, 1);
+  NVIM_MK_AUTOCMD_CALLBACK(L, "VimLeavePre", "Release the caches, watches and threads", "my-teardown", true, config_teardown);
+
+  /* Keymaps */
+  nvim_map_table(L, g_keymaps, STATIC_ARRAY_SIZE(g_keymaps));
+
+  // Highlight when yanking (copying) text
+  nvim_mk_autocmd_command(L, "TextYankPost", "Highlight when yanking text", "my-highlight-yank", true,
+      nvim_mk_string("lua vim.highlight.on_yank({ on_visual = false })"));
+
+  TRACE_END();
+#if PERFORMANCE
+  END_PERF_TIME(g_perf_times, Perf_Time_Opt);
 #endif
 
+  clear_arena(&string_arena);
+
+#if PERFORMANCE
+  START_PERF_TIME(g_perf_times, Perf_Time_Download);
+#endif
+  TRACE_BEGIN("phase", "Download");
+
+  /* Download Packages */
+  if((g_plugin_sources_pending & PLUGIN_SOURCES_EAGER) == 0)
+  {
+    config_plugins(L);
+  }
+
+  TRACE_END();
+  TRACE_END();
 #if PERFORMANCE
-  END_PERF_TIME(perf_times, Perf_Time_Download);
+  END_PERF_TIME(g_perf_times, Perf_Time_Download);
 
-  END_PERF_TIME(perf_times, Perf_Time_Total);
+  END_PERF_TIME(g_perf_times, Perf_Time_Total);
   for(enum Perf_Time i = 0;
       i < (int)STATIC_ARRAY_SIZE(g_perf_time_strings);
       i += 1)
   {
+    int64_t ns = PERF_TIME_NS(g_perf_times, i);
     char out_buf[4096] = {0};
     snprintf(out_buf, sizeof(out_buf),
         "time took: %ld.%09ld; %s\n",
-        perf_times[i][1].tv_sec - perf_times[i][0].tv_sec,
-        perf_times[i][1].tv_nsec - perf_times[i][0].tv_nsec,
+        (long)(ns / 1'000'000'000), (long)(ns % 1'000'000'000),
         g_perf_time_strings[i]);
     lua_getglobal(L, "vim");
     lua_getfield(L, -1, "print");
     lua_pushstring(L, out_buf);
     MLUA_PCALL_VOID(L, 1);
   }
+
+  // the trace also covers whatever runs until the UI is up (deferred plugins, lazy events)
+  NVIM_MK_AUTOCMD_CALLBACK(L, "VimEnter", "Write the startup trace", "my-trace", true, trace_dump);
+
+  lua_getglobal(L, "vim");
+  lua_getfield(L, -1, "api");
+  lua_getfield(L, -1, "nvim_create_user_command");
+  lua_pushstring(L, "ConfigCallbackTimes");
+  lua_pushcfunction(L, perf_callback_report);
+  lua_createtable(L, 0, 1);
+  {
+    MLUA_PUSH_KV(L, "desc") { lua_pushstring(L, "Latency of the config callbacks"); }
+  }
+  MLUA_PCALL(L, 3, 0);
+  lua_pop(L, 2);
 #endif
 
 #if DEBUG
@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <stdint.h>
+#include <time.h>
 
 #if _WIN32
   #include <windows.h>
@@ -49,6 +50,18 @@ Assert(
 #define START_PERF_TIME(g, n) clock_gettime(CLOCK_MONOTONIC, &((g)[n][0]))
 #define END_PERF_TIME(g, n) clock_gettime(CLOCK_MONOTONIC, &((g)[n][1]))
 #define SAME_PERF_TIME(g, n, x) (g)[n][1] = (g)[x][0]
+// nanoseconds, tv_nsec alone can go negative when a second boundary is crossed
+#define PERF_TIME_NS(g, n) \
+  ((int64_t)((g)[n][1].tv_sec - (g)[n][0].tv_sec) * 1'000'000'000 + ((g)[n][1].tv_nsec - (g)[n][0].tv_nsec))
+
+// monotonic, for durations and recheck intervals
+static inline int64_t
+now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1'000'000'000 + t.tv_nsec;
+}
 
 #define Min(x,y) ((x) < (y) ? (x) : (y))
 #define Max(x,y) ((x) > (y) ? (x) : (y))
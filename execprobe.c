@@ -0,0 +1,189 @@
+#ifndef EXECPROBE_C
+#define EXECPROBE_C
+
+// Which of a fixed list of executables are on $PATH, probed on a worker thread.
+// The result is one bit per name, reading it never touches the filesystem. A query at most every
+// EXECPROBE_RECHECK_NS hands the worker the current $PATH: it stats the PATH directories (a binary
+// that is installed or removed changes the mtime of its directory) and only probes every
+// name again when $PATH or one of those mtimes changed. Until that check is done the old bits stay.
+
+#if defined(__linux__)
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* TYPES */
+#define EXECPROBE_NAMES_MAX 64
+#define EXECPROBE_DIRS_MAX 64
+#define EXECPROBE_PATH_MAX 8192
+#define EXECPROBE_RECHECK_NS 2'000'000'000
+
+struct ExecProbe
+{
+  char const *const *names;
+  uint names_len;
+
+  // main thread, only touched while the worker is idle
+  pthread_t thread;
+  bool started;
+  int64_t checked_ns;
+  char next_path[EXECPROBE_PATH_MAX];
+
+  // worker
+  char path[EXECPROBE_PATH_MAX]; // $PATH of the last full probe
+  uint dirs_len;
+  int64_t dirs_mtime[EXECPROBE_DIRS_MAX];
+
+  atomic_bool busy;
+  atomic_bool ready; // the first probe is done
+  _Atomic uint64_t available;
+  atomic_uint probes; // full probes, for the PERFORMANCE report
+};
+
+/* HELPERS */
+// splits path on ':', an empty entry is the current directory
+static inline uint
+execprobe_dirs(
+    char const *path,
+    char (*dirs)[PATH_MAX],
+    uint dirs_max)
+{
+  uint len = 0;
+  for(char const *p = path;
+      len < dirs_max;
+      p += 1)
+  {
+    char const *end = strchr(p, ':');
+    uint dir_len = end == NULL ? strlen(p) : (uint)(end - p);
+    if(dir_len == 0) { memcpy(dirs[len++], ".", 2); }
+    else if(dir_len < PATH_MAX)
+    {
+      memcpy(dirs[len], p, dir_len);
+      dirs[len++][dir_len] = 0;
+    }
+    if(end == NULL) { break; }
+    p = end;
+  }
+  return len;
+}
+
+static void *
+execprobe_worker(
+    void *data)
+{
+  struct ExecProbe *p = data;
+
+  static char dirs[EXECPROBE_DIRS_MAX][PATH_MAX]; // one worker at a time
+  uint dirs_len = execprobe_dirs(p->next_path, dirs, EXECPROBE_DIRS_MAX);
+  int64_t mtimes[EXECPROBE_DIRS_MAX];
+  bool changed = !atomic_load(&p->ready) || strcmp(p->next_path, p->path) != 0 || dirs_len != p->dirs_len;
+  for(uint i = 0;
+      i < dirs_len;
+      i += 1)
+  {
+    mtimes[i] = mtime_ns(dirs[i]);
+    changed = changed || mtimes[i] != p->dirs_mtime[i];
+  }
+
+  if(changed)
+  {
+    uint64_t available = 0;
+    char file[PATH_MAX * 2];
+    for(uint n = 0;
+        n < p->names_len;
+        n += 1)
+    {
+      for(uint i = 0;
+          i < dirs_len;
+          i += 1)
+      {
+        if(mtimes[i] == -1) { continue; }
+        int file_len = snprintf(file, sizeof(file), "%s/%s", dirs[i], p->names[n]);
+        if(file_len <= 0 || file_len >= (int)sizeof(file)) { continue; }
+        struct stat st;
+        if(stat(file, &st) == 0 && S_ISREG(st.st_mode) && access(file, X_OK) == 0)
+        {
+          available |= 1ULL << n;
+          break;
+        }
+      }
+    }
+
+    memcpy(p->path, p->next_path, sizeof(p->path));
+    p->dirs_len = dirs_len;
+    memcpy(p->dirs_mtime, mtimes, dirs_len * sizeof(*mtimes));
+    atomic_store(&p->available, available);
+    atomic_fetch_add(&p->probes, 1);
+  }
+
+  atomic_store(&p->ready, true);
+  atomic_store(&p->busy, false);
+  return NULL;
+}
+
+// main thread, the worker is idle
+static inline bool
+execprobe_spawn(
+    struct ExecProbe *p)
+{
+  if(p->started) { pthread_join(p->thread, NULL); }
+  p->started = false;
+
+  char const *path = getenv("PATH");
+  snprintf(p->next_path, sizeof(p->next_path), "%s", path != NULL ? path : "");
+  p->checked_ns = now_ns();
+
+  atomic_store(&p->busy, true);
+  if(pthread_create(&p->thread, NULL, execprobe_worker, p) != 0)
+  {
+    execprobe_worker(p); // no thread, probe inline
+    return false;
+  }
+  p->started = true;
+  return true;
+}
+
+/* API */
+// names must outlive the probe, the first probe starts right away
+static inline void
+start_exec_probe(
+    struct ExecProbe *restrict p,
+    char const *const *restrict names,
+    uint names_len)
+{
+  memset(p, 0, sizeof(*p));
+  p->names = names;
+  p->names_len = Min(names_len, EXECPROBE_NAMES_MAX);
+  execprobe_spawn(p);
+}
+
+// bit i is names[i]; O(1) unless the first probe is still running, then it waits for it
+static inline uint64_t
+exec_probe_available(
+    struct ExecProbe *p)
+{
+  if(!atomic_load(&p->ready) && p->started)
+  {
+    pthread_join(p->thread, NULL);
+    p->started = false;
+  }
+
+  if(!atomic_load(&p->busy) && now_ns() - p->checked_ns > EXECPROBE_RECHECK_NS)
+  {
+    execprobe_spawn(p);
+  }
+  return atomic_load(&p->available);
+}
+
+static inline void
+stop_exec_probe(
+    struct ExecProbe *p)
+{
+  if(p->started) { pthread_join(p->thread, NULL); }
+  p->started = false;
+}
+#endif
+
+#endif // EXECPROBE_C
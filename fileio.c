@@ -1,11 +1,53 @@
 #ifndef FILEIO_C
 #define FILEIO_C
 
+// File access without copying into the heap.
+// A view maps the whole file read-only, for files that are read as a whole (snapshots, packs).
+// A reader streams a file through a caller owned buffer, for big or unbounded files read once.
+// NOTE: a view of a file that is truncated behind our back faults (SIGBUS), only map files
+// that are replaced by rename (everything this config writes) or owned by someone careful (git)
+
 #if defined(__linux__)
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+/* TYPES */
+#define FILEIO_ADVICE_LIST \
+  FILEIO_ADVICE_X(Normal) \
+  FILEIO_ADVICE_X(Sequential) \
+  FILEIO_ADVICE_X(Random) \
+  FILEIO_ADVICE_X(WillNeed)
+
+enum Fileio_Advice : int
+{
+#define FILEIO_ADVICE_X(n) Fileio_Advice_##n,
+  FILEIO_ADVICE_LIST
+#undef FILEIO_ADVICE_X
+  Fileio_Advice_Count,
+};
+
+struct FileView
+{
+  char const *data; // "" for an empty file
+  size_t len;
+  void *map;
+  size_t map_len;
+};
+
+struct FileReader
+{
+  int fd;
+  bool eof;
+  char *buffer;
+  uint capacity;
+  uint start; // unconsumed bytes are buffer[start, end)
+  uint end;
+};
+
+/* HELPERS */
 static inline long
 get_file_size(
     int fd)
@@ -16,21 +58,209 @@ get_file_size(
   return stat_buf.st_size;
 }
 
+// -1 when path does not exist
+static inline int64_t
+mtime_ns(
+    char const *path)
+{
+  struct stat st;
+  if(stat(path, &st) == -1) { return -1; }
+  return (int64_t)st.st_mtim.tv_sec * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+static inline void
+fileio_fadvise(
+    int fd,
+    enum Fileio_Advice advice)
+{
+  static int const advices[] = {
+    [Fileio_Advice_Normal] = POSIX_FADV_NORMAL,
+    [Fileio_Advice_Sequential] = POSIX_FADV_SEQUENTIAL,
+    [Fileio_Advice_Random] = POSIX_FADV_RANDOM,
+    [Fileio_Advice_WillNeed] = POSIX_FADV_WILLNEED,
+  };
+  if(advice != Fileio_Advice_Normal) { posix_fadvise(fd, 0, 0, advices[advice]); }
+}
+
+static inline void
+fileio_madvise(
+    void *map,
+    size_t map_len,
+    enum Fileio_Advice advice)
+{
+  static int const advices[] = {
+    [Fileio_Advice_Normal] = MADV_NORMAL,
+    [Fileio_Advice_Sequential] = MADV_SEQUENTIAL,
+    [Fileio_Advice_Random] = MADV_RANDOM,
+    [Fileio_Advice_WillNeed] = MADV_WILLNEED,
+  };
+  if(advice != Fileio_Advice_Normal) { madvise(map, map_len, advices[advice]); }
+}
+
+/* API */
+// whole file into a malloc'd buffer, prefer a view
 static inline long
 read_entire_file(
     char const *filename,
     char **out_buf)
 {
-  int fd = open(filename, O_RDONLY);
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd == -1) { return -1; }
   long file_size;
-  if((file_size = get_file_size(fd)) == -1) { return -1; }
+  if((file_size = get_file_size(fd)) == -1) { close(fd); return -1; }
 
-  *out_buf = malloc(file_size);
-  if(*out_buf == NULL) { return -1; }
+  *out_buf = malloc(Max(file_size, 1));
+  if(*out_buf == NULL) { close(fd); return -1; }
 
-  if(read(fd, *out_buf, file_size) != file_size) { free(*out_buf); return -1; }
+  long len = 0;
+  while(len < file_size)
+  {
+    ssize_t n = read(fd, *out_buf + len, file_size - len);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n <= 0) { break; } // shrunk under us, return what is there
+    len += n;
+  }
+  close(fd);
+
+  if(len == 0 && file_size > 0) { free(*out_buf); *out_buf = NULL; return -1; }
+  return len;
+}
+
+// a file that fits, nul terminated; returns the length or -1
+static inline int
+read_small_file(
+    char const *restrict path,
+    char *restrict buf,
+    uint buf_cap)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == -1) { return -1; }
+  ssize_t len;
+  do { len = read(fd, buf, buf_cap - 1); } while(len == -1 && errno == EINTR);
+  close(fd);
+  if(len < 0) { return -1; }
+  buf[len] = 0;
+  return len;
+}
+
+// read-only view of the whole file, WillNeed also faults it in up front
+static inline uint
+open_file_view(
+    struct FileView *restrict view,
+    char const *restrict path,
+    enum Fileio_Advice advice)
+{
+  memset(view, 0, sizeof(*view));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == -1) { return 0; }
+  long file_size = get_file_size(fd);
+  if(file_size <= 0)
+  {
+    close(fd);
+    view->data = "";
+    return file_size == 0;
+  }
+
+  int flags = MAP_PRIVATE | (advice == Fileio_Advice_WillNeed ? MAP_POPULATE : 0);
+  void *map = mmap(NULL, file_size, PROT_READ, flags, fd, 0);
+  close(fd); // the mapping keeps the file
+  if(map == MAP_FAILED) { return 0; }
+  if(advice != Fileio_Advice_WillNeed) { fileio_madvise(map, file_size, advice); }
+
+  view->data = map;
+  view->len = file_size;
+  view->map = map;
+  view->map_len = file_size;
+  return 1;
+}
+
+static inline void
+close_file_view(
+    struct FileView *view)
+{
+  if(view->map != NULL) { munmap(view->map, view->map_len); }
+  memset(view, 0, sizeof(*view));
+}
+
+// buffer is the caller's, a line never grows past it
+static inline uint
+open_file_reader(
+    struct FileReader *restrict r,
+    char const *restrict path,
+    char *restrict buffer,
+    uint capacity,
+    enum Fileio_Advice advice)
+{
+  *r = (struct FileReader){ .fd = open(path, O_RDONLY | O_CLOEXEC), .buffer = buffer, .capacity = capacity };
+  if(r->fd == -1) { return 0; }
+  fileio_fadvise(r->fd, advice);
+  return 1;
+}
+
+static inline void
+close_file_reader(
+    struct FileReader *r)
+{
+  if(r->fd != -1) { close(r->fd); }
+  r->fd = -1;
+}
+
+// moves the unconsumed tail to the front and reads behind it; returns the bytes read, 0 at eof or error
+static inline uint
+fill_file_reader(
+    struct FileReader *r)
+{
+  if(r->eof) { return 0; }
+  if(r->start > 0)
+  {
+    memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->start = 0;
+  }
+  if(r->end == r->capacity) { return 0; }
+
+  ssize_t n;
+  do { n = read(r->fd, r->buffer + r->end, r->capacity - r->end); } while(n == -1 && errno == EINTR);
+  if(n <= 0)
+  {
+    r->eof = true;
+    return 0;
+  }
+  r->end += n;
+  return n;
+}
+
+// next line without its '\n', valid until the next call; a line longer than the buffer comes in pieces
+static inline bool
+read_line_file_reader(
+    struct FileReader *restrict r,
+    char const **restrict line,
+    uint *restrict line_len)
+{
+  for(;;)
+  {
+    char *begin = r->buffer + r->start;
+    char *nl = memchr(begin, '\n', r->end - r->start);
+    if(nl != NULL)
+    {
+      *line = begin;
+      *line_len = nl - begin;
+      r->start += *line_len + 1;
+      return true;
+    }
 
-  return file_size;
+    bool full = r->start == 0 && r->end == r->capacity;
+    if(full || fill_file_reader(r) == 0)
+    {
+      if(r->start == r->end) { return false; }
+      // last line without a '\n', or a piece of an overlong line
+      *line = r->buffer + r->start;
+      *line_len = r->end - r->start;
+      r->start = r->end;
+      return true;
+    }
+  }
 }
 #endif
 
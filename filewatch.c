@@ -0,0 +1,192 @@
+#ifndef FILEWATCH_C
+#define FILEWATCH_C
+
+// Buffers whose files changed on disk, from one inotify fd instead of polling with stat.
+// Every buffer watches its own file, buffers of the same file share the watch (inotify hands out one
+// wd per inode). A file replaced by rename (most editors and git) drops the watch of the old inode,
+// that buffer is reported and the caller watches its path again after checking it.
+// IN_MODIFY covers writers that keep the file open (logs, appends), a burst of them marks the buffer once.
+// The fd is nonblocking, the caller polls it for reading in its event loop.
+
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* TYPES */
+#define FILEWATCH_MAX 1024
+#define FILEWATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define FILEWATCH_READ_SIZE 4096
+
+struct FileWatchEntry
+{
+  int wd; // -1 once inotify dropped it
+  int buf;
+};
+
+struct FileWatch
+{
+  int fd;
+  uint entries_len;
+  struct FileWatchEntry entries[FILEWATCH_MAX];
+
+  // changed buffers, not yet taken by the caller
+  uint changed_len;
+  int changed[FILEWATCH_MAX];
+
+  uint events; // for the PERFORMANCE report
+};
+
+/* HELPERS */
+static inline int
+filewatch_find(
+    struct FileWatch const *w,
+    int buf)
+{
+  for(uint i = 0;
+      i < w->entries_len;
+      i += 1)
+  {
+    if(w->entries[i].buf == buf) { return i; }
+  }
+  return -1;
+}
+
+static inline bool
+filewatch_wd_used(
+    struct FileWatch const *w,
+    int wd)
+{
+  for(uint i = 0;
+      i < w->entries_len;
+      i += 1)
+  {
+    if(w->entries[i].wd == wd) { return true; }
+  }
+  return false;
+}
+
+static inline void
+filewatch_mark(
+    struct FileWatch *w,
+    int buf)
+{
+  for(uint i = 0;
+      i < w->changed_len;
+      i += 1)
+  {
+    if(w->changed[i] == buf) { return; }
+  }
+  if(w->changed_len < FILEWATCH_MAX) { w->changed[w->changed_len++] = buf; }
+}
+
+/* API */
+static inline uint
+init_file_watch(
+    struct FileWatch *w)
+{
+  w->entries_len = 0;
+  w->changed_len = 0;
+  w->events = 0;
+  w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  return w->fd != -1;
+}
+
+static inline void
+deinit_file_watch(
+    struct FileWatch *w)
+{
+  if(w->fd != -1) { close(w->fd); } // drops every watch
+  w->fd = -1;
+  w->entries_len = 0;
+  w->changed_len = 0;
+}
+
+static inline void
+unwatch_file(
+    struct FileWatch *w,
+    int buf)
+{
+  int i = filewatch_find(w, buf);
+  if(i == -1) { return; }
+
+  int wd = w->entries[i].wd;
+  w->entries[i] = w->entries[--w->entries_len];
+  if(wd != -1 && !filewatch_wd_used(w, wd)) { inotify_rm_watch(w->fd, wd); }
+}
+
+// (re)watches the file of buf, false for a path that is not a file (yet) or too many watches
+static inline bool
+watch_file(
+    struct FileWatch *restrict w,
+    int buf,
+    char const *restrict path)
+{
+  unwatch_file(w, buf);
+  if(w->fd == -1 || path[0] != '/' || w->entries_len == FILEWATCH_MAX) { return false; }
+
+  int wd = inotify_add_watch(w->fd, path, FILEWATCH_MASK);
+  if(wd == -1) { return false; }
+  w->entries[w->entries_len++] = (struct FileWatchEntry){ .wd = wd, .buf = buf };
+  return true;
+}
+
+// drains the fd into the changed buffers, returns how many are pending
+static inline uint
+read_file_watch(
+    struct FileWatch *w)
+{
+  alignas(struct inotify_event) char buffer[FILEWATCH_READ_SIZE];
+  for(;;)
+  {
+    ssize_t n = read(w->fd, buffer, sizeof(buffer));
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n <= 0) { break; } // EAGAIN, drained
+
+    for(char *p = buffer;
+        p < buffer + n;
+        p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+    {
+      struct inotify_event const *e = (struct inotify_event const *)p;
+      w->events += 1;
+      if(e->mask & IN_Q_OVERFLOW)
+      {
+        // lost events, every buffer may have changed
+        for(uint i = 0;
+            i < w->entries_len;
+            i += 1)
+        {
+          filewatch_mark(w, w->entries[i].buf);
+        }
+        continue;
+      }
+
+      for(uint i = 0;
+          i < w->entries_len;
+          i += 1)
+      {
+        if(w->entries[i].wd != e->wd) { continue; }
+        if(e->mask & IN_IGNORED) { w->entries[i].wd = -1; }
+        filewatch_mark(w, w->entries[i].buf);
+      }
+    }
+  }
+  return w->changed_len;
+}
+
+// hands out the changed buffers and forgets them
+static inline uint
+take_file_watch(
+    struct FileWatch *restrict w,
+    int *restrict bufs,
+    uint bufs_cap)
+{
+  uint len = Min(w->changed_len, bufs_cap);
+  memcpy(bufs, w->changed, len * sizeof(*bufs));
+  memmove(w->changed, w->changed + len, (w->changed_len - len) * sizeof(*bufs));
+  w->changed_len -= len;
+  return len;
+}
+#endif
+
+#endif // FILEWATCH_C
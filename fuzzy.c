@@ -0,0 +1,426 @@
+#ifndef FUZZY_C
+#define FUZZY_C
+
+// Fuzzy matching for the picker: a query matches an item when its bytes appear in it in order.
+// Filter: each query byte is found with a 32 byte vector compare (case folded for ascii), an item
+// that runs out of bytes is rejected before any scoring.
+// Score: fzf v1, the forward match is shrunk backwards to the shortest window that still holds the
+// query, matches score more after a boundary (/ _ - . space), on a camelCase hump and in a row,
+// gaps cost. Results are sorted by score, then the shorter item, then the candidate order.
+// Long candidate lists are split over worker threads, each one filters, scores and sorts its
+// slice, the sorted slices are merged at the end.
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <unistd.h>
+
+/* TYPES */
+#define FUZZY_QUERY_MAX 128
+#define FUZZY_THREADS_MAX 8
+#define FUZZY_PARALLEL_MIN 16'384 // per thread, below this a thread costs more than it saves
+#define FUZZY_PAGE_SIZE 4096 // the smallest page, for reads past the end of an item
+
+#define FUZZY_SCORE_MATCH 16
+#define FUZZY_SCORE_GAP_START -3
+#define FUZZY_SCORE_GAP_EXTENSION -1
+#define FUZZY_BONUS_BOUNDARY 8
+#define FUZZY_BONUS_CAMEL 7
+#define FUZZY_BONUS_CONSECUTIVE 4
+#define FUZZY_BONUS_FIRST_MULTIPLIER 2
+
+typedef uint8_t FuzzyVec __attribute__((vector_size(32), aligned(1)));
+typedef uint64_t FuzzyLanes __attribute__((vector_size(32), aligned(1)));
+
+struct FuzzyItem
+{
+  char const *str;
+  uint len;
+};
+
+struct FuzzyMatch
+{
+  uint idx; // candidate
+  uint len; // of the item, shorter wins a tie
+  int score;
+};
+
+struct FuzzyQuery
+{
+  uint8_t chars[FUZZY_QUERY_MAX];
+  uint len;
+  bool fold; // smart case, a query without upper case matches either case
+};
+
+struct FuzzyJob
+{
+  struct FuzzyQuery const *query;
+  struct FuzzyItem const *items;
+  uint const *cands;
+  uint cands_len;
+  struct FuzzyMatch *matches; // this job's slice of the output
+  uint matches_len;
+  pthread_t thread;
+};
+
+/* HELPERS */
+static inline uint8_t
+fuzzy_fold(
+    uint8_t c)
+{
+  return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+// first position >= from of c in s[0, len), -1 when there is none
+static inline int
+fuzzy_find(
+    uint8_t const *s,
+    uint from,
+    uint len,
+    uint8_t c,
+    bool fold)
+{
+  uint i = from;
+  FuzzyVec needle = (FuzzyVec){0} + c;
+  for(;
+      i + sizeof(FuzzyVec) <= len;
+      i += sizeof(FuzzyVec))
+  {
+    FuzzyVec x;
+    memcpy(&x, s + i, sizeof(x));
+    if(fold) { x |= (FuzzyVec)((x >= 'A') & (x <= 'Z')) & 0x20; }
+    FuzzyLanes eq = (FuzzyLanes)(x == needle);
+    for(uint lane = 0;
+        lane < 4;
+        lane += 1)
+    {
+      if(eq[lane] != 0) { return i + lane * 8 + __builtin_ctzll(eq[lane]) / 8; }
+    }
+  }
+  if(i >= len) { return -1; }
+
+  // the tail: a load that stays inside the page cannot fault, bytes past len are ignored
+  if(((uintptr_t)(s + i) & (FUZZY_PAGE_SIZE - 1)) <= FUZZY_PAGE_SIZE - sizeof(FuzzyVec))
+  {
+    FuzzyVec x;
+    memcpy(&x, s + i, sizeof(x));
+    if(fold) { x |= (FuzzyVec)((x >= 'A') & (x <= 'Z')) & 0x20; }
+    FuzzyLanes eq = (FuzzyLanes)(x == needle);
+    for(uint lane = 0;
+        lane < 4;
+        lane += 1)
+    {
+      if(eq[lane] == 0) { continue; }
+      uint at = lane * 8 + __builtin_ctzll(eq[lane]) / 8;
+      return at < len - i ? (int)(i + at) : -1;
+    }
+    return -1;
+  }
+  for(;
+      i < len;
+      i += 1)
+  {
+    if((fold ? fuzzy_fold(s[i]) : s[i]) == c) { return i; }
+  }
+  return -1;
+}
+
+static inline int
+fuzzy_bonus(
+    uint8_t const *s,
+    uint i)
+{
+  if(i == 0) { return FUZZY_BONUS_BOUNDARY; }
+  uint8_t prev = s[i - 1];
+  if(prev == '/' || prev == '_' || prev == '-' || prev == '.' || prev == ' ') { return FUZZY_BONUS_BOUNDARY; }
+  if(prev >= 'a' && prev <= 'z' && s[i] >= 'A' && s[i] <= 'Z') { return FUZZY_BONUS_CAMEL; }
+  return 0;
+}
+
+static inline int
+fuzzy_compare(
+    void const *a_,
+    void const *b_)
+{
+  struct FuzzyMatch const *a = a_, *b = b_;
+  if(a->score != b->score) { return a->score > b->score ? -1 : 1; }
+  if(a->len != b->len) { return a->len < b->len ? -1 : 1; }
+  return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+// the sort key: higher score first, then shorter, 20 + 12 bits
+static inline uint32_t
+fuzzy_key(
+    struct FuzzyMatch const *m)
+{
+  int score = Max(Min(m->score, (1 << 19) - 1), -(1 << 19));
+  return (uint32_t)((1 << 19) - 1 - score) << 12 | Min(m->len, 4095u);
+}
+
+// stable lsd radix sort on fuzzy_key, the candidate order breaks the rest of the ties
+static inline void
+fuzzy_sort(
+    struct FuzzyMatch *matches,
+    uint len)
+{
+  if(len < 64) { qsort(matches, len, sizeof(*matches), fuzzy_compare); return; }
+
+  struct FuzzyMatch *tmp = malloc(len * sizeof(*tmp));
+  if(tmp == NULL) { qsort(matches, len, sizeof(*matches), fuzzy_compare); return; }
+
+  struct FuzzyMatch *from = matches, *to = tmp;
+  for(uint shift = 0;
+      shift < 32;
+      shift += 8)
+  {
+    uint counts[256] = {0};
+    for(uint i = 0;
+        i < len;
+        i += 1)
+    {
+      counts[(fuzzy_key(&from[i]) >> shift) & 0xff] += 1;
+    }
+    if(counts[(fuzzy_key(&from[0]) >> shift) & 0xff] == len) { continue; } // one bucket, nothing moves
+
+    uint offset = 0;
+    for(uint b = 0;
+        b < 256;
+        b += 1)
+    {
+      uint n = counts[b];
+      counts[b] = offset;
+      offset += n;
+    }
+    for(uint i = 0;
+        i < len;
+        i += 1)
+    {
+      to[counts[(fuzzy_key(&from[i]) >> shift) & 0xff]++] = from[i];
+    }
+    struct FuzzyMatch *swap = from; from = to; to = swap;
+  }
+  if(from != matches) { memcpy(matches, from, len * sizeof(*matches)); }
+  free(tmp);
+}
+
+/* API */
+// false when the query is too long for the matcher
+static inline bool
+init_fuzzy_query(
+    struct FuzzyQuery *restrict q,
+    char const *restrict query,
+    uint query_len)
+{
+  if(query_len > FUZZY_QUERY_MAX) { return false; }
+  q->len = query_len;
+  q->fold = true;
+  for(uint i = 0;
+      i < query_len;
+      i += 1)
+  {
+    if(query[i] >= 'A' && query[i] <= 'Z') { q->fold = false; }
+  }
+  for(uint i = 0;
+      i < query_len;
+      i += 1)
+  {
+    q->chars[i] = q->fold ? fuzzy_fold(query[i]) : (uint8_t)query[i];
+  }
+  return true;
+}
+
+// false when str does not hold the query in order
+static inline bool
+fuzzy_score(
+    struct FuzzyQuery const *restrict q,
+    char const *restrict str,
+    uint len,
+    int *restrict score)
+{
+  uint8_t const *s = (uint8_t const *)str;
+  if(q->len == 0) { *score = 0; return true; }
+
+  // forward: the earliest end of a match
+  int end = -1;
+  for(uint i = 0;
+      i < q->len;
+      i += 1)
+  {
+    end = fuzzy_find(s, end + 1, len, q->chars[i], q->fold);
+    if(end == -1) { return false; }
+  }
+
+  // backward: the latest start that still ends there
+  int start = end;
+  for(int i = q->len - 1;
+      i >= 0;
+      start -= 1)
+  {
+    if((q->fold ? fuzzy_fold(s[start]) : s[start]) == q->chars[i]) { i -= 1; }
+  }
+  start += 1;
+
+  int total = 0;
+  int first_bonus = 0;
+  uint consecutive = 0;
+  bool in_gap = false;
+  uint qi = 0;
+  for(int i = start;
+      i <= end;
+      i += 1)
+  {
+    uint8_t c = q->fold ? fuzzy_fold(s[i]) : s[i];
+    if(qi < q->len && c == q->chars[qi])
+    {
+      int bonus = fuzzy_bonus(s, i);
+      if(consecutive == 0) { first_bonus = bonus; }
+      else
+      {
+        if(bonus >= FUZZY_BONUS_BOUNDARY && bonus > first_bonus) { first_bonus = bonus; }
+        bonus = Max(Max(bonus, first_bonus), FUZZY_BONUS_CONSECUTIVE);
+      }
+      total += FUZZY_SCORE_MATCH + (qi == 0 ? bonus * FUZZY_BONUS_FIRST_MULTIPLIER : bonus);
+      in_gap = false;
+      consecutive += 1;
+      qi += 1;
+    }
+    else
+    {
+      total += in_gap ? FUZZY_SCORE_GAP_EXTENSION : FUZZY_SCORE_GAP_START;
+      in_gap = true;
+      consecutive = 0;
+      first_bonus = 0;
+    }
+  }
+  *score = total;
+  return true;
+}
+
+// one slice: filter, score, sort
+static void *
+fuzzy_worker(
+    void *data)
+{
+  struct FuzzyJob *job = data;
+  job->matches_len = 0;
+  for(uint i = 0;
+      i < job->cands_len;
+      i += 1)
+  {
+    struct FuzzyItem item = job->items[job->cands[i]];
+    int score;
+    if(!fuzzy_score(job->query, item.str, item.len, &score)) { continue; }
+    job->matches[job->matches_len++] = (struct FuzzyMatch){ .idx = i, .len = item.len, .score = score };
+  }
+  fuzzy_sort(job->matches, job->matches_len);
+  return NULL;
+}
+
+// matches holds cands_len, returns how many matched; matches[i].idx is an index into cands
+// threads 0 picks by the number of candidates and cpus
+static inline uint
+fuzzy_match(
+    struct FuzzyQuery const *restrict q,
+    struct FuzzyItem const *restrict items,
+    uint const *restrict cands,
+    uint cands_len,
+    struct FuzzyMatch *restrict matches,
+    uint threads)
+{
+  if(threads == 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = Min((uint)Max(cpus, 1), cands_len / FUZZY_PARALLEL_MIN);
+  }
+  threads = Max(Min(threads, FUZZY_THREADS_MAX), 1);
+
+  struct FuzzyJob jobs[FUZZY_THREADS_MAX];
+  uint slice = (cands_len + threads - 1) / threads;
+  for(uint t = 0;
+      t < threads;
+      t += 1)
+  {
+    uint from = Min(t * slice, cands_len);
+    jobs[t] = (struct FuzzyJob){
+      .query = q, .items = items, .cands = cands + from,
+      .cands_len = Min(slice, cands_len - from), .matches = matches + from,
+    };
+  }
+
+  // the calling thread takes the first slice
+  bool spawned[FUZZY_THREADS_MAX] = {0};
+  for(uint t = 1;
+      t < threads;
+      t += 1)
+  {
+    spawned[t] = pthread_create(&jobs[t].thread, NULL, fuzzy_worker, &jobs[t]) == 0;
+  }
+  fuzzy_worker(&jobs[0]);
+  for(uint t = 1;
+      t < threads;
+      t += 1)
+  {
+    if(spawned[t]) { pthread_join(jobs[t].thread, NULL); }
+    else { fuzzy_worker(&jobs[t]); }
+  }
+
+  // the slice indices are relative to their slice
+  for(uint t = 1;
+      t < threads;
+      t += 1)
+  {
+    uint from = jobs[t].cands - cands;
+    for(uint i = 0;
+        i < jobs[t].matches_len;
+        i += 1)
+    {
+      jobs[t].matches[i].idx += from;
+    }
+  }
+  if(threads == 1) { return jobs[0].matches_len; }
+
+  // merge the sorted slices, a k-way pick is fine for a handful of them
+  uint total = 0;
+  for(uint t = 0;
+      t < threads;
+      t += 1)
+  {
+    total += jobs[t].matches_len;
+  }
+  struct FuzzyMatch *merged = malloc(Max(total, 1) * sizeof(*merged));
+  if(merged == NULL)
+  {
+    // sort the whole thing in place instead, the slices are packed first
+    uint len = jobs[0].matches_len;
+    for(uint t = 1;
+        t < threads;
+        t += 1)
+    {
+      memmove(matches + len, jobs[t].matches, jobs[t].matches_len * sizeof(*matches));
+      len += jobs[t].matches_len;
+    }
+    qsort(matches, len, sizeof(*matches), fuzzy_compare);
+    return len;
+  }
+
+  uint heads[FUZZY_THREADS_MAX] = {0};
+  for(uint i = 0;
+      i < total;
+      i += 1)
+  {
+    int best = -1;
+    for(uint t = 0;
+        t < threads;
+        t += 1)
+    {
+      if(heads[t] == jobs[t].matches_len) { continue; }
+      if(best == -1 || fuzzy_compare(&jobs[t].matches[heads[t]], &jobs[best].matches[heads[best]]) < 0) { best = t; }
+    }
+    merged[i] = jobs[best].matches[heads[best]++];
+  }
+  memcpy(matches, merged, total * sizeof(*matches));
+  free(merged);
+  return total;
+}
+#endif
+
+#endif // FUZZY_C
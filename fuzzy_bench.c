@@ -0,0 +1,128 @@
+// Benchmark of fuzzy.c on generated paths, single threaded and split over the cpus.
+// Not part of config.so, build and run it by hand:
+//   gcc -std=c23 -O3 -march=native -pthread fuzzy_bench.c -o fuzzy_bench && ./fuzzy_bench
+// The comparison against mini.pick's lua matcher runs inside nvim, see fuzzy_bench.lua.
+
+#define _GNU_SOURCE // clock_gettime under -std=c23
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int uint;
+#define Min(x,y) ((x) < (y) ? (x) : (y))
+#define Max(x,y) ((x) > (y) ? (x) : (y))
+#define STATIC_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+#include "fuzzy.c"
+
+/* TYPES */
+#define BENCH_PATH_MAX 96
+
+/* HELPERS */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_nsec;
+}
+
+static char const *g_parts[] =
+{
+  "src", "lib", "test", "internal", "vendor", "pkg", "cmd", "api", "core", "util",
+  "render", "network", "storage", "config", "parser", "server", "client", "build",
+};
+
+static char const *g_exts[] = { ".c", ".h", ".lua", ".go", ".ts", ".rs", ".md", ".json" };
+
+// monorepo-ish paths, the same seed every run
+static char *
+bench_paths(
+    struct FuzzyItem *items,
+    uint len)
+{
+  char *buf = malloc((size_t)len * BENCH_PATH_MAX);
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  for(uint i = 0;
+      i < len;
+      i += 1)
+  {
+    char *p = buf + (size_t)i * BENCH_PATH_MAX;
+    uint n = 0;
+    uint depth = 2 + seed % 5;
+    for(uint d = 0;
+        d < depth;
+        d += 1)
+    {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      n += snprintf(p + n, BENCH_PATH_MAX - n, "%s/", g_parts[(seed >> 33) % STATIC_ARRAY_SIZE(g_parts)]);
+    }
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    n += snprintf(p + n, BENCH_PATH_MAX - n, "file_%u%s", (uint)(seed >> 40) % 10'000,
+        g_exts[(seed >> 20) % STATIC_ARRAY_SIZE(g_exts)]);
+    items[i] = (struct FuzzyItem){ p, Min(n, BENCH_PATH_MAX - 1) };
+  }
+  return buf;
+}
+
+static void
+bench_query(
+    struct FuzzyItem const *items,
+    uint *cands,
+    struct FuzzyMatch *matches,
+    uint len,
+    char const *query)
+{
+  struct FuzzyQuery q;
+  init_fuzzy_query(&q, query, strlen(query));
+  for(uint i = 0;
+      i < len;
+      i += 1)
+  {
+    cands[i] = i;
+  }
+
+  uint64_t t0 = bench_now_ns();
+  uint single = fuzzy_match(&q, items, cands, len, matches, 1);
+  uint64_t t1 = bench_now_ns();
+  uint parallel = fuzzy_match(&q, items, cands, len, matches, 0);
+  uint64_t t2 = bench_now_ns();
+
+  printf("%8u items  %-12s %8u matches  1 thread %8.2f ms  auto %8.2f ms%s\n",
+      len, query, single, (double)(t1 - t0) / 1e6, (double)(t2 - t1) / 1e6,
+      single == parallel ? "" : "  MISMATCH");
+}
+
+int
+main(void)
+{
+  static uint const sizes[] = { 10'000, 100'000, 1'000'000 };
+  static char const *queries[] = { "s", "srcfile", "rndrcfg", "zzzz" };
+
+  uint max = sizes[STATIC_ARRAY_SIZE(sizes) - 1];
+  struct FuzzyItem *items = malloc(max * sizeof(*items));
+  uint *cands = malloc(max * sizeof(*cands));
+  struct FuzzyMatch *matches = malloc(max * sizeof(*matches));
+  char *buf = bench_paths(items, max);
+
+  for(uint s = 0;
+      s < STATIC_ARRAY_SIZE(sizes);
+      s += 1)
+  {
+    for(uint q = 0;
+        q < STATIC_ARRAY_SIZE(queries);
+        q += 1)
+    {
+      bench_query(items, cands, matches, sizes[s], queries[q]);
+    }
+  }
+
+  free(buf);
+  free(matches);
+  free(cands);
+  free(items);
+  return 0;
+}
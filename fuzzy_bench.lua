@@ -0,0 +1,68 @@
+-- Benchmark of the native picker matcher (fuzzy.c) against mini.pick's lua matcher.
+-- Runs inside nvim with config.so loaded:
+--   nvim --headless -c 'luafile fuzzy_bench.lua' -c 'qa!'
+-- The pure C numbers (no lua tables) come from fuzzy_bench.c.
+
+local native = _G.g_fuzzy_pick_match
+assert(native ~= nil, "config.so is not loaded")
+local MiniPick = require('mini.pick')
+if MiniPick.config == nil then MiniPick.setup({}) end
+
+local parts = {
+  "src", "lib", "test", "internal", "vendor", "pkg", "cmd", "api", "core", "util",
+  "render", "network", "storage", "config", "parser", "server", "client", "build",
+}
+local exts = { ".c", ".h", ".lua", ".go", ".ts", ".rs", ".md", ".json" }
+
+-- the same shape of paths as fuzzy_bench.c, not the same paths
+local function paths(n)
+  local out = {}
+  math.randomseed(1)
+  for i = 1, n do
+    local p = {}
+    for d = 1, math.random(2, 6) do p[d] = parts[math.random(#parts)] end
+    out[i] = table.concat(p, "/") .. "/file_" .. math.random(0, 9999) .. exts[math.random(#exts)]
+  end
+  return out
+end
+
+local function seq(n)
+  local out = {}
+  for i = 1, n do out[i] = i end
+  return out
+end
+
+local function chars(s)
+  local out = {}
+  for c in s:gmatch(".") do out[#out + 1] = c end
+  return out
+end
+
+local function time(f)
+  local t = vim.uv.hrtime()
+  local r = f()
+  return (vim.uv.hrtime() - t) / 1e6, r
+end
+
+for _, n in ipairs({ 10000, 100000, 1000000 }) do
+  local stritems = paths(n)
+  for _, query in ipairs({ "s", "srcfile", "rndrcfg", "zzzz" }) do
+    local q = chars(query)
+    local lua_ms, lua_r = time(function() return MiniPick.default_match(stritems, seq(n), q, { sync = true }) end)
+    local cold_ms, c_r = time(function() return native(stritems, seq(n), q) end)
+    local warm_ms = time(function() return native(stritems, seq(n), q) end)
+    print(string.format("%8d items  %-8s  lua %6d matches %9.2f ms  native %6d matches %9.2f ms cold %9.2f ms warm",
+      n, query, #(lua_r or {}), lua_ms, #c_r, cold_ms, warm_ms))
+  end
+end
+
+-- typing: every keystroke narrows the last result, like the picker does
+local stritems = paths(1000000)
+local inds = seq(#stritems)
+local q = {}
+for c in ("srcfile"):gmatch(".") do
+  q[#q + 1] = c
+  local ms
+  ms, inds = time(function() return native(stritems, inds, q) end)
+  print(string.format("keystroke %-8s %7d matches %8.2f ms", table.concat(q), #inds, ms))
+end
@@ -0,0 +1,734 @@
+#ifndef GREP_C
+#define GREP_C
+
+// Live grep over the files of walk.c, on a pool of threads that stays up while the picker is open.
+// The file list is walked once (`rg` rules: no hidden entries, ignore files) and grows while the
+// first searches already run. A search is a generation: a new pattern bumps it, the threads drop
+// the old one at the next file or line, results of an old generation are never handed out.
+// A pattern is a POSIX extended regex (\d and \D added), the longest literal it cannot match
+// without is searched first with SIMD, the regex only runs on the lines that have it.
+// A pattern that does not compile (half typed) is searched as a literal.
+// Results are mini.pick grep items, "path\0lnum\0col\0text", col is the byte of the first match.
+// Files are read (never mapped) in chunks of whole lines through the thread's buffer: a file
+// truncated while it is searched only ends early, a mapping would take nvim down with SIGBUS.
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/* TYPES */
+#define GREP_THREADS_MAX 16
+#define GREP_PATTERN_MAX 256
+#define GREP_READ_MAX (256 * 1024) // a chunk, a line longer than it is searched in pieces
+#define GREP_BINARY_PROBE 8192 // a nul in here and the file is binary, like rg
+#define GREP_TEXT_MAX 512 // of a line shown in the picker
+#define GREP_MATCHES_MAX 100'000 // per search, the rest is not worth showing
+#define GREP_BATCH_BYTES (64 * 1024)
+#define GREP_FILES_BLOCK 4096 // paths per block, blocks never move
+#define GREP_FILES_BLOCKS 1024
+
+typedef uint8_t GrepVec __attribute__((vector_size(32), aligned(1)));
+typedef uint64_t GrepLanes __attribute__((vector_size(32), aligned(1)));
+
+struct GrepQuery
+{
+  uint8_t literal[GREP_PATTERN_MAX]; // every match contains it, may be empty
+  uint literal_len;
+  bool regex_used; // false: the literal is the whole pattern
+  regex_t regex;
+};
+
+// items, each one a uint32_t length and its bytes
+struct GrepBatch
+{
+  struct GrepBatch *next;
+  uint len;
+  uint bytes;
+  char data[GREP_BATCH_BYTES];
+};
+
+struct Grep
+{
+  struct Walk walk;
+  uint threads_len;
+  pthread_t threads[GREP_THREADS_MAX];
+
+  // the file list, appended by whichever thread runs out of files first
+  pthread_mutex_t files_lock;
+  char const **files[GREP_FILES_BLOCKS];
+  atomic_uint files_len;
+  atomic_bool files_done;
+  struct WalkBatch *walk_batches; // the paths point in here
+
+  // the search, everything under lock but the atomics
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool quit;
+  atomic_uint generation;
+  char pattern[GREP_PATTERN_MAX];
+  uint pattern_len;
+  _Atomic uint64_t cursor; // generation << 32 | next file
+  atomic_uint matches;
+  uint idle; // threads done with the current generation
+  struct GrepBatch *batches;
+  struct GrepBatch **batches_tail;
+  atomic_bool starving; // the reader found nothing last time
+};
+
+struct GrepThread
+{
+  struct Grep *grep;
+  uint generation;
+  struct GrepQuery query;
+  struct GrepBatch *batch;
+  char buffer[GREP_READ_MAX];
+};
+
+/* HELPERS */
+// first position >= from of lit in s[0, len), -1 when there is none
+// the first and the last byte of lit are compared a vector at a time, memcmp checks the candidates
+static inline long
+grep_find(
+    uint8_t const *s,
+    size_t from,
+    size_t len,
+    uint8_t const *lit,
+    uint lit_len)
+{
+  if(lit_len == 1)
+  {
+    uint8_t const *hit = from < len ? memchr(s + from, lit[0], len - from) : NULL;
+    return hit == NULL ? -1 : hit - s;
+  }
+
+  GrepVec first = (GrepVec){0} + lit[0];
+  GrepVec last = (GrepVec){0} + lit[lit_len - 1];
+  size_t i = from;
+  for(;
+      i + lit_len - 1 + sizeof(GrepVec) <= len;
+      i += sizeof(GrepVec))
+  {
+    GrepVec a, b;
+    memcpy(&a, s + i, sizeof(a));
+    memcpy(&b, s + i + lit_len - 1, sizeof(b));
+    GrepLanes eq = (GrepLanes)((a == first) & (b == last));
+    for(uint lane = 0;
+        lane < 4;
+        lane += 1)
+    {
+      uint64_t bits = eq[lane];
+      while(bits != 0)
+      {
+        uint byte = __builtin_ctzll(bits) / 8;
+        size_t at = i + lane * 8 + byte;
+        if(memcmp(s + at + 1, lit + 1, lit_len - 2) == 0) { return at; }
+        bits &= ~(0xffULL << (byte * 8));
+      }
+    }
+  }
+  if(i >= len) { return -1; }
+  uint8_t const *hit = memmem(s + i, len - i, lit, lit_len);
+  return hit == NULL ? -1 : hit - s;
+}
+
+// newlines in s[from, to)
+static inline size_t
+grep_count_lines(
+    uint8_t const *s,
+    size_t from,
+    size_t to)
+{
+  size_t lines = 0;
+  size_t i = from;
+  GrepVec nl = (GrepVec){0} + '\n';
+  for(;
+      i + sizeof(GrepVec) <= to;
+      i += sizeof(GrepVec))
+  {
+    GrepVec x;
+    memcpy(&x, s + i, sizeof(x));
+    GrepLanes eq = (GrepLanes)(x == nl);
+    lines += (__builtin_popcountll(eq[0]) + __builtin_popcountll(eq[1])
+        + __builtin_popcountll(eq[2]) + __builtin_popcountll(eq[3])) / 8;
+  }
+  for(;
+      i < to;
+      i += 1)
+  {
+    lines += s[i] == '\n';
+  }
+  return lines;
+}
+
+// the longest run of characters every match has: nothing optional, in a class or a group, no alternation outside of one
+static inline void
+grep_literal(
+    struct GrepQuery *q,
+    char const *pattern,
+    uint len)
+{
+  q->literal_len = 0;
+  uint depth = 0;
+  for(uint i = 0;
+      i < len;
+      i += 1)
+  {
+    if(pattern[i] == '\\') { i += 1; continue; }
+    depth += pattern[i] == '(';
+    depth -= depth > 0 && pattern[i] == ')';
+    if(pattern[i] == '|' && depth == 0) { return; } // an alternation of the whole pattern
+  }
+
+  uint8_t run[GREP_PATTERN_MAX];
+  uint run_len = 0;
+  for(uint i = 0;
+      i <= len;
+      i += 1)
+  {
+    char c = i < len ? pattern[i] : 0;
+    if(c == '\\' && i + 1 < len && strchr(".[]()*+?{}|^$\\/-", pattern[i + 1]) != NULL)
+    {
+      run[run_len++] = pattern[++i];
+      continue;
+    }
+    if(i < len && strchr(".[]()*+?{}^$\\", c) == NULL)
+    {
+      run[run_len++] = c;
+      continue;
+    }
+
+    // the end of a run: a quantifier makes the character before it optional, '+' does not
+    if(c == '*' || c == '?' || c == '{') { run_len -= run_len > 0; }
+    if(run_len > q->literal_len)
+    {
+      memcpy(q->literal, run, run_len);
+      q->literal_len = run_len;
+    }
+    run_len = 0;
+
+    // skip what a class, a group, a repeat or an escape (\w, \b) holds
+    if(c == '\\') { i += 1; }
+    else if(c == '{')
+    {
+      while(i < len && pattern[i] != '}') { i += 1; }
+    }
+    else if(c == '[')
+    {
+      uint j = i + 1;
+      if(j < len && pattern[j] == '^') { j += 1; }
+      if(j < len && pattern[j] == ']') { j += 1; }
+      while(j < len && pattern[j] != ']') { j += 1; }
+      i = j;
+    }
+    else if(c == '(')
+    {
+      uint depth = 1;
+      uint j = i + 1;
+      for(;
+          j < len && depth > 0;
+          j += 1)
+      {
+        if(pattern[j] == '\\') { j += 1; continue; }
+        depth += pattern[j] == '(';
+        depth -= pattern[j] == ')';
+      }
+      i = j - 1;
+    }
+  }
+}
+
+// false for an empty pattern
+static inline bool
+init_grep_query(
+    struct GrepQuery *restrict q,
+    char const *restrict pattern,
+    uint len)
+{
+  memset(q, 0, sizeof(*q));
+  if(len == 0 || len >= GREP_PATTERN_MAX) { return false; }
+
+  // plain characters only: no regex at all
+  bool plain = true;
+  for(uint i = 0;
+      i < len && plain;
+      i += 1)
+  {
+    plain = strchr(".[]()*+?{}|^$\\", pattern[i]) == NULL;
+  }
+  if(!plain)
+  {
+    // \d is not POSIX
+    char translated[GREP_PATTERN_MAX * 5];
+    uint t = 0;
+    for(uint i = 0;
+        i < len;
+        i += 1)
+    {
+      if(pattern[i] == '\\' && i + 1 < len && (pattern[i + 1] == 'd' || pattern[i + 1] == 'D'))
+      {
+        char const *class = pattern[i + 1] == 'd' ? "[0-9]" : "[^0-9]";
+        memcpy(translated + t, class, strlen(class));
+        t += strlen(class);
+        i += 1;
+        continue;
+      }
+      translated[t++] = pattern[i];
+      if(pattern[i] == '\\' && i + 1 < len) { translated[t++] = pattern[++i]; }
+    }
+    translated[t] = 0;
+    q->regex_used = regcomp(&q->regex, translated, REG_EXTENDED | REG_NEWLINE) == 0;
+  }
+
+  if(q->regex_used) { grep_literal(q, pattern, len); }
+  else
+  {
+    memcpy(q->literal, pattern, len);
+    q->literal_len = len;
+  }
+  return true;
+}
+
+static inline void
+deinit_grep_query(
+    struct GrepQuery *q)
+{
+  if(q->regex_used) { regfree(&q->regex); }
+  memset(q, 0, sizeof(*q));
+}
+
+static inline bool
+grep_cancelled(
+    struct GrepThread *t)
+{
+  struct Grep *g = t->grep;
+  return atomic_load_explicit(&g->generation, memory_order_relaxed) != t->generation
+    || atomic_load_explicit(&g->matches, memory_order_relaxed) >= GREP_MATCHES_MAX;
+}
+
+static inline void
+grep_flush(
+    struct GrepThread *t)
+{
+  struct Grep *g = t->grep;
+  if(t->batch == NULL || t->batch->len == 0) { return; }
+  pthread_mutex_lock(&g->lock);
+  bool current = atomic_load(&g->generation) == t->generation;
+  if(current)
+  {
+    *g->batches_tail = t->batch;
+    g->batches_tail = &t->batch->next;
+    t->batch = NULL;
+  }
+  pthread_mutex_unlock(&g->lock);
+  if(!current) { t->batch->len = 0; t->batch->bytes = 0; }
+  else { atomic_store_explicit(&g->starving, false, memory_order_relaxed); }
+}
+
+static inline void
+grep_emit(
+    struct GrepThread *t,
+    char const *path,
+    size_t lnum,
+    size_t col,
+    char const *text,
+    size_t text_len)
+{
+  char item[PATH_MAX + 64 + GREP_TEXT_MAX];
+  int head = snprintf(item, sizeof(item), "%s%c%zu%c%zu%c", path, 0, lnum, 0, col, 0);
+  if(head <= 0 || head >= (int)(sizeof(item) - GREP_TEXT_MAX)) { return; }
+  text_len = Min(text_len, GREP_TEXT_MAX);
+  if(text_len > 0 && text[text_len - 1] == '\r') { text_len -= 1; }
+  memcpy(item + head, text, text_len);
+  uint32_t item_len = head + text_len;
+
+  if(t->batch != NULL && t->batch->bytes + sizeof(item_len) + item_len > GREP_BATCH_BYTES) { grep_flush(t); }
+  if(t->batch == NULL)
+  {
+    t->batch = malloc(sizeof(*t->batch));
+    if(t->batch == NULL) { return; }
+    t->batch->next = NULL;
+    t->batch->len = 0;
+    t->batch->bytes = 0;
+  }
+  memcpy(t->batch->data + t->batch->bytes, &item_len, sizeof(item_len));
+  memcpy(t->batch->data + t->batch->bytes + sizeof(item_len), item, item_len);
+  t->batch->bytes += sizeof(item_len) + item_len;
+  t->batch->len += 1;
+  atomic_fetch_add_explicit(&t->grep->matches, 1, memory_order_relaxed);
+}
+
+// s holds whole lines from lnum on, the first one from byte offset of it (a piece of an overlong line),
+// returns the line after them
+static size_t
+grep_buffer(
+    struct GrepThread *t,
+    char const *path,
+    uint8_t const *s,
+    size_t len,
+    size_t lnum,
+    size_t offset)
+{
+  struct GrepQuery const *q = &t->query;
+  size_t counted = 0; // lnum is the line of this offset
+  size_t pos = 0; // always the start of a line
+  while(pos < len && !grep_cancelled(t))
+  {
+    size_t line_start, line_end, col;
+    if(q->literal_len > 0)
+    {
+      long hit = grep_find(s, pos, len, q->literal, q->literal_len);
+      if(hit == -1) { break; }
+      uint8_t const *nl = memrchr(s + pos, '\n', hit - pos);
+      line_start = nl == NULL ? pos : (size_t)(nl - s) + 1;
+      nl = memchr(s + hit, '\n', len - hit);
+      line_end = nl == NULL ? len : (size_t)(nl - s);
+      col = hit - line_start;
+
+      if(q->regex_used)
+      {
+        regmatch_t m = { .rm_so = 0, .rm_eo = line_end - line_start };
+        if(regexec(&q->regex, (char const *)s + line_start, 1, &m, REG_STARTEND) != 0)
+        {
+          pos = line_end + 1;
+          continue;
+        }
+        col = m.rm_so;
+      }
+    }
+    else
+    {
+      regmatch_t m = { .rm_so = 0, .rm_eo = len - pos };
+      if(regexec(&q->regex, (char const *)s + pos, 1, &m, REG_STARTEND) != 0) { break; }
+      size_t at = pos + m.rm_so;
+      uint8_t const *nl = memrchr(s + pos, '\n', at - pos);
+      line_start = nl == NULL ? pos : (size_t)(nl - s) + 1;
+      nl = at < len ? memchr(s + at, '\n', len - at) : NULL;
+      line_end = nl == NULL ? len : (size_t)(nl - s);
+      col = at - line_start;
+    }
+
+    lnum += grep_count_lines(s, counted, line_start);
+    counted = line_start;
+    if(line_start == 0) { col += offset; }
+    grep_emit(t, path, lnum, col + 1, (char const *)s + line_start, line_end - line_start);
+    pos = line_end + 1;
+  }
+  return lnum + grep_count_lines(s, counted, len);
+}
+
+static void
+grep_file(
+    struct GrepThread *t,
+    char const *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == -1) { return; }
+
+  uint8_t *buffer = (uint8_t *)t->buffer;
+  size_t lnum = 1;
+  size_t kept = 0; // the unfinished last line of the chunk before, moved to the front
+  size_t offset = 0; // of the first line of the chunk, more than 0 in the pieces of an overlong line
+  bool first = true;
+  while(!grep_cancelled(t))
+  {
+    ssize_t n = read(fd, buffer + kept, GREP_READ_MAX - kept);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n == -1) { break; }
+    size_t len = kept + n;
+    if(first && memchr(buffer, 0, Min(len, GREP_BINARY_PROBE)) != NULL) { break; }
+    first = false;
+    if(n == 0)
+    {
+      if(len > 0) { grep_buffer(t, path, buffer, len, lnum, offset); } // the last line has no '\n'
+      break;
+    }
+
+    // a match never spans lines, so a chunk ends after its last '\n'
+    uint8_t const *nl = memrchr(buffer, '\n', len);
+    size_t cut = nl == NULL ? len : (size_t)(nl - buffer) + 1;
+    lnum = grep_buffer(t, path, buffer, cut, lnum, offset);
+    offset = nl == NULL ? offset + cut : 0;
+    kept = len - cut;
+    memmove(buffer, buffer + cut, kept);
+  }
+  close(fd);
+}
+
+// appends the paths of batches to the file list, under files_lock
+static inline void
+grep_add_files(
+    struct Grep *restrict g,
+    struct WalkBatch *restrict batches)
+{
+  uint len = atomic_load(&g->files_len);
+  for(struct WalkBatch *b = batches;
+      b != NULL;
+      b = b->next)
+  {
+    char const *path = b->data;
+    for(uint i = 0;
+        i < b->len && len < GREP_FILES_BLOCK * GREP_FILES_BLOCKS;
+        i += 1)
+    {
+      char const **block = g->files[len / GREP_FILES_BLOCK];
+      if(block == NULL)
+      {
+        block = malloc(GREP_FILES_BLOCK * sizeof(*block));
+        if(block == NULL) { break; }
+        g->files[len / GREP_FILES_BLOCK] = block;
+      }
+      block[len % GREP_FILES_BLOCK] = path;
+      len += 1;
+      path += strlen(path) + 1;
+    }
+  }
+  // kept for the paths
+  while(batches != NULL)
+  {
+    struct WalkBatch *next = batches->next;
+    batches->next = g->walk_batches;
+    g->walk_batches = batches;
+    batches = next;
+  }
+  atomic_store(&g->files_len, len);
+}
+
+// moves what the walk found into the file list until it is longer than seen, sleeping on the walk while
+// it has nothing new (one thread waits for the walk, the others for files_lock); false when it will not be
+static inline bool
+grep_more_files(
+    struct Grep *g,
+    uint seen)
+{
+  pthread_mutex_lock(&g->files_lock);
+  while(atomic_load(&g->files_len) <= seen && !atomic_load(&g->files_done))
+  {
+    bool finished = finished_walk(&g->walk); // first: whatever is taken after it is the last of it
+    struct WalkBatch *batches = take_walk(&g->walk);
+    if(batches == NULL && !finished) { wait_walk(&g->walk); continue; }
+    grep_add_files(g, batches);
+    if(finished) { atomic_store(&g->files_done, true); }
+  }
+  bool more = atomic_load(&g->files_len) > seen;
+  pthread_mutex_unlock(&g->files_lock);
+  return more;
+}
+
+// the next file of this thread's generation, NULL when there is none (or it is not current anymore)
+static inline char const *
+grep_claim(
+    struct GrepThread *t)
+{
+  struct Grep *g = t->grep;
+  for(;;)
+  {
+    uint64_t cursor = atomic_load(&g->cursor);
+    if(cursor >> 32 != t->generation || grep_cancelled(t)) { return NULL; }
+    uint i = (uint)cursor;
+    if(i >= atomic_load(&g->files_len))
+    {
+      if(!grep_more_files(g, i)) { return NULL; }
+      continue;
+    }
+    if(atomic_compare_exchange_weak(&g->cursor, &cursor, cursor + 1))
+    {
+      return g->files[i / GREP_FILES_BLOCK][i % GREP_FILES_BLOCK];
+    }
+  }
+}
+
+static void *
+grep_worker(
+    void *data)
+{
+  struct GrepThread *t = data;
+  struct Grep *g = t->grep;
+  char pattern[GREP_PATTERN_MAX];
+  uint pattern_len = 0;
+
+  pthread_mutex_lock(&g->lock);
+  for(;;)
+  {
+    // done with t->generation, a search that was replaced meanwhile is not counted
+    if(atomic_load(&g->generation) == t->generation) { g->idle += 1; }
+    while(!g->quit && atomic_load(&g->generation) == t->generation) { pthread_cond_wait(&g->wake, &g->lock); }
+    if(g->quit) { break; }
+    t->generation = atomic_load(&g->generation);
+    pattern_len = g->pattern_len;
+    memcpy(pattern, g->pattern, pattern_len);
+    pthread_mutex_unlock(&g->lock);
+
+    deinit_grep_query(&t->query);
+    if(init_grep_query(&t->query, pattern, pattern_len))
+    {
+      for(char const *path = grep_claim(t);
+          path != NULL;
+          path = grep_claim(t))
+      {
+        grep_file(t, path);
+        // a reader that has nothing gets what is there, otherwise full batches
+        if(t->batch != NULL && t->batch->len > 0 && atomic_load_explicit(&g->starving, memory_order_relaxed)) { grep_flush(t); }
+      }
+      grep_flush(t);
+    }
+    pthread_mutex_lock(&g->lock);
+  }
+  pthread_mutex_unlock(&g->lock);
+
+  deinit_grep_query(&t->query);
+  free(t->batch);
+  free(t);
+  return NULL;
+}
+
+/* API */
+static inline void
+free_grep_batches(
+    struct GrepBatch *b)
+{
+  while(b != NULL)
+  {
+    struct GrepBatch *next = b->next;
+    free(b);
+    b = next;
+  }
+}
+
+// stops the threads
+static inline void
+deinit_grep(
+    struct Grep *g)
+{
+  pthread_mutex_lock(&g->lock);
+  g->quit = true;
+  atomic_fetch_add(&g->generation, 1); // cancels the running search
+  pthread_cond_broadcast(&g->wake);
+  pthread_mutex_unlock(&g->lock);
+  cancel_walk(&g->walk); // a thread waiting for the walk wakes up when its threads are out
+  for(uint i = 0;
+      i < g->threads_len;
+      i += 1)
+  {
+    pthread_join(g->threads[i], NULL);
+  }
+
+  deinit_walk(&g->walk);
+  free_walk_batches(g->walk_batches);
+  for(uint i = 0;
+      i < GREP_FILES_BLOCKS;
+      i += 1)
+  {
+    free(g->files[i]);
+  }
+  free_grep_batches(g->batches);
+  pthread_cond_destroy(&g->wake);
+  pthread_mutex_destroy(&g->lock);
+  pthread_mutex_destroy(&g->files_lock);
+  memset(g, 0, sizeof(*g));
+}
+
+// starts the walk of root (the cwd of the paths: "." unless the results are opened elsewhere) and the threads
+static inline bool
+init_grep(
+    struct Grep *restrict g,
+    char const *restrict root,
+    uint threads)
+{
+  memset(g, 0, sizeof(*g));
+  g->batches_tail = &g->batches;
+  pthread_mutex_init(&g->files_lock, NULL);
+  pthread_mutex_init(&g->lock, NULL);
+  pthread_cond_init(&g->wake, NULL);
+
+  static char const *const excludes[] = { ".git" };
+  struct WalkOptions options = {
+    .hidden = false,
+    .ignore_files = true,
+    .excludes = excludes,
+    .excludes_len = STATIC_ARRAY_SIZE(excludes),
+  };
+  if(threads == 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = Max(cpus, 1);
+  }
+  threads = Min(threads, GREP_THREADS_MAX);
+  if(!start_walk(&g->walk, root, &options, threads))
+  {
+    pthread_cond_destroy(&g->wake);
+    pthread_mutex_destroy(&g->lock);
+    pthread_mutex_destroy(&g->files_lock);
+    return false;
+  }
+
+  for(uint i = 0;
+      i < threads;
+      i += 1)
+  {
+    struct GrepThread *t = malloc(sizeof(*t));
+    if(t == NULL) { break; }
+    memset(t, 0, offsetof(struct GrepThread, buffer));
+    t->grep = g;
+    if(pthread_create(&g->threads[i], NULL, grep_worker, t) != 0) { free(t); break; }
+    g->threads_len += 1;
+  }
+  if(g->threads_len == 0) { deinit_grep(g); return false; }
+  return true;
+}
+
+// cancels the running search and starts pattern, returns its generation; an empty pattern finds nothing
+static inline uint
+grep_search(
+    struct Grep *restrict g,
+    char const *restrict pattern,
+    uint pattern_len)
+{
+  pthread_mutex_lock(&g->lock);
+  uint generation = atomic_load(&g->generation) + 1;
+  atomic_store(&g->generation, generation);
+  atomic_store(&g->cursor, (uint64_t)generation << 32);
+  atomic_store(&g->matches, 0);
+  g->pattern_len = Min(pattern_len, GREP_PATTERN_MAX);
+  memcpy(g->pattern, pattern, g->pattern_len);
+  g->idle = 0;
+  free_grep_batches(g->batches);
+  g->batches = NULL;
+  g->batches_tail = &g->batches;
+  atomic_store(&g->starving, true);
+  pthread_cond_broadcast(&g->wake);
+  pthread_mutex_unlock(&g->lock);
+  return generation;
+}
+
+// every thread is done with the search of generation
+static inline bool
+finished_grep(
+    struct Grep *g,
+    uint generation)
+{
+  pthread_mutex_lock(&g->lock);
+  bool finished = atomic_load(&g->generation) == generation && g->idle == g->threads_len;
+  pthread_mutex_unlock(&g->lock);
+  return finished;
+}
+
+// the results of the current search found since the last call, free them with free_grep_batches
+static inline struct GrepBatch *
+take_grep(
+    struct Grep *g)
+{
+  pthread_mutex_lock(&g->lock);
+  struct GrepBatch *batches = g->batches;
+  g->batches = NULL;
+  g->batches_tail = &g->batches;
+  pthread_mutex_unlock(&g->lock);
+  if(batches == NULL) { atomic_store_explicit(&g->starving, true, memory_order_relaxed); }
+  return batches;
+}
+#endif
+
+#endif // GREP_C
@@ -0,0 +1,236 @@
+// Benchmark of grep.c: latency per keystroke of typed patterns over a generated corpus,
+// to the first result and to the end of the search, against `rg` (one process per keystroke) when installed.
+// Not part of config.so, build and run it by hand:
+//   gcc -std=c23 -O3 -march=native -pthread grep_bench.c -o grep_bench && ./grep_bench [corpus dir]
+// The corpus (GREP_BENCH_FILES files of C-ish lines, the same every run) is written on the first run.
+
+#define _GNU_SOURCE // clock_gettime, memmem, memrchr under -std=c23
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef unsigned int uint;
+#define Min(x,y) ((x) < (y) ? (x) : (y))
+#define Max(x,y) ((x) > (y) ? (x) : (y))
+#define STATIC_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+#include "fileio.c"
+#include "walk.c"
+#include "grep.c"
+
+/* TYPES */
+#define GREP_BENCH_DIRS 64
+#define GREP_BENCH_FILES 4'000
+#define GREP_BENCH_LINES 600 // per file, about 25 KiB
+#define GREP_BENCH_RARE 500
+
+/* HELPERS */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_nsec;
+}
+
+static char const *g_words[] =
+{
+  "static", "inline", "uint", "int", "char", "const", "struct", "return", "if", "for", "while",
+  "buffer", "length", "arena", "push", "pop", "table", "index", "error",
+  "window", "config", "render", "parser", "token", "cursor", "line", "column",
+};
+
+// one word in GREP_BENCH_RARE, what the patterns look for
+static char const *g_rare_words[] = { "nvim_buf_set_text", "capacity", "lua_State", "nvim_buf_get_lines" };
+
+static uint64_t g_seed = 0x9e3779b97f4a7c15ULL;
+
+static inline uint
+bench_rand(
+    uint n)
+{
+  g_seed = g_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (uint)(g_seed >> 33) % n;
+}
+
+static void
+bench_corpus(
+    char const *dir)
+{
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/.done", dir);
+  struct stat st;
+  if(stat(path, &st) == 0) { return; }
+
+  mkdir(dir, 0755);
+  for(uint d = 0;
+      d < GREP_BENCH_DIRS;
+      d += 1)
+  {
+    snprintf(path, sizeof(path), "%s/dir%02u", dir, d);
+    mkdir(path, 0755);
+  }
+  for(uint f = 0;
+      f < GREP_BENCH_FILES;
+      f += 1)
+  {
+    snprintf(path, sizeof(path), "%s/dir%02u/file%04u.c", dir, f % GREP_BENCH_DIRS, f);
+    FILE *out = fopen(path, "w");
+    if(out == NULL) { perror(path); exit(1); }
+    for(uint l = 0;
+        l < GREP_BENCH_LINES;
+        l += 1)
+    {
+      uint words = 2 + bench_rand(8);
+      fputs("  ", out);
+      for(uint w = 0;
+          w < words;
+          w += 1)
+      {
+        char const *word = bench_rand(GREP_BENCH_RARE) == 0
+          ? g_rare_words[bench_rand(STATIC_ARRAY_SIZE(g_rare_words))]
+          : g_words[bench_rand(STATIC_ARRAY_SIZE(g_words))];
+        fprintf(out, "%s%s", word, w + 1 < words ? " " : "");
+      }
+      fprintf(out, "(%u);\n", bench_rand(100'000));
+    }
+    fclose(out);
+  }
+  snprintf(path, sizeof(path), "%s/.done", dir);
+  fclose(fopen(path, "w"));
+}
+
+// every prefix of pattern, each one searched to the end
+static void
+bench_typing(
+    struct Grep *g,
+    char const *pattern)
+{
+  uint len = strlen(pattern);
+  for(uint i = 1;
+      i <= len;
+      i += 1)
+  {
+    uint64_t t0 = bench_now_ns();
+    uint generation = grep_search(g, pattern, i);
+    uint64_t first = 0;
+    uint results = 0;
+    for(;;)
+    {
+      bool finished = finished_grep(g, generation);
+      struct GrepBatch *batches = take_grep(g);
+      for(struct GrepBatch const *b = batches;
+          b != NULL;
+          b = b->next)
+      {
+        if(first == 0) { first = bench_now_ns(); }
+        results += b->len;
+      }
+      free_grep_batches(batches);
+      if(finished) { break; }
+      usleep(100);
+    }
+    uint64_t t1 = bench_now_ns();
+    printf("  %-24.*s %7u results  first %8.2f ms  all %8.2f ms\n",
+        (int)i, pattern, results, first == 0 ? 0.0 : (double)(first - t0) / 1e6, (double)(t1 - t0) / 1e6);
+  }
+}
+
+// keystrokes every interval_ms whatever is still running, the last search to the end
+static void
+bench_cancel(
+    struct Grep *g,
+    char const *pattern,
+    uint interval_ms)
+{
+  uint len = strlen(pattern);
+  uint64_t t0 = bench_now_ns();
+  uint generation = 0;
+  for(uint i = 1;
+      i <= len;
+      i += 1)
+  {
+    generation = grep_search(g, pattern, i);
+    if(i < len) { usleep(interval_ms * 1000); }
+  }
+  uint64_t last = bench_now_ns();
+  uint results = 0;
+  for(;;)
+  {
+    bool finished = finished_grep(g, generation);
+    struct GrepBatch *batches = take_grep(g);
+    for(struct GrepBatch const *b = batches;
+        b != NULL;
+        b = b->next)
+    {
+      results += b->len;
+    }
+    free_grep_batches(batches);
+    if(finished) { break; }
+    usleep(100);
+  }
+  uint64_t t1 = bench_now_ns();
+  printf("  typed %-18s every %3u ms  %7u results  last keystroke to all %8.2f ms (typing %.0f ms)\n",
+      pattern, interval_ms, results, (double)(t1 - last) / 1e6, (double)(last - t0) / 1e6);
+}
+
+static void
+bench_rg(
+    char const *dir,
+    char const *pattern)
+{
+  uint len = strlen(pattern);
+  for(uint i = 1;
+      i <= len;
+      i += 1)
+  {
+    char cmd[PATH_MAX + 256];
+    snprintf(cmd, sizeof(cmd), "cd '%s' && rg --column --line-number --no-heading --color=never -- '%.*s' 2>/dev/null",
+        dir, (int)i, pattern);
+    uint64_t t0 = bench_now_ns();
+    FILE *p = popen(cmd, "r");
+    if(p == NULL) { return; }
+    uint results = 0;
+    char line[4096];
+    while(fgets(line, sizeof(line), p) != NULL) { results += strchr(line, '\n') != NULL; }
+    int status = pclose(p);
+    uint64_t t1 = bench_now_ns();
+    if(status == 127 << 8) { printf("  rg not installed\n"); return; }
+    printf("  %-24.*s %7u results             all %8.2f ms\n", (int)i, pattern, results, (double)(t1 - t0) / 1e6);
+  }
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+  char const *dir = argc > 1 ? argv[1] : "/tmp/grep_corpus";
+  static char const *patterns[] = { "nvim_buf_set_text", "lua_State [a-z]+\\(", "capacity\\(\\d+\\)", "nvim_buf_(set|get)" };
+
+  bench_corpus(dir);
+  if(chdir(dir) == -1) { perror(dir); return 1; }
+
+  struct Grep g;
+  if(!init_grep(&g, ".", 0)) { fprintf(stderr, "cannot read %s\n", dir); return 1; }
+  printf("grep.c, %u threads\n", g.threads_len);
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(patterns);
+      i += 1)
+  {
+    bench_typing(&g, patterns[i]);
+  }
+  bench_cancel(&g, patterns[0], 30);
+  bench_cancel(&g, patterns[0], 100);
+  deinit_grep(&g);
+
+  printf("rg, a process per keystroke\n");
+  bench_rg(".", patterns[0]);
+  return 0;
+}
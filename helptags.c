@@ -0,0 +1,161 @@
+#ifndef HELPTAGS_C
+#define HELPTAGS_C
+
+// Help tags of the plugins below a few pack directories, regenerated only where the docs changed.
+// Every <plugin>/doc is stamped with its mtime and entry count, taken after its tags file was
+// written, the stamps are a snapshot file (snapshot.c). A doc directory without a stamp,
+// with another stamp or without a tags file is handed to the caller to run `:helptags` on.
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/* TYPES */
+#define HELPTAGS_DIRS_MAX 256
+#define HELPTAGS_KEY 0x68656c7074616773ULL // "helptags", bump when the stamp changes meaning
+
+#define HELPTAGS_KIND_LIST \
+  HELPTAGS_KIND_X(Dir)
+
+enum Helptags_Kind : int
+{
+#define HELPTAGS_KIND_X(n) Helptags_Kind_##n,
+  HELPTAGS_KIND_LIST
+#undef HELPTAGS_KIND_X
+  Helptags_Kind_Count,
+};
+
+struct HelptagsStamp
+{
+  int64_t mtime;
+  uint entries;
+  bool has_tags;
+};
+
+// returns whether tags were written, dir is only valid during the call
+typedef uint (*Helptags_Generate)(void *ctx, char const *dir);
+
+struct Helptags
+{
+  uint dirs_len;
+  uint regenerated;
+  uint failed;
+};
+
+/* HELPERS */
+// false when path is not a directory
+static inline bool
+helptags_stamp(
+    char const *restrict path,
+    struct HelptagsStamp *restrict stamp)
+{
+  struct stat st;
+  if(stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) { return false; }
+
+  *stamp = (struct HelptagsStamp){ .mtime = (int64_t)st.st_mtim.tv_sec * 1'000'000'000 + st.st_mtim.tv_nsec };
+
+  DIR *dir = opendir(path);
+  if(dir == NULL) { return false; }
+  struct dirent *e;
+  while((e = readdir(dir)) != NULL)
+  {
+    if(e->d_name[0] == '.') { continue; }
+    stamp->entries += 1;
+    if(strcmp(e->d_name, "tags") == 0) { stamp->has_tags = true; }
+  }
+  closedir(dir);
+  return true;
+}
+
+static inline struct SnapshotRecord const *
+helptags_find(
+    struct Snapshot const *restrict s,
+    char const *restrict path,
+    uint path_len)
+{
+  if(s->header == NULL) { return NULL; }
+  for(uint i = 0;
+      i < s->header->records_len;
+      i += 1)
+  {
+    struct SnapshotRecord const *r = &s->records[i];
+    if(r->kind == Helptags_Kind_Dir && r->str_len[0] == path_len
+        && memcmp(snapshot_string(s, r, 0), path, path_len) == 0)
+    {
+      return r;
+    }
+  }
+  return NULL;
+}
+
+/* API */
+// roots are the pack directories ("<site>/pack/deps/opt", ...), the stamps live at path
+static inline struct Helptags
+update_helptags(
+    char const *restrict path,
+    char const *const *restrict roots,
+    uint roots_len,
+    Helptags_Generate generate,
+    void *ctx)
+{
+  struct Helptags result = {0};
+
+  struct Snapshot old;
+  open_snapshot(&old, path, HELPTAGS_KEY);
+
+  struct SnapshotWriter w;
+  if(!init_snapshot_writer(&w, HELPTAGS_DIRS_MAX, HELPTAGS_DIRS_MAX * 128))
+  {
+    close_snapshot(&old);
+    return result;
+  }
+
+  // a plugin that went away also changes the stamps
+  bool dirty = old.header == NULL;
+  char doc[PATH_MAX];
+  for(uint i = 0;
+      i < roots_len;
+      i += 1)
+  {
+    DIR *dir = opendir(roots[i]);
+    if(dir == NULL) { continue; }
+    struct dirent *e;
+    while((e = readdir(dir)) != NULL && result.dirs_len < HELPTAGS_DIRS_MAX)
+    {
+      if(e->d_name[0] == '.') { continue; }
+      int doc_len = snprintf(doc, sizeof(doc), "%s/%s/doc", roots[i], e->d_name);
+      if(doc_len <= 0 || doc_len >= (int)sizeof(doc)) { continue; }
+
+      struct HelptagsStamp stamp;
+      if(!helptags_stamp(doc, &stamp)) { continue; }
+
+      struct SnapshotRecord const *r = helptags_find(&old, doc, doc_len);
+      if(r == NULL || r->integer != stamp.mtime || r->type != stamp.entries || !stamp.has_tags)
+      {
+        dirty = true;
+        if(generate(ctx, doc)) { result.regenerated += 1; }
+        else { result.failed += 1; }
+
+        // the tags file itself moved the mtime
+        if(!helptags_stamp(doc, &stamp)) { continue; }
+        if(!stamp.has_tags) { continue; } // no stamp, try again next start
+      }
+
+      struct SnapshotSlice slice = { doc, doc_len };
+      push_snapshot_record(&w, Helptags_Kind_Dir, stamp.entries, stamp.mtime, &slice, 1);
+      result.dirs_len += 1;
+    }
+    closedir(dir);
+  }
+
+  if(!dirty && w.records.length / sizeof(struct SnapshotRecord) != old.header->records_len) { dirty = true; }
+  close_snapshot(&old);
+
+  if(dirty) { write_snapshot(&w, path, HELPTAGS_KEY); }
+  deinit_snapshot_writer(&w);
+  return result;
+}
+#endif
+
+#endif // HELPTAGS_C
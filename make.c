@@ -3,9 +3,14 @@
 #include <string.h>
 
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <spawn.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 /* macros */
@@ -28,11 +33,15 @@
 
 /* limits */
 #define ARGS_MAX 4096
+#define VARIANTS_MAX 64
 
 /* types */
 #define MAKEMODE_LIST \
   MAKEMODE_X(Debug) \
-  MAKEMODE_X(Release)
+  MAKEMODE_X(Release) \
+  MAKEMODE_X(Matrix) \
+  MAKEMODE_X(Pgo) \
+  MAKEMODE_X(ReleaseLean)
 
 enum MakeMode : int
 {
@@ -49,6 +58,41 @@ struct CommandBuilder
   char **buffer;
 };
 
+#define MATRIXRESULT_LIST \
+  MATRIXRESULT_X(Pending, "pending") \
+  MATRIXRESULT_X(UpToDate, "up to date") \
+  MATRIXRESULT_X(Built, "built") \
+  MATRIXRESULT_X(Failed, "FAILED")
+
+enum MatrixResult : int
+{
+#define MATRIXRESULT_X(n, s) MatrixResult_##n,
+  MATRIXRESULT_LIST
+#undef MATRIXRESULT_X
+  MatrixResult__Count,
+};
+
+static char const *matrix_result_names[] = {
+#define MATRIXRESULT_X(n, s) s,
+  MATRIXRESULT_LIST
+#undef MATRIXRESULT_X
+};
+
+// one variant of make_c matrix
+struct MatrixJob
+{
+  char output[PATH_MAX];
+  char depfile[PATH_MAX];
+  char cmdfile[PATH_MAX];
+  struct CommandBuilder command;
+  char *command_text;
+  size_t command_text_len;
+  pid_t pid;
+  enum MatrixResult result;
+  struct timespec start;
+  double seconds;
+};
+
 /* helpers */
 static inline struct CommandBuilder
 make_command_builder(
@@ -96,86 +140,869 @@ push_array_command_builder(
   return 1;
 }
 
-/* main */
+// flags as the shell would split them (no quotes), one arg each; flags is cut in place
 static inline int
-read_exec_stdout(
-    char **restrict exec,
-    char *restrict out,
-    size_t out_cap,
+push_split_command_builder(
+    struct CommandBuilder *restrict command,
+    char *restrict flags)
+{
+  char *p = flags;
+  for(;;)
+  {
+    while(isspace((unsigned char)*p)) { p++; }
+    if(*p == 0) { return 1; }
+    if(!push_command_builder(command, p)) { return 0; }
+    while(*p != 0 && !isspace((unsigned char)*p)) { p++; }
+    if(*p == 0) { return 1; }
+    *p++ = 0;
+  }
+}
+
+// whole file, nul terminated, free it; NULL when it cannot be read
+static inline char *
+read_whole_file(
+    char const *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == -1) { return NULL; }
+
+  struct stat st;
+  char *buf = fstat(fd, &st) == 0 ? malloc(st.st_size + 1) : NULL;
+  size_t len = 0;
+  while(buf != NULL && len < (size_t)st.st_size)
+  {
+    ssize_t n = read(fd, buf + len, st.st_size - len);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n <= 0) { break; }
+    len += n;
+  }
+  close(fd);
+  if(buf != NULL) { buf[len] = 0; }
+  return buf;
+}
+
+// replaced by rename, a build that dies halfway never leaves half a file
+static inline int
+write_whole_file(
+    char const *restrict path,
+    char const *restrict data,
+    size_t len)
+{
+  char tmp[PATH_MAX];
+  if(snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) { return 0; }
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd == -1) { return 0; }
+
+  size_t written = 0;
+  while(written < len)
+  {
+    ssize_t n = write(fd, data + written, len - written);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n <= 0) { break; }
+    written += n;
+  }
+  close(fd);
+  if(written < len || rename(tmp, path) == -1) { unlink(tmp); return 0; }
+  return 1;
+}
+
+static inline int
+timespec_newer(
+    struct timespec a,
+    struct timespec b)
+{
+  return a.tv_sec > b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec > b.tv_nsec);
+}
+
+// the next path of a make rule (the part after "target:"), NULL at the end
+// handles line continuations, escaped spaces and $$ the way gcc writes them
+static inline char *
+next_depfile_path(
+    char **cursor)
+{
+  char *p = *cursor;
+  while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || (p[0] == '\\' && (p[1] == '\n' || p[1] == '\r')))
+  {
+    p += p[0] == '\\' ? 2 : 1;
+  }
+  if(*p == 0) { return NULL; }
+
+  char *path = p;
+  char *out = p;
+  while(*p != 0 && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+  {
+    if(p[0] == '\\' && (p[1] == ' ' || p[1] == '#')) { p += 1; }
+    else if(p[0] == '$' && p[1] == '$') { p += 1; }
+    else if(p[0] == '\\' && (p[1] == '\n' || p[1] == '\r')) { break; }
+    *out++ = *p++;
+  }
+  if(*p != 0 && !(p[0] == '\\')) { p += 1; }
+  *out = 0;
+  *cursor = p;
+  return path;
+}
+
+// 1 and why in reason when output has to be built: it is missing, a dependency of the last build
+// changed or is gone, or the command is not the one of the last build
+static inline int
+needs_rebuild(
+    char const *restrict output,
+    char const *restrict depfile,
+    char const *restrict cmdfile,
+    char const *restrict command_text,
+    char *restrict reason,
+    size_t reason_cap)
+{
+  struct stat out_st;
+  if(stat(output, &out_st) == -1) { snprintf(reason, reason_cap, "%s is missing", output); return 1; }
+
+  char *last_command = read_whole_file(cmdfile);
+  int same_command = last_command != NULL && strcmp(last_command, command_text) == 0;
+  free(last_command);
+  if(!same_command) { snprintf(reason, reason_cap, "the flags changed"); return 1; }
+
+  char *deps = read_whole_file(depfile);
+  char *cursor = deps == NULL ? NULL : strchr(deps, ':');
+  if(cursor == NULL) { free(deps); snprintf(reason, reason_cap, "%s is missing", depfile); return 1; }
+  cursor += 1;
+
+  int rebuild = 0;
+  for(char *path = next_depfile_path(&cursor);
+      path != NULL && !rebuild;
+      path = next_depfile_path(&cursor))
+  {
+    struct stat st;
+    if(stat(path, &st) == -1) { snprintf(reason, reason_cap, "%s is gone", path); rebuild = 1; }
+    else if(timespec_newer(st.st_mtim, out_st.st_mtim)) { snprintf(reason, reason_cap, "%s changed", path); rebuild = 1; }
+  }
+  free(deps);
+  return rebuild;
+}
+
+// starts command without waiting for it, its pid (-1 when it did not start)
+static inline pid_t
+spawn_command(
+    char **restrict command,
     char **restrict envp)
 {
-  int pipefd[2];
-  if(pipe(pipefd) == -1) { LOG_ERROR("pipe failed\n"); return 0; }
-  int out_pid = fork(); // I know, we all hate fork, deal with it
-  if(out_pid == -1)
+  pid_t pid;
+  int err = posix_spawnp(&pid, command[0], NULL, NULL, command, envp);
+  if(err != 0) { LOG_ERROR("posix_spawn failed: error_code(%d): program('%s')\n", err, command[0]); return -1; }
+  return pid;
+}
+
+// waits for pid, its exit status (-1 when it did not exit)
+static inline int
+wait_command(
+    pid_t pid)
+{
+  int wstatus;
+  while(waitpid(pid, &wstatus, 0) == -1)
+  {
+    if(errno != EINTR) { LOG_ERROR("waitpid failed\n"); return -1; }
+  }
+  return WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+}
+
+// runs command to its end, its exit status (-1 when it did not run)
+static inline int
+run_command(
+    char **restrict command,
+    char **restrict envp)
+{
+  pid_t pid = spawn_command(command, envp);
+  if(pid == -1) { return -1; }
+  return wait_command(pid);
+}
+
+// the args of command one per line, what the .cmd file keeps, free it
+static inline char *
+join_command_builder(
+    struct CommandBuilder const *restrict command,
+    size_t *restrict len_out)
+{
+  size_t len = 0;
+  for(size_t i = 0;
+      i < command->length && command->buffer[i] != NULL;
+      i++)
   {
-    LOG_ERROR("fork failed\n");
+    len += strlen(command->buffer[i]) + 1;
+  }
+  char *text = malloc(len + 1);
+  ASSERT(text != NULL, "failed to allocate the command text\n");
+  len = 0;
+  for(size_t i = 0;
+      i < command->length && command->buffer[i] != NULL;
+      i++)
+  {
+    size_t arg_len = strlen(command->buffer[i]);
+    memcpy(text + len, command->buffer[i], arg_len);
+    text[len + arg_len] = '\n';
+    len += arg_len + 1;
+  }
+  text[len] = 0;
+  *len_out = len;
+  return text;
+}
+
+// sources, the depfile for the next incremental build and the output, then the null execve wants
+static inline int
+push_output_command_builder(
+    struct CommandBuilder *restrict command,
+    char **restrict sources,
+    size_t sources_len,
+    char *restrict depfile,
+    char *restrict output)
+{
+  char *tail[] = { "-MMD", "-MF", depfile, "-o", output, NULL };
+  return push_array_command_builder(command, sources, sources_len)
+    && push_array_command_builder(command, tail, STATIC_ARRAY_SIZE(tail));
+}
+
+// base + flags built into output, unless it is up to date and not forced; 0 when output is there
+static inline int
+build_output(
+    struct CommandBuilder const *restrict base,
+    char **restrict flags,
+    size_t flags_len,
+    char **restrict sources,
+    size_t sources_len,
+    char *restrict output,
+    int force,
+    char **restrict envp)
+{
+  char depfile[PATH_MAX]; // what gcc read, written by -MMD
+  char cmdfile[PATH_MAX]; // the command of the last build that succeeded
+  snprintf(depfile, sizeof(depfile), "%s.d", output);
+  snprintf(cmdfile, sizeof(cmdfile), "%s.cmd", output);
+
+  struct CommandBuilder command = make_command_builder(ARGS_MAX);
+  ASSERT(push_array_command_builder(&command, base->buffer, base->length), "ran out of args\n");
+  ASSERT(push_array_command_builder(&command, flags, flags_len), "ran out of args\n");
+  ASSERT(push_output_command_builder(&command, sources, sources_len, depfile, output), "ran out of args\n");
+
+  /* skip the build when nothing changed */
+  size_t command_text_len = 0;
+  char *command_text = join_command_builder(&command, &command_text_len);
+
+  char reason[PATH_MAX + 64];
+  if(force) { snprintf(reason, sizeof(reason), "--force"); }
+  else if(!needs_rebuild(output, depfile, cmdfile, command_text, reason, sizeof(reason)))
+  {
+    printf(PROGRAM ": %s is up to date\n", output);
+    free(command_text);
+    free(command.buffer);
     return 0;
   }
-  else if(out_pid == 0)
+  printf(PROGRAM ": %s: rebuild: %s\n", output, reason);
+
+  /* call the build */
+  for(size_t i = 0;
+      i < command.length - 1; // ignore the null
+      i++)
   {
-    dup2(pipefd[1], STDOUT_FILENO);
-    close(pipefd[0]);
-    close(pipefd[1]);
+    printf("%s ", command.buffer[i]);
+  }
+  putchar('\n');
+  fflush(stdout);
+
+  unlink(cmdfile); // a failed build is never up to date
+  int status = run_command(command.buffer, envp);
+  if(status != 0) { LOG_ERROR("build failed: exit status %d\n", status); }
+  else if(!write_whole_file(cmdfile, command_text, command_text_len))
+  {
+    LOG_ERROR("failed to write %s, the next build is a full one\n", cmdfile);
+  }
+  free(command_text);
+  free(command.buffer);
+  return status == -1 ? 1 : status;
+}
+
+// a copy of output where nvim loads it from, whole or not at all: a running nvim keeps the old file
+// the last build of installed is not what is there anymore, so the next plain build of it is a full one
+static inline int
+install_output(
+    char const *restrict output,
+    char const *restrict installed)
+{
+  char cmdfile[PATH_MAX + sizeof(".cmd")];
+  snprintf(cmdfile, sizeof(cmdfile), "%s.cmd", installed);
+  unlink(cmdfile);
+
+  struct stat st;
+  char *data = stat(output, &st) == 0 ? read_whole_file(output) : NULL;
+  int ok = data != NULL && write_whole_file(installed, data, st.st_size);
+  free(data);
+  return ok;
+}
+
+// the .gcda files in dir, removed when remove is set: gcc merges new counts into old ones
+static inline int
+count_profiles(
+    char const *restrict dir,
+    int remove)
+{
+  DIR *d = opendir(dir);
+  if(d == NULL) { return 0; }
 
-    execve(exec[0], exec, envp);
-    PANIC("failed to exec\n");
+  int count = 0;
+  for(struct dirent *e = readdir(d);
+      e != NULL;
+      e = readdir(d))
+  {
+    size_t len = strlen(e->d_name);
+    if(len < sizeof(".gcda") - 1 || strcmp(e->d_name + len - (sizeof(".gcda") - 1), ".gcda") != 0) { continue; }
+    count++;
+    if(remove) { unlinkat(dirfd(d), e->d_name, 0); }
   }
-  else
+  closedir(d);
+  return count;
+}
+
+static inline int
+compare_double(
+    void const *a,
+    void const *b)
+{
+  double x = *(double const *)a;
+  double y = *(double const *)b;
+  return (x > y) - (x < y);
+}
+
+// mean, median and min of the runs of each name (times[name * runs + run], in seconds, sorted here),
+// then the last name against the first
+static inline void
+print_timings(
+    char const *restrict title,
+    char **restrict names,
+    size_t names_len,
+    double *restrict times,
+    size_t runs,
+    double scale,
+    char const *restrict unit)
+{
+  double mean[names_len];
+  double median[names_len];
+  double min[names_len];
+  printf("\n%-20s %10s %10s %10s\n", title, "mean", "median", "min");
+  for(size_t j = 0;
+      j < names_len;
+      j++)
   {
-    close(pipefd[1]);
+    double *t = times + j * runs;
+    qsort(t, runs, sizeof(*t), compare_double);
+    mean[j] = 0;
+    for(size_t i = 0;
+        i < runs;
+        i++)
+    {
+      mean[j] += t[i] / runs;
+    }
+    median[j] = runs % 2 ? t[runs / 2] : (t[runs / 2 - 1] + t[runs / 2]) / 2;
+    min[j] = t[0];
+    printf("%-20s %7.2f %-2s %7.2f %-2s %7.2f %-2s\n", names[j], mean[j] * scale, unit, median[j] * scale, unit, min[j] * scale, unit);
+  }
 
-    ssize_t len = read(pipefd[0], out, out_cap);
-    if(len == -1) { LOG_ERROR("read from pipe failed\n"); return 0; }
+  size_t l = names_len - 1;
+  printf("%-20s %+7.2f %-2s %+7.2f %-2s %+7.2f %-2s\n", "delta",
+      (mean[l] - mean[0]) * scale, unit, (median[l] - median[0]) * scale, unit, (min[l] - min[0]) * scale, unit);
+  printf("%-20s %+8.1f %% %+8.1f %% %+8.1f %%\n", "",
+      (mean[l] / mean[0] - 1) * 100, (median[l] / median[0] - 1) * 100, (min[l] / min[0] - 1) * 100);
+}
 
-    int wstatus;
-    waitpid(out_pid, &wstatus, 0);
-    if(WEXITSTATUS(wstatus) != 0) { LOG_ERROR("process exited with error\n"); return 0; }
+static inline double
+seconds_since(
+    struct timespec start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) / 1e9;
+}
 
+// stem-<defines>.so, each define lowercased without -D and MODE_:
+// "-DMODE_THEME -DDEBUG" builds config-theme-debug.so, no defines config-base.so
+static inline int
+variant_output_name(
+    char *restrict out,
+    size_t out_cap,
+    char const *restrict stem,
+    char const *restrict variant)
+{
+  size_t len = snprintf(out, out_cap, "%s", stem);
+  size_t stem_len = len;
+  char const *p = variant;
+  for(;;)
+  {
+    while(isspace((unsigned char)*p)) { p++; }
+    if(*p == 0) { break; }
+    if(p[0] == '-' && p[1] == 'D') { p += 2; }
+    while(*p == '-') { p++; }
+    if(strncmp(p, "MODE_", sizeof("MODE_") - 1) == 0) { p += sizeof("MODE_") - 1; }
+
+    if(len + 1 < out_cap) { out[len] = '-'; }
+    len++;
+    for(;
+        *p != 0 && !isspace((unsigned char)*p);
+        p++)
+    {
+      if(len + 1 < out_cap) { out[len] = isalnum((unsigned char)*p) ? tolower((unsigned char)*p) : '_'; }
+      len++;
+    }
+  }
+  if(len < out_cap) { out[len] = 0; }
+  if(len == stem_len) { len += snprintf(out + len, out_cap - len, "-base"); }
+  if(len < out_cap) { len += snprintf(out + len, out_cap - len, ".so"); }
+  return len < out_cap;
+}
+
+// what pkg-config resolves, changes with the .pc file and the variables that pick it
+static inline void
+pkg_config_key(
+    char const *restrict pc_path,
+    char *restrict key,
+    size_t key_cap)
+{
+  struct stat st;
+  if(stat(pc_path, &st) == -1) { key[0] = 0; return; }
+
+  char const *vars[] = { "PKG_CONFIG_PATH", "PKG_CONFIG_LIBDIR", "PKG_CONFIG_SYSROOT_DIR" };
+  size_t len = snprintf(key, key_cap, "%s %lld.%09ld", pc_path, (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+  for(size_t i = 0;
+      i < STATIC_ARRAY_SIZE(vars) && len < key_cap;
+      i++)
+  {
+    char const *value = getenv(vars[i]);
+    len += snprintf(key + len, key_cap - len, " %s=%s", vars[i], value == NULL ? "" : value);
+  }
+  if(len >= key_cap) { key[0] = 0; } // a key cut short could match the wrong file
+}
+
+/* main */
+// runs exec and reads its stdout to the end, nul terminated without the trailing whitespace, free it;
+// NULL when it did not run or exited with an error
+static inline char *
+read_exec_stdout(
+    char **restrict exec,
+    char **restrict envp)
+{
+  int pipefd[2];
+  if(pipe(pipefd) == -1) { LOG_ERROR("pipe failed\n"); return NULL; }
+  fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+  fcntl(pipefd[1], F_SETFD, FD_CLOEXEC); // dup2 clears it on the child's stdout
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+  pid_t pid;
+  int err = posix_spawn(&pid, exec[0], &actions, NULL, exec, envp);
+  posix_spawn_file_actions_destroy(&actions);
+  close(pipefd[1]);
+  if(err != 0)
+  {
+    LOG_ERROR("posix_spawn failed: error_code(%d): program('%s')\n", err, exec[0]);
     close(pipefd[0]);
-    while(isspace(out[len - 1])) { out[--len] = 0; }
+    return NULL;
   }
-  return 1;
+
+  size_t cap = 256;
+  size_t len = 0;
+  char *out = malloc(cap);
+  int failed = out == NULL;
+  while(!failed)
+  {
+    if(len + 1 == cap)
+    {
+      char *grown = realloc(out, cap * 2);
+      if(grown == NULL) { failed = 1; break; }
+      out = grown;
+      cap *= 2;
+    }
+    ssize_t n = read(pipefd[0], out + len, cap - 1 - len);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n == -1) { LOG_ERROR("read from pipe failed\n"); failed = 1; }
+    if(n <= 0) { break; }
+    len += n;
+  }
+  close(pipefd[0]);
+
+  int wstatus;
+  while(waitpid(pid, &wstatus, 0) == -1)
+  {
+    if(errno != EINTR) { LOG_ERROR("waitpid failed\n"); failed = 1; break; }
+  }
+  if(!failed && (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)) { LOG_ERROR("process exited with error\n"); failed = 1; }
+  if(failed) { free(out); return NULL; }
+
+  while(len > 0 && isspace((unsigned char)out[len - 1])) { len--; }
+  out[len] = 0;
+  return out;
 }
 
+// cflags and libs of package, from cachefile while its .pc file is the same one,
+// else from pkg-config and written back to cachefile
+// cachefile is three lines: the key (pc path, mtime, the pkg-config variables), cflags, libs
 static inline int
 get_pkg_configs(
-    char *restrict cflags_out,
-    size_t cflags_out_cap,
-    char *restrict libs_out,
-    size_t libs_out_cap,
+    char const *restrict package,
+    char const *restrict cachefile,
+    int refresh,
+    char **restrict cflags_out,
+    char **restrict libs_out,
     char **restrict envp)
 {
-  int retval = 0;
+  char key[PATH_MAX * 4];
 
+  // cache
+  char *cache = refresh ? NULL : read_whole_file(cachefile);
+  if(cache != NULL)
+  {
+    char *cflags = strchr(cache, '\n');
+    char *libs = cflags == NULL ? NULL : strchr(cflags + 1, '\n');
+    char *end = libs == NULL ? NULL : strchr(libs + 1, '\n');
+    char *pc_path_end = strchr(cache, ' ');
+    if(end != NULL && pc_path_end != NULL && pc_path_end < cflags)
+    {
+      *cflags++ = 0;
+      *libs++ = 0;
+      *end = 0;
+      *pc_path_end = 0;
+      pkg_config_key(cache, key, sizeof(key));
+      *pc_path_end = ' ';
+      if(key[0] != 0 && strcmp(cache, key) == 0)
+      {
+        *cflags_out = cflags;
+        *libs_out = libs;
+        return 1;
+      }
+    }
+    free(cache);
+  }
+
+  // pkg-config
+  char pcfiledir_flag[] = "--variable=pcfiledir";
   char cflags_flag[] = "--cflags";
   char libs_flag[] = "--libs";
   char *pkg_config[] = {
     "/usr/bin/pkg-config",
     NULL,
-    "luajit",
+    (char *)package,
     NULL,
   };
 
-  // cflags
   pkg_config[1] = cflags_flag;
-  if(!read_exec_stdout(pkg_config, cflags_out, cflags_out_cap, envp))
+  char *cflags = read_exec_stdout(pkg_config, envp);
+  if(cflags == NULL) { LOG_ERROR("pkg-config cflags failed\n"); return 0; }
+
+  pkg_config[1] = libs_flag;
+  char *libs = read_exec_stdout(pkg_config, envp);
+  if(libs == NULL) { LOG_ERROR("pkg-config libs failed\n"); free(cflags); return 0; }
+
+  *cflags_out = cflags;
+  *libs_out = libs;
+
+  // a pc file we cannot find is never cached, the next build asks again
+  pkg_config[1] = pcfiledir_flag;
+  char *pcfiledir = read_exec_stdout(pkg_config, envp);
+  char pc_path[PATH_MAX];
+  if(pcfiledir == NULL || snprintf(pc_path, sizeof(pc_path), "%s/%s.pc", pcfiledir, package) >= (int)sizeof(pc_path))
   {
-    LOG_ERROR("pkg-config cflags failed\n");
-    goto EXIT;
+    pc_path[0] = 0;
   }
+  free(pcfiledir);
+  if(pc_path[0] == 0 || strchr(pc_path, ' ') != NULL || strchr(pc_path, '\n') != NULL) { return 1; }
 
-  // libs
-  pkg_config[1] = libs_flag;
-  if(!read_exec_stdout(pkg_config, libs_out, libs_out_cap, envp))
+  pkg_config_key(pc_path, key, sizeof(key));
+  if(key[0] == 0) { return 1; }
+  size_t cache_cap = strlen(key) + strlen(cflags) + strlen(libs) + 4;
+  cache = malloc(cache_cap);
+  if(cache != NULL)
+  {
+    size_t cache_len = snprintf(cache, cache_cap, "%s\n%s\n%s\n", key, cflags, libs);
+    if(!write_whole_file(cachefile, cache, cache_len)) { LOG_ERROR("failed to write %s\n", cachefile); }
+    free(cache);
+  }
+  return 1;
+}
+
+// builds base + each variant's flags into its own output, at most jobs at a time, each skipped
+// when it is up to date, then a table of the results; 0 when none failed
+static inline int
+run_matrix(
+    struct CommandBuilder const *restrict base,
+    char **restrict variants,
+    size_t variants_len,
+    char **restrict sources,
+    size_t sources_len,
+    size_t jobs,
+    int force,
+    char **restrict envp)
+{
+  struct MatrixJob *matrix = calloc(variants_len, sizeof(*matrix));
+  ASSERT_FMT(matrix != NULL, "failed to allocate: %ldb", variants_len * sizeof(*matrix));
+
+  /* commands */
+  for(size_t i = 0;
+      i < variants_len;
+      i++)
+  {
+    struct MatrixJob *job = &matrix[i];
+    ASSERT_FMT(variant_output_name(job->output, sizeof(job->output), "config", variants[i]), "variant name too long: '%s'\n", variants[i]);
+    for(size_t j = 0;
+        j < i;
+        j++)
+    {
+      ASSERT_FMT(strcmp(matrix[j].output, job->output) != 0, "variants '%s' and '%s' both build %s\n", variants[j], variants[i], job->output);
+    }
+    snprintf(job->depfile, sizeof(job->depfile), "%s.d", job->output);
+    snprintf(job->cmdfile, sizeof(job->cmdfile), "%s.cmd", job->output);
+
+    char *defines = strdup(variants[i]); // split in place
+    ASSERT(defines != NULL, "failed to allocate the variant\n");
+    job->command = make_command_builder(ARGS_MAX);
+    ASSERT(push_array_command_builder(&job->command, base->buffer, base->length), "ran out of args\n");
+    ASSERT(push_split_command_builder(&job->command, defines), "ran out of args\n");
+    ASSERT(push_output_command_builder(&job->command, sources, sources_len, job->depfile, job->output), "ran out of args\n");
+    job->command_text = join_command_builder(&job->command, &job->command_text_len);
+
+    char reason[PATH_MAX + 64];
+    if(force) { snprintf(reason, sizeof(reason), "--force"); }
+    else if(!needs_rebuild(job->output, job->depfile, job->cmdfile, job->command_text, reason, sizeof(reason)))
+    {
+      job->result = MatrixResult_UpToDate;
+      continue;
+    }
+    printf(PROGRAM ": %s: rebuild: %s\n", job->output, reason);
+  }
+  fflush(stdout);
+
+  /* job pool */
+  size_t next = 0;
+  size_t running = 0;
+  for(;;)
+  {
+    while(running < jobs && next < variants_len)
+    {
+      struct MatrixJob *job = &matrix[next++];
+      if(job->result != MatrixResult_Pending) { continue; }
+
+      unlink(job->cmdfile); // a failed build is never up to date
+      clock_gettime(CLOCK_MONOTONIC, &job->start);
+      job->pid = spawn_command(job->command.buffer, envp);
+      if(job->pid == -1) { job->result = MatrixResult_Failed; continue; }
+      running++;
+    }
+    if(running == 0) { break; }
+
+    int wstatus;
+    pid_t pid = waitpid(-1, &wstatus, 0);
+    if(pid == -1)
+    {
+      if(errno == EINTR) { continue; }
+      PANIC("waitpid failed\n");
+    }
+    for(size_t i = 0;
+        i < variants_len;
+        i++)
+    {
+      struct MatrixJob *job = &matrix[i];
+      if(job->pid != pid || job->result != MatrixResult_Pending) { continue; }
+
+      running--;
+      job->seconds = seconds_since(job->start);
+      job->result = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0 ? MatrixResult_Built : MatrixResult_Failed;
+      if(job->result == MatrixResult_Built && !write_whole_file(job->cmdfile, job->command_text, job->command_text_len))
+      {
+        LOG_ERROR("failed to write %s, the next build is a full one\n", job->cmdfile);
+      }
+      break;
+    }
+  }
+
+  /* summary */
+  int failed = 0;
+  int width = sizeof("output") - 1;
+  for(size_t i = 0;
+      i < variants_len;
+      i++)
+  {
+    int len = strlen(matrix[i].output);
+    if(width < len) { width = len; }
+  }
+  printf("\n%-*s  %-10s %9s %12s  %s\n", width, "output", "result", "time", "size", "flags");
+  for(size_t i = 0;
+      i < variants_len;
+      i++)
+  {
+    struct MatrixJob *job = &matrix[i];
+    struct stat st;
+    int has_output = job->result != MatrixResult_Failed && stat(job->output, &st) == 0;
+    failed += job->result == MatrixResult_Failed;
+
+    char seconds[32] = "-";
+    char size[32] = "-";
+    if(job->result == MatrixResult_Built || job->result == MatrixResult_Failed) { snprintf(seconds, sizeof(seconds), "%.2fs", job->seconds); }
+    if(has_output) { snprintf(size, sizeof(size), "%.1f KiB", (double)st.st_size / 1024.0); }
+    printf("%-*s  %-10s %9s %12s  %s\n", width, job->output, matrix_result_names[job->result], seconds, size, variants[i]);
+  }
+  printf("%zu variants, %d failed, %zu jobs\n", variants_len, failed, jobs);
+  return failed == 0 ? 0 : 1;
+}
+
+// the plain release build against one trained on runs of nvim --headless +qa: builds with
+// -fprofile-generate, trains it, rebuilds with -fprofile-use, then times startup with each, runs times
+// nvim loads them from a directory of its own put first on package.cpath, installed is left alone
+// until the pgo build replaces it at the end, a failed run leaves it as it was
+static inline int
+run_pgo(
+    struct CommandBuilder const *restrict base,
+    char **restrict sources,
+    size_t sources_len,
+    char const *restrict installed,
+    char *restrict nvim,
+    size_t runs,
+    char **restrict envp)
+{
+  char cwd[PATH_MAX];
+  ASSERT(getcwd(cwd, sizeof(cwd)) != NULL, "getcwd failed\n");
+  char profile_dir[PATH_MAX + 32]; // absolute, nvim writes it on exit from wherever it runs
+  snprintf(profile_dir, sizeof(profile_dir), "%s/%s.pgo", cwd, installed);
+  ASSERT_FMT(mkdir(profile_dir, 0755) == 0 || errno == EEXIST, "failed to create %s\n", profile_dir);
+  count_profiles(profile_dir, 1);
+
+  // -dumpbase names the .gcda files the same for both builds whatever their -o
+  char generate_flag[sizeof(profile_dir) + 32];
+  char use_flag[sizeof(profile_dir) + 32];
+  snprintf(generate_flag, sizeof(generate_flag), "-fprofile-generate=%s", profile_dir);
+  snprintf(use_flag, sizeof(use_flag), "-fprofile-use=%s", profile_dir);
+  char *generate_flags[] = {
+    generate_flag,
+    "-fprofile-update=prefer-atomic", // walk.c, grep.c, execprobe.c threads
+    "-dumpbase", "config-pgo",
+  };
+  char *use_flags[] = {
+    use_flag,
+    "-fprofile-partial-training", // what startup never runs (pickers, formatters) stays -O3, not -Os
+    "-dumpbase", "config-pgo",
+  };
+  char release_output[] = "config-release.so";
+  char generate_output[] = "config-pgo-gen.so";
+  char use_output[] = "config-pgo.so";
+
+  // require('config') finds the build under test before the installed one
+  char trial_dir[PATH_MAX];
+  char trial[PATH_MAX];
+  char cpath_command[PATH_MAX + 64];
+  ASSERT_FMT(snprintf(trial_dir, sizeof(trial_dir), "%s/lib", profile_dir) < (int)sizeof(trial_dir), "path too long: %s\n", profile_dir);
+  ASSERT_FMT(snprintf(trial, sizeof(trial), "%s/config.so", trial_dir) < (int)sizeof(trial), "path too long: %s\n", trial_dir);
+  snprintf(cpath_command, sizeof(cpath_command), "lua package.cpath = [==[%s/?.so;]==] .. package.cpath", trial_dir);
+  ASSERT_FMT(mkdir(trial_dir, 0755) == 0 || errno == EEXIST, "failed to create %s\n", trial_dir);
+  char *nvim_command[] = { nvim, "--headless", "--cmd", cpath_command, "+qa", NULL };
+
+  /* release and instrumented */
+  if(build_output(base, NULL, 0, sources, sources_len, release_output, 0, envp) != 0) { return 1; }
+  if(build_output(base, generate_flags, STATIC_ARRAY_SIZE(generate_flags), sources, sources_len, generate_output, 1, envp) != 0) { return 1; }
+
+  /* training */
+  ASSERT_FMT(install_output(generate_output, trial), "failed to install %s\n", generate_output);
+  printf(PROGRAM ": pgo: training, %zu runs of %s --headless +qa\n", runs, nvim);
+  fflush(stdout);
+  for(size_t i = 0;
+      i < runs;
+      i++)
   {
-    LOG_ERROR("pkg-config libs failed\n");
-    goto EXIT;
+    int status = run_command(nvim_command, envp);
+    ASSERT_FMT(status == 0, "%s exited with %d\n", nvim, status);
   }
+  ASSERT_FMT(count_profiles(profile_dir, 0) > 0, "no profile in %s, does nvim require('config')?\n", profile_dir);
+
+  /* optimized */
+  if(build_output(base, use_flags, STATIC_ARRAY_SIZE(use_flags), sources, sources_len, use_output, 1, envp) != 0) { return 1; }
 
-  retval = 1;
-EXIT:
-  return retval;
+  /* startup, the builds take turns so drift hits both */
+  char *outputs[] = { release_output, use_output };
+  double *times = calloc(runs * STATIC_ARRAY_SIZE(outputs), sizeof(*times));
+  ASSERT(times != NULL, "failed to allocate the timings\n");
+  printf(PROGRAM ": pgo: timing, %zu runs of each\n", runs);
+  fflush(stdout);
+  for(size_t i = 0;
+      i <= runs; // the first round warms the page cache
+      i++)
+  {
+    for(size_t j = 0;
+        j < STATIC_ARRAY_SIZE(outputs);
+        j++)
+    {
+      ASSERT_FMT(install_output(outputs[j], trial), "failed to install %s\n", outputs[j]);
+      struct timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      int status = run_command(nvim_command, envp);
+      double seconds = seconds_since(start);
+      ASSERT_FMT(status == 0, "%s exited with %d\n", nvim, status);
+      if(i > 0) { times[j * runs + i - 1] = seconds; }
+    }
+  }
+
+  /* summary */
+  print_timings("startup", outputs, STATIC_ARRAY_SIZE(outputs), times, runs, 1e3, "ms");
+  free(times);
+
+  ASSERT_FMT(install_output(use_output, installed), "failed to install %s\n", use_output);
+  printf(PROGRAM ": pgo: %s is %s\n", installed, use_output);
+  return 0;
+}
+
+// dlopen of each output timed inside nvim, where the lua and nvim symbols config.so binds to are,
+// a fresh nvim --clean for every run (config.so not loaded already), the outputs take turns
+static inline int
+run_dlopen_bench(
+    char **restrict outputs,
+    size_t outputs_len,
+    char *restrict nvim,
+    size_t runs,
+    char **restrict envp)
+{
+  char cwd[PATH_MAX];
+  ASSERT(getcwd(cwd, sizeof(cwd)) != NULL, "getcwd failed\n");
+
+  double *times = calloc(runs * outputs_len, sizeof(*times));
+  ASSERT(times != NULL, "failed to allocate the timings\n");
+  printf(PROGRAM ": dlopen: %zu runs of each in %s --clean --headless\n", runs, nvim);
+  fflush(stdout);
+  for(size_t i = 0;
+      i <= runs; // the first round warms the page cache
+      i++)
+  {
+    for(size_t j = 0;
+        j < outputs_len;
+        j++)
+    {
+      // '*' only links the library, RTLD_NOW like require does
+      char script[2 * PATH_MAX + 256];
+      snprintf(script, sizeof(script),
+          "lua local uv = vim.uv or vim.loop; local t = uv.hrtime();"
+          " local ok, err = package.loadlib('%s/%s', '*'); local dt = uv.hrtime() - t;"
+          " if ok then io.stdout:write(tostring(dt)) else io.stderr:write(err) end",
+          cwd, outputs[j]);
+      char *nvim_command[] = { nvim, "--clean", "--headless", "--cmd", script, "+qa", NULL };
+      char *out = read_exec_stdout(nvim_command, envp);
+      char *end = NULL;
+      double ns = out == NULL ? 0 : strtod(out, &end);
+      ASSERT_FMT(out != NULL && end != out && ns > 0, "dlopen of %s failed in %s\n", outputs[j], nvim);
+      free(out);
+      if(i > 0) { times[j * runs + i - 1] = ns / 1e9; }
+    }
+  }
+
+  print_timings("dlopen", outputs, outputs_len, times, runs, 1e6, "us");
+  for(size_t j = 0;
+      j < outputs_len;
+      j++)
+  {
+    struct stat st;
+    if(stat(outputs[j], &st) == 0) { printf("%-20s %7.1f KiB\n", outputs[j], (double)st.st_size / 1024.0); }
+  }
+  free(times);
+  return 0;
 }
 
 int
@@ -197,6 +1024,7 @@ main(
     "-shared",
     "-fPIC",
     "-Wl,-undefined,dynamic_lookup",
+    "-pthread", // execprobe.c
   };
   size_t general_flags_len = STATIC_ARRAY_SIZE(general_flags);
 
@@ -208,6 +1036,13 @@ main(
   };
   size_t release_flags_len = STATIC_ARRAY_SIZE(release_flags);
 
+  // release with only luaopen_config exported: 41 fewer dynamic symbols and 29 fewer relocations,
+  // section gc, no plt, -Bsymbolic and lto changed nothing measurable on top of it and are left out
+  char *lean_flags[] = {
+    "-fvisibility=hidden",
+  };
+  size_t lean_flags_len = STATIC_ARRAY_SIZE(lean_flags);
+
   char *debug_flags[] = {
     "-Og",
     "-g",
@@ -215,12 +1050,24 @@ main(
   };
   size_t debug_flags_len = STATIC_ARRAY_SIZE(debug_flags);
 
+  // make_c matrix without --variant, the combinations that get shipped
+  char *default_variants[] = {
+    "",
+    "-DMODE_FORMATTER -DMODE_DESIGN -DMODE_THEME",
+    "-DMODE_FORMATTER -DMODE_DESIGN -DMODE_THEME -DMODE_FOCUS",
+    "-DPERFORMANCE -DMODE_FORMATTER -DMODE_DESIGN -DMODE_THEME -DMODE_FOCUS",
+    "-DDEBUG -DPERFORMANCE -DMODE_FORMATTER -DMODE_DESIGN -DMODE_THEME",
+  };
+  size_t default_variants_len = STATIC_ARRAY_SIZE(default_variants);
+
   char *source_names[] = {
     "config.c"
   };
   size_t source_names_len = STATIC_ARRAY_SIZE(source_names);
 
   char *output_name = "config.so";
+  char pkgfile_name[PATH_MAX]; // pkg-config output, kept while the .pc file does not change
+  snprintf(pkgfile_name, sizeof(pkgfile_name), "%s.pkg", output_name);
 
   /* arg parse */
   if(argc == 0) { return -1; }
@@ -235,7 +1082,16 @@ main(
   char *extra_args[ARGS_MAX] = {0};
   size_t extra_args_len = 0;
 
+  char *variants[VARIANTS_MAX] = {0};
+  size_t variants_len = 0;
+
   enum MakeMode make_mode = MakeMode_Debug;
+  int force = 0;
+  int bench = 0;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t jobs = cpus > 0 ? cpus : 1;
+  char *nvim = "nvim";
+  size_t runs = 20;
   while(argc > 0)
   {
     if(argv[0][0] != '-')
@@ -248,11 +1104,57 @@ main(
       {
         make_mode = MakeMode_Release;
       }
+      else if(strcmp(argv[0], "matrix") == 0)
+      {
+        make_mode = MakeMode_Matrix;
+      }
+      else if(strcmp(argv[0], "pgo") == 0)
+      {
+        make_mode = MakeMode_Pgo;
+      }
+      else if(strcmp(argv[0], "release-lean") == 0)
+      {
+        make_mode = MakeMode_ReleaseLean;
+      }
       else
       {
         PANIC_FMT("unknown make mode: %s\n", argv[0]);
       }
     }
+    else if(strcmp(argv[0], "--force") == 0)
+    {
+      force = 1;
+    }
+    else if(strcmp(argv[0], "--bench") == 0)
+    {
+      bench = 1;
+    }
+    else if(strncmp(argv[0], "-j", 2) == 0)
+    {
+      char *value = argv[0] + 2;
+      if(*value == 0 && argc > 1) { argv++; argc--; value = argv[0]; }
+      char *end = NULL;
+      long n = strtol(value, &end, 10);
+      ASSERT_FMT(*value != 0 && *end == 0 && n > 0, "expected a number of jobs, got '%s'\n", value);
+      jobs = n;
+    }
+    else if(strncmp(argv[0], "--variant=", sizeof("--variant=") - 1) == 0)
+    {
+      ASSERT(variants_len < VARIANTS_MAX, "too many variants\n");
+      variants[variants_len++] = argv[0] + sizeof("--variant=") - 1;
+    }
+    else if(strncmp(argv[0], "--runs=", sizeof("--runs=") - 1) == 0)
+    {
+      char *value = argv[0] + sizeof("--runs=") - 1;
+      char *end = NULL;
+      long n = strtol(value, &end, 10);
+      ASSERT_FMT(*value != 0 && *end == 0 && n > 0, "expected a number of runs, got '%s'\n", value);
+      runs = n;
+    }
+    else if(strncmp(argv[0], "--nvim=", sizeof("--nvim=") - 1) == 0)
+    {
+      nvim = argv[0] + sizeof("--nvim=") - 1;
+    }
     else if(strncmp(argv[0], "--makeprg=", sizeof("--makeprg=") - 1) == 0)
     {
       command.buffer[0] = argv[0] + sizeof("--makeprg=") - 1;
@@ -270,18 +1172,21 @@ main(
   ASSERT(push_array_command_builder(&command, general_flags, general_flags_len), "ran out of args\n");
 
   // pkg-config
-  char cflags[256] = {0}; // -I/path/to/lib
-  char libs[2 + PATH_MAX] = {0}; // arbitrary
-  if(!get_pkg_configs(cflags, sizeof(cflags), libs, sizeof(libs), envp))
+  char *cflags = NULL; // -I/path/to/lib
+  char *libs = NULL;
+  if(!get_pkg_configs("luajit", pkgfile_name, force, &cflags, &libs, envp))
   {
     PANIC("get pkg-config failed\n");
   }
-  ASSERT(push_command_builder(&command, cflags), "ran out of args\n");
-  ASSERT(push_command_builder(&command, libs), "ran out of args\n");
+  ASSERT(push_split_command_builder(&command, cflags), "ran out of args\n");
+  ASSERT(push_split_command_builder(&command, libs), "ran out of args\n");
 
   // extra_args
   ASSERT(push_array_command_builder(&command, extra_args, extra_args_len), "ran out of args\n");
 
+  struct CommandBuilder common = make_command_builder(ARGS_MAX); // before the mode flags, what --bench builds on
+  ASSERT(push_array_command_builder(&common, command.buffer, command.length), "ran out of args\n");
+
   switch(make_mode)
   {
   default: {
@@ -292,30 +1197,40 @@ main(
     ASSERT(push_array_command_builder(&command, debug_flags, debug_flags_len), "ran out of args\n");
   } break;
 
-  case MakeMode_Release: {
+  case MakeMode_Release:
+  case MakeMode_Matrix:
+  case MakeMode_Pgo: {
     ASSERT(push_array_command_builder(&command, release_flags, release_flags_len), "ran out of args\n");
   } break;
-  }
 
-  // source
-  ASSERT(push_array_command_builder(&command, source_names, source_names_len), "ran out of args\n");
+  case MakeMode_ReleaseLean: {
+    ASSERT(push_array_command_builder(&command, release_flags, release_flags_len), "ran out of args\n");
+    ASSERT(push_array_command_builder(&command, lean_flags, lean_flags_len), "ran out of args\n");
+  } break;
+  }
 
-  ASSERT(push_command_builder(&command, "-o"), "ran out of args\n");
-  ASSERT(push_command_builder(&command, output_name), "ran out of args\n");
+  if(make_mode == MakeMode_Matrix)
+  {
+    if(variants_len == 0) { return run_matrix(&command, default_variants, default_variants_len, source_names, source_names_len, jobs, force, envp); }
+    return run_matrix(&command, variants, variants_len, source_names, source_names_len, jobs, force, envp);
+  }
 
-  ASSERT(push_command_builder(&command, NULL), "ran out of args\n");
+  if(make_mode == MakeMode_Pgo)
+  {
+    return run_pgo(&command, source_names, source_names_len, output_name, nvim, runs, envp);
+  }
 
-  /* call the build */
-  for(size_t i = 0;
-      i < command.length - 1; // ignore the null
-      i++)
+  if(bench)
   {
-    printf("%s ", command.buffer[i]);
+    // the plain release next to this build, nvim loads neither
+    ASSERT(make_mode == MakeMode_ReleaseLean, "--bench only goes with release-lean\n");
+    char release_output[] = "config-release.so";
+    char lean_output[] = "config-lean.so";
+    char *outputs[] = { release_output, lean_output };
+    if(build_output(&common, release_flags, release_flags_len, source_names, source_names_len, release_output, 0, envp) != 0) { return 1; }
+    if(build_output(&command, NULL, 0, source_names, source_names_len, lean_output, force, envp) != 0) { return 1; }
+    return run_dlopen_bench(outputs, STATIC_ARRAY_SIZE(outputs), nvim, runs, envp);
   }
-  putchar('\n');
-  execve(command.buffer[0], command.buffer, envp);
 
-  /* exec failed */
-  PANIC_FMT("execve failed: error_code(%d): program('%s')\n", errno, command.buffer[0]);
-  return -1;
+  return build_output(&command, NULL, 0, source_names, source_names_len, output_name, force, envp);
 }
@@ -0,0 +1,476 @@
+#ifndef MODINDEX_C
+#define MODINDEX_C
+
+// Lua module name -> file, over every plugin below a few pack directories.
+// Resolving a module is one hash lookup instead of probing lua/<mod>.lua and
+// lua/<mod>/init.lua in every runtimepath entry.
+// The index is a snapshot file (snapshot.c): the pack directories with their mtimes first,
+// then each plugin followed by its modules. It is checked on the first lookup of a session, a pack directory
+// with another mtime (plugin added or removed) or an indexed file that is gone rebuilds it.
+// Lookups only see the plugins on the runtimepath, in its order: the file holds every plugin
+// (lazy ones are added to the runtimepath later) and the view is picked again when the runtimepath changes.
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/* TYPES */
+#define MODINDEX_ROOTS_MAX 4
+#define MODINDEX_PLUGINS_MAX 256
+#define MODINDEX_MODULES_MAX 4096
+#define MODINDEX_SLOTS (MODINDEX_MODULES_MAX * 2) // power of 2
+#define MODINDEX_STRINGS_BLOCK (64 * 1024)
+#define MODINDEX_DEPTH_MAX 16
+
+static_assert((MODINDEX_SLOTS & (MODINDEX_SLOTS - 1)) == 0, "slots are masked, not divided");
+static_assert(MODINDEX_MODULES_MAX < UINT16_MAX, "slots store module indices in 16 bits");
+
+#define MODINDEX_KIND_LIST \
+  MODINDEX_KIND_X(Root) \
+  MODINDEX_KIND_X(Plugin) \
+  MODINDEX_KIND_X(Module)
+
+enum Modindex_Kind : int
+{
+#define MODINDEX_KIND_X(n) Modindex_Kind_##n,
+  MODINDEX_KIND_LIST
+#undef MODINDEX_KIND_X
+  Modindex_Kind_Count,
+};
+
+struct ModindexModule
+{
+  char const *name;
+  char const *path;
+  uint name_len;
+  uint path_len;
+};
+
+// "<root>/<plugin>", its modules are modules[first, first + len)
+struct ModindexPlugin
+{
+  char const *dir;
+  uint dir_len;
+  uint first;
+  uint len;
+};
+
+struct ModuleIndex
+{
+  char path[PATH_MAX];
+  uint64_t key;
+
+  // pack directories, every child with a lua/ directory is a plugin
+  uint roots_len;
+  char roots[MODINDEX_ROOTS_MAX][PATH_MAX];
+  int64_t roots_mtime[MODINDEX_ROOTS_MAX];
+
+  struct Snapshot snapshot;
+  struct Arena strings; // names and paths of a rebuilt index
+  bool checked;
+  bool rebuilt;
+
+  uint plugins_len;
+  struct ModindexPlugin plugins[MODINDEX_PLUGINS_MAX];
+  uint modules_len;
+  struct ModindexModule modules[MODINDEX_MODULES_MAX];
+
+  // the modules of the plugins on the runtimepath, selected for runtimepath_hash
+  uint64_t runtimepath_hash;
+  bool selected;
+  uint selected_len;
+  uint16_t slots[MODINDEX_SLOTS]; // module index + 1, 0 is empty
+
+  uint rebuilds;
+};
+
+/* HELPERS */
+static inline uint
+modindex_slot(
+    char const *name,
+    uint name_len)
+{
+  return snapshot_hash(SNAPSHOT_FNV_OFFSET, name, name_len) & (MODINDEX_SLOTS - 1);
+}
+
+static inline int
+modindex_find_slot(
+    struct ModuleIndex const *restrict index,
+    char const *restrict name,
+    uint name_len)
+{
+  uint slot = modindex_slot(name, name_len);
+  for(;
+      index->slots[slot] != 0;
+      slot = (slot + 1) & (MODINDEX_SLOTS - 1))
+  {
+    struct ModindexModule const *m = &index->modules[index->slots[slot] - 1];
+    if(m->name_len == name_len && memcmp(m->name, name, name_len) == 0) { break; }
+  }
+  return slot;
+}
+
+static inline bool
+modindex_is_init(
+    char const *path,
+    uint path_len)
+{
+  return path_len >= 9 && memcmp(path + path_len - 9, "/init.lua", 9) == 0;
+}
+
+// the first module of a name wins, the plugins are selected in runtimepath order,
+// but inside one plugin lua/a.lua still comes before lua/a/init.lua
+static inline void
+modindex_select_module(
+    struct ModuleIndex *index,
+    uint idx)
+{
+  struct ModindexModule const *m = &index->modules[idx];
+  int slot = modindex_find_slot(index, m->name, m->name_len);
+  if(index->slots[slot] != 0)
+  {
+    struct ModindexModule const *other = &index->modules[index->slots[slot] - 1];
+    uint root_len = m->path_len - (modindex_is_init(m->path, m->path_len) ? 9 : 4) - m->name_len; // "<root>/lua/"
+    if(modindex_is_init(other->path, other->path_len) && !modindex_is_init(m->path, m->path_len)
+        && other->path_len > root_len && memcmp(other->path, m->path, root_len) == 0)
+    {
+      index->slots[slot] = idx + 1;
+    }
+    return;
+  }
+  index->slots[slot] = idx + 1;
+  index->selected_len += 1;
+}
+
+// the runtimepath entries that are indexed plugins, in runtimepath order
+static inline void
+modindex_select(
+    struct ModuleIndex *restrict index,
+    char const *restrict runtimepath,
+    uint runtimepath_len,
+    uint64_t runtimepath_hash)
+{
+  memset(index->slots, 0, sizeof(index->slots));
+  index->selected_len = 0;
+  index->selected = true;
+  index->runtimepath_hash = runtimepath_hash;
+
+  for(uint begin = 0, end = 0;
+      begin < runtimepath_len;
+      begin = end + 1)
+  {
+    char const *comma = memchr(runtimepath + begin, ',', runtimepath_len - begin);
+    end = comma != NULL ? (uint)(comma - runtimepath) : runtimepath_len;
+    uint entry_len = end - begin;
+    while(entry_len > 1 && runtimepath[begin + entry_len - 1] == '/') { entry_len -= 1; }
+
+    for(uint i = 0;
+        i < index->plugins_len;
+        i += 1)
+    {
+      struct ModindexPlugin const *p = &index->plugins[i];
+      if(p->dir_len != entry_len || memcmp(p->dir, runtimepath + begin, entry_len) != 0) { continue; }
+      for(uint j = 0;
+          j < p->len;
+          j += 1)
+      {
+        modindex_select_module(index, p->first + j);
+      }
+      break;
+    }
+  }
+}
+
+// modules are added to the last plugin
+static inline void
+modindex_add_plugin(
+    struct ModuleIndex *restrict index,
+    char const *restrict dir,
+    uint dir_len)
+{
+  if(index->plugins_len >= MODINDEX_PLUGINS_MAX) { return; }
+  index->plugins[index->plugins_len++] = (struct ModindexPlugin){ dir, dir_len, index->modules_len, 0 };
+}
+
+static inline void
+modindex_add_module(
+    struct ModuleIndex *restrict index,
+    char const *restrict name,
+    uint name_len,
+    char const *restrict path,
+    uint path_len)
+{
+  if(index->plugins_len == 0 || index->modules_len >= MODINDEX_MODULES_MAX) { return; }
+  index->modules[index->modules_len++] = (struct ModindexModule){ name, path, name_len, path_len };
+  index->plugins[index->plugins_len - 1].len += 1;
+}
+
+static inline char const *
+modindex_copy(
+    struct ModuleIndex *restrict index,
+    char const *restrict s,
+    uint s_len)
+{
+  return push_string_arena(&index->strings, s, s_len);
+}
+
+// path holds "<plugin>/lua/<dir>", module the dotted name of <dir> (empty at the top)
+static inline void
+modindex_walk(
+    struct ModuleIndex *restrict index,
+    char *restrict path,
+    uint path_len,
+    char *restrict module,
+    uint module_len,
+    uint depth)
+{
+  if(depth >= MODINDEX_DEPTH_MAX) { return; }
+
+  DIR *dir = opendir(path);
+  if(dir == NULL) { return; }
+
+  struct dirent *e;
+  while((e = readdir(dir)) != NULL)
+  {
+    if(e->d_name[0] == '.') { continue; }
+    uint name_len = strlen(e->d_name);
+    if(path_len + 1 + name_len + 1 > PATH_MAX || module_len + 1 + name_len + 1 > PATH_MAX) { continue; }
+
+    path[path_len] = '/';
+    memcpy(path + path_len + 1, e->d_name, name_len + 1);
+    uint child_len = path_len + 1 + name_len;
+
+    uint child_module_len = module_len;
+    if(module_len > 0) { module[child_module_len++] = '.'; }
+
+    bool is_dir = e->d_type == DT_DIR;
+    if(e->d_type == DT_UNKNOWN || e->d_type == DT_LNK)
+    {
+      struct stat st;
+      is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    if(is_dir)
+    {
+      memcpy(module + child_module_len, e->d_name, name_len);
+      modindex_walk(index, path, child_len, module, child_module_len + name_len, depth + 1);
+    }
+    else if(name_len > 4 && memcmp(e->d_name + name_len - 4, ".lua", 4) == 0)
+    {
+      // lua/a/init.lua is module "a"
+      uint stem_len = name_len - 4;
+      bool is_init = stem_len == 4 && memcmp(e->d_name, "init", 4) == 0;
+      uint full_len = is_init ? module_len : child_module_len + stem_len;
+      if(!is_init) { memcpy(module + child_module_len, e->d_name, stem_len); }
+      if(full_len > 0)
+      {
+        char const *name = modindex_copy(index, module, full_len);
+        char const *file = modindex_copy(index, path, child_len);
+        if(name != NULL && file != NULL) { modindex_add_module(index, name, full_len, file, child_len); }
+      }
+    }
+  }
+  path[path_len] = 0;
+  closedir(dir);
+}
+
+/* API */
+// maps the index at path, roots are the pack directories ("<site>/pack/deps/opt", ...)
+static inline void
+open_module_index(
+    struct ModuleIndex *restrict index,
+    char const *restrict path,
+    uint64_t key,
+    char const *const *restrict roots,
+    uint roots_len)
+{
+  memset(index, 0, sizeof(*index));
+  snprintf(index->path, sizeof(index->path), "%s", path);
+  index->key = key;
+  index->roots_len = Min(roots_len, MODINDEX_ROOTS_MAX);
+  for(uint i = 0;
+      i < index->roots_len;
+      i += 1)
+  {
+    snprintf(index->roots[i], sizeof(index->roots[i]), "%s", roots[i]);
+    index->roots_mtime[i] = -1;
+  }
+
+  if(!open_snapshot(&index->snapshot, path, key)) { return; }
+
+  struct Snapshot const *s = &index->snapshot;
+  uint root = 0;
+  bool orphans = false;
+  for(uint i = 0;
+      i < s->header->records_len;
+      i += 1)
+  {
+    struct SnapshotRecord const *r = &s->records[i];
+    if(r->kind == Modindex_Kind_Root && root < index->roots_len)
+    {
+      // a different list of roots never matches, the mtimes stay -1
+      if(strcmp(snapshot_string(s, r, 0), index->roots[root]) == 0) { index->roots_mtime[root] = r->integer; }
+      root += 1;
+    }
+    else if(r->kind == Modindex_Kind_Plugin)
+    {
+      modindex_add_plugin(index, snapshot_string(s, r, 0), r->str_len[0]);
+    }
+    else if(r->kind == Modindex_Kind_Module)
+    {
+      orphans = orphans || index->plugins_len == 0;
+      modindex_add_module(index, snapshot_string(s, r, 0), r->str_len[0], snapshot_string(s, r, 1), r->str_len[1]);
+    }
+  }
+
+  // modules without their plugin, an index from before plugins were recorded
+  if(orphans && index->roots_len > 0) { index->roots_mtime[0] = -1; }
+}
+
+static inline uint
+write_module_index(
+    struct ModuleIndex *index)
+{
+  if(index->key == 0) { return 1; }
+
+  struct SnapshotWriter w;
+  uint records_len = index->roots_len + index->plugins_len + index->modules_len;
+  if(!init_snapshot_writer(&w, records_len, index->strings.length + PATH_MAX * MODINDEX_ROOTS_MAX))
+  {
+    return 0;
+  }
+
+  uint ok = 1;
+  for(uint i = 0;
+      ok && i < index->roots_len;
+      i += 1)
+  {
+    struct SnapshotSlice root = { index->roots[i], strlen(index->roots[i]) };
+    ok = push_snapshot_record(&w, Modindex_Kind_Root, 0, index->roots_mtime[i], &root, 1);
+  }
+  for(uint i = 0;
+      ok && i < index->plugins_len;
+      i += 1)
+  {
+    struct ModindexPlugin const *p = &index->plugins[i];
+    struct SnapshotSlice dir = { p->dir, p->dir_len };
+    ok = push_snapshot_record(&w, Modindex_Kind_Plugin, 0, 0, &dir, 1);
+    for(uint j = p->first;
+        ok && j < p->first + p->len;
+        j += 1)
+    {
+      struct SnapshotSlice strs[2] = {
+        { index->modules[j].name, index->modules[j].name_len },
+        { index->modules[j].path, index->modules[j].path_len },
+      };
+      ok = push_snapshot_record(&w, Modindex_Kind_Module, 0, 0, strs, STATIC_ARRAY_SIZE(strs));
+    }
+  }
+
+  ok = ok && write_snapshot(&w, index->path, index->key);
+  deinit_snapshot_writer(&w);
+  return ok;
+}
+
+// walks every plugin of every root again and persists the result
+static inline void
+rebuild_module_index(
+    struct ModuleIndex *index)
+{
+  index->rebuilt = true;
+  index->checked = true;
+  index->rebuilds += 1;
+  index->plugins_len = 0;
+  index->modules_len = 0;
+  index->selected = false;
+  close_snapshot(&index->snapshot);
+  if(index->strings.block == NULL && !init_arena(&index->strings, MODINDEX_STRINGS_BLOCK)) { return; }
+  clear_arena(&index->strings);
+
+  char path[PATH_MAX];
+  char module[PATH_MAX];
+  for(uint i = 0;
+      i < index->roots_len;
+      i += 1)
+  {
+    index->roots_mtime[i] = mtime_ns(index->roots[i]);
+
+    DIR *dir = opendir(index->roots[i]);
+    if(dir == NULL) { continue; }
+    struct dirent *e;
+    while((e = readdir(dir)) != NULL)
+    {
+      if(e->d_name[0] == '.') { continue; }
+      int path_len = snprintf(path, sizeof(path), "%s/%s/lua", index->roots[i], e->d_name);
+      if(path_len <= 0 || path_len >= (int)sizeof(path)) { continue; }
+      char const *dir = modindex_copy(index, path, path_len - 4); // without /lua
+      if(dir == NULL) { continue; }
+      modindex_add_plugin(index, dir, path_len - 4);
+      modindex_walk(index, path, path_len, module, 0, 0);
+      if(index->plugins_len > 0 && index->plugins[index->plugins_len - 1].len == 0) { index->plugins_len -= 1; }
+    }
+    closedir(dir);
+  }
+
+  write_module_index(index);
+}
+
+// NULL when the module is not in a plugin on runtimepath, the caller falls back to searching it then
+static inline char const *
+find_module_index(
+    struct ModuleIndex *restrict index,
+    char const *restrict name,
+    uint name_len,
+    char const *restrict runtimepath,
+    uint runtimepath_len)
+{
+  if(!index->checked)
+  {
+    index->checked = true;
+    for(uint i = 0;
+        i < index->roots_len;
+        i += 1)
+    {
+      if(mtime_ns(index->roots[i]) != index->roots_mtime[i])
+      {
+        rebuild_module_index(index);
+        break;
+      }
+    }
+  }
+
+  uint64_t runtimepath_hash = snapshot_hash(SNAPSHOT_FNV_OFFSET, runtimepath, runtimepath_len);
+  if(!index->selected || index->runtimepath_hash != runtimepath_hash)
+  {
+    modindex_select(index, runtimepath, runtimepath_len, runtimepath_hash);
+  }
+
+  uint slot = modindex_find_slot(index, name, name_len);
+  return index->slots[slot] == 0 ? NULL : index->modules[index->slots[slot] - 1].path;
+}
+
+// an indexed file is gone, rebuild once per session; returns whether the caller should look again
+static inline bool
+stale_module_index(
+    struct ModuleIndex *index)
+{
+  if(index->rebuilt) { return false; }
+  rebuild_module_index(index);
+  return true;
+}
+
+static inline void
+close_module_index(
+    struct ModuleIndex *index)
+{
+  close_snapshot(&index->snapshot);
+  deinit_arena(&index->strings);
+  index->plugins_len = 0;
+  index->modules_len = 0;
+  index->selected = false;
+  memset(index->slots, 0, sizeof(index->slots));
+}
+#endif
+
+#endif // MODINDEX_C
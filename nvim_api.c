@@ -120,6 +120,11 @@ struct object {
   } data;
 };
 
+struct key_value_pair {
+  String key;
+  Object value;
+};
+
 typedef uint64_t OptionalKeys;
 // END
 
@@ -198,6 +203,14 @@ typedef struct {
   Boolean force;
   String url;
 } Dict(highlight);
+
+typedef struct {
+  OptionalKeys is_set__get_highlight_;
+  Integer id;
+  String name;
+  Boolean link;
+  Boolean create;
+} Dict(get_highlight);
 // END
 
 // BEGIN https://github.com/neovim/neovim/blob/master/src/nvim/os/stdpaths_defs.h#L12
@@ -263,6 +276,11 @@ typedef enum {
 #define KEYSET_OPTIDX_highlight__underdouble 29
 #define KEYSET_OPTIDX_highlight__strikethrough 30
 
+#define KEYSET_OPTIDX_get_highlight__id 1
+#define KEYSET_OPTIDX_get_highlight__link 2
+#define KEYSET_OPTIDX_get_highlight__name 3
+#define KEYSET_OPTIDX_get_highlight__create 4
+
 #define KEYSET_OPTIDX_keymap__desc 1
 #define KEYSET_OPTIDX_keymap__expr 2
 #define KEYSET_OPTIDX_keymap__script 3
@@ -291,24 +309,38 @@ extern char *runtimepath_default(bool clean_arg);
 
 extern void nvim_set_option_value(uint64_t channel_id, String name, Object value, Dict(option) * opts, Error *err);
 extern Object nvim_get_option_value(String name, Dict(option) *opts, Error *err);
+extern void api_free_object(Object value);
+extern void api_clear_error(Error *value);
 
 extern void nvim_set_var(String name, Object value, Error *err);
 extern void nvim_set_keymap(uint64_t channel_id, String mode, String lhs, String rhs, Dict(keymap) * opts, Error *err);
 extern void nvim_set_hl(uint64_t channel_id, Integer ns_id, String name, Dict(highlight) *val, Error *err);
+extern DictOf(Dict(highlight)) nvim_get_hl(Integer ns_id, Dict(get_highlight) *opts, Arena *arena, Error *err);
+extern ArenaMem arena_finish(Arena *arena);
+extern void arena_mem_free(ArenaMem mem);
 extern void nvim_buf_set_keymap(uint64_t channel_id, Buffer buffer, String mode, String lhs, String rhs, Dict(keymap) *opts, Error *err);
+extern void nvim_del_keymap(uint64_t channel_id, String mode, String lhs, Error *err);
 
 extern Buffer nvim_get_current_buf(void);
 extern ArrayOf(String) nvim_buf_get_lines(
     uint64_t channel_id, Buffer buffer, Integer start, Integer end, Boolean strict_indexing, Arena *arena, lua_State *lstate, Error *err);
 
+extern Integer nvim_buf_line_count(Buffer buffer, Error *err);
+extern void nvim_buf_set_text(
+    uint64_t channel_id, Buffer buffer, Integer start_row, Integer start_col, Integer end_row, Integer end_col,
+    ArrayOf(String) replacement, Arena *arena, Error *err);
+
 extern String nvim_get_current_line(Arena *arena, Error *err);
 extern ArrayOf(Buffer) nvim_list_bufs(Arena *arena);
 extern Boolean nvim_buf_is_loaded(Buffer buffer);
+extern Boolean nvim_buf_is_valid(Buffer buffer);
+extern String nvim_buf_get_name(Buffer buffer, Error *err);
 extern ArrayOf(Integer, 2) nvim_win_get_cursor(Window window, Arena *arena, Error *err);
 
 extern Integer nvim_create_augroup(
     uint64_t channel_id, String name, Dict(create_augroup) *opts, Error *err);
 extern Integer nvim_create_autocmd(
     uint64_t channel_id, Object event, Dict(create_autocmd) *opts, Arena *arena, Error *err);
+extern void nvim_del_autocmd(Integer id, Error *err);
 
 #endif // NVIM_API_C
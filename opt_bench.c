@@ -0,0 +1,393 @@
+// Benchmark of the Opt phase of luaopen_config: vars, options and keymaps applied from static tables
+// (lengths from sizeof, one opts dict and error for the loop) against the call per entry they replaced
+// (strlen of every string, opts and error set up per call). The entries are the ones of config.c.
+// The nvim setters are stand-ins that hash what they get: the work nvim does for each option is the same
+// either way and is not in here, the PERFORMANCE report times the whole phase inside nvim.
+// Not part of config.so, build and run it by hand:
+//   gcc -std=c23 -O3 -march=native opt_bench.c -o opt_bench && ./opt_bench
+
+#define _GNU_SOURCE // clock_gettime under -std=c23
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int uint;
+#define STATIC_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+typedef struct lua_State lua_State;
+#include "nvim_api.c"
+
+/* TYPES */
+#define BENCH_ROUNDS 100'000
+
+#define BENCH_VAR_LIST \
+  BENCH_VAR_X("mapleader", STRING, " ") \
+  BENCH_VAR_X("maplocalleader", STRING, ",")
+
+#define BENCH_OPTION_LIST \
+  BENCH_OPTION_X("number", BOOL, true) \
+  BENCH_OPTION_X("relativenumber", BOOL, true) \
+  BENCH_OPTION_X("mouse", STRING, "a") \
+  BENCH_OPTION_X("undofile", BOOL, true) \
+  BENCH_OPTION_X("ignorecase", BOOL, true) \
+  BENCH_OPTION_X("smartcase", BOOL, true) \
+  BENCH_OPTION_X("signcolumn", STRING, "yes") \
+  BENCH_OPTION_X("updatetime", INT, 50) \
+  BENCH_OPTION_X("timeout", BOOL, true) \
+  BENCH_OPTION_X("timeoutlen", INT, 1'000) \
+  BENCH_OPTION_X("splitright", BOOL, true) \
+  BENCH_OPTION_X("splitbelow", BOOL, true) \
+  BENCH_OPTION_X("list", BOOL, true) \
+  BENCH_OPTION_X("listchars", STRING, "tab:» ,trail:·,nbsp:␣,extends:⟩") \
+  BENCH_OPTION_X("inccommand", STRING, "split") \
+  BENCH_OPTION_X("sidescrolloff", INT, 20) \
+  BENCH_OPTION_X("tabstop", INT, 4) \
+  BENCH_OPTION_X("softtabstop", INT, 4) \
+  BENCH_OPTION_X("shiftwidth", INT, 4) \
+  BENCH_OPTION_X("expandtab", BOOL, true) \
+  BENCH_OPTION_X("colorcolumn", STRING, "80") \
+  BENCH_OPTION_X("showbreak", STRING, "└▶") \
+  BENCH_OPTION_X("wrap", BOOL, true) \
+  BENCH_OPTION_X("linebreak", BOOL, true) \
+  BENCH_OPTION_X("breakindent", BOOL, true) \
+  BENCH_OPTION_X("breakindentopt", STRING, "list:-1") \
+  BENCH_OPTION_X("guicursor", STRING, "n-v-c:block") \
+  BENCH_OPTION_X("cinkeys", STRING, "0{,0},0),0],:,!^F,o,O,e") \
+  BENCH_OPTION_X("cinoptions", STRING, ":0,l1,b1,=0") \
+  BENCH_OPTION_X("autoread", BOOL, true) \
+  BENCH_OPTION_X("wildmode", STRING, "longest:full") \
+  BENCH_OPTION_X("wildmenu", BOOL, true) \
+  BENCH_OPTION_X("completeopt", STRING, "longest,noselect") \
+  BENCH_OPTION_X("hlsearch", BOOL, true)
+
+#define BENCH_KEYMAP_LIST \
+  BENCH_KEYMAP_X(KEYMAP, "i", "<c-space>", "<c-x><c-o>") \
+  BENCH_KEYMAP_X(KEYMAP, "t", "<C-w>", "<c-\\><c-n><C-w>") \
+  BENCH_KEYMAP_X(KEYMAP, "n", "j", "gj") \
+  BENCH_KEYMAP_X(KEYMAP, "n", "k", "gk") \
+  BENCH_KEYMAP_X(KEYMAP, "v", "j", "gj") \
+  BENCH_KEYMAP_X(KEYMAP, "v", "k", "gk") \
+  BENCH_KEYMAP_X(KEYMAP, "n", "<leader>y", "\"+y") \
+  BENCH_KEYMAP_X(KEYMAP, "v", "<leader>y", "\"+y") \
+  BENCH_KEYMAP_X(KEYMAP, "n", "<leader>Y", "\"+Y") \
+  BENCH_KEYMAP_X(KEYMAP, "n", "<esc>", "<cmd>nohlsearch<cr><esc>") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>uq", "copen") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>ul", "lopen") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>cm", "Man") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>tw", "lua vim.o.wrap = not vim.o.wrap") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>mm", "make") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>um", "messages") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>th", "ColorizerToggle") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>v", "vsp") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>wv", "vsp") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>x", "sp") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>wx", "sp") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>wt", "tab split") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>w|", "vertical resize") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>w_", "horizontal resize") \
+  BENCH_KEYMAP_X(KEYMAP_CMD, "n", "<leader>ws", "wincmd =") \
+  BENCH_KEYMAP_X(KEYMAP, "n", "<leader>wf", "<cmd>horizontal resize<cr><cmd>vertical resize<cr>")
+
+// what config.c has now
+#define NVIM_STRING_LIT(s) { .data = "" s, .size = sizeof("" s) - 1 }
+#define NVIM_OBJ_STRING_LIT(s) { .type = kObjectTypeString, .data.string = NVIM_STRING_LIT(s) }
+#define NVIM_OBJ_BOOL_LIT(b) { .type = kObjectTypeBoolean, .data.boolean = (b) }
+#define NVIM_OBJ_INT_LIT(i) { .type = kObjectTypeInteger, .data.integer = (i) }
+
+struct NvimSetting
+{
+  String key;
+  Object val;
+};
+
+struct NvimKeymap
+{
+  String mode;
+  String key;
+  String action;
+};
+
+#define NVIM_SETTING(k, v) { .key = NVIM_STRING_LIT(k), .val = v }
+#define NVIM_KEYMAP(m, k, a) { .mode = NVIM_STRING_LIT(m), .key = NVIM_STRING_LIT(k), .action = NVIM_STRING_LIT(a) }
+#define NVIM_KEYMAP_CMD(m, k, a) NVIM_KEYMAP(m, k, "<cmd>" a "<cr>")
+
+/* HELPERS */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_nsec;
+}
+
+// keep the optimizer from dropping the work
+static volatile uint64_t g_sink;
+
+static inline uint64_t
+bench_hash(
+    uint64_t h,
+    String s)
+{
+  for(size_t i = 0;
+      i < s.size;
+      i += 1)
+  {
+    h = (h ^ (uint8_t)s.data[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static inline uint64_t
+bench_hash_object(
+    uint64_t h,
+    Object o)
+{
+  if(o.type == kObjectTypeString) { return bench_hash(h, o.data.string); }
+  return (h ^ (uint64_t)o.data.integer) * 0x100000001b3ULL;
+}
+
+// the nvim api, the lookup of the name stands for what nvim does
+__attribute__((noinline)) void
+nvim_set_var(
+    String name,
+    Object value,
+    Error *err)
+{
+  g_sink += bench_hash_object(bench_hash(0xcbf29ce484222325ULL, name), value);
+  err->type = kErrorTypeNone;
+}
+
+__attribute__((noinline)) void
+nvim_set_option_value(
+    uint64_t channel_id,
+    String name,
+    Object value,
+    Dict(option) *opts,
+    Error *err)
+{
+  g_sink += bench_hash_object(bench_hash(0xcbf29ce484222325ULL, name), value) + channel_id + opts->is_set__option_;
+  err->type = kErrorTypeNone;
+}
+
+__attribute__((noinline)) void
+nvim_set_keymap(
+    uint64_t channel_id,
+    String mode,
+    String lhs,
+    String rhs,
+    Dict(keymap) *opts,
+    Error *err)
+{
+  uint64_t h = bench_hash(bench_hash(bench_hash(0xcbf29ce484222325ULL, mode), lhs), rhs);
+  g_sink += h + channel_id + opts->is_set__keymap_;
+  err->type = kErrorTypeNone;
+}
+
+// the helpers config.c used before the tables, one call per entry
+static inline String
+nvim_mk_string(
+    char *s)
+{
+  return (String){ .data = s, .size = strlen(s) };
+}
+
+static inline Object
+nvim_mk_obj_bool(
+    bool b)
+{
+  return (Object){ .type = kObjectTypeBoolean, .data.boolean = b };
+}
+
+static inline Object
+nvim_mk_obj_int(
+    Integer i)
+{
+  return (Object){ .type = kObjectTypeInteger, .data.integer = i };
+}
+
+static inline Object
+nvim_mk_obj_string(
+    char *s)
+{
+  return (Object){ .type = kObjectTypeString, .data.string = nvim_mk_string(s) };
+}
+
+#define BENCH_OLD_OBJ_BOOL(v) nvim_mk_obj_bool(v)
+#define BENCH_OLD_OBJ_INT(v) nvim_mk_obj_int(v)
+#define BENCH_OLD_OBJ_STRING(v) nvim_mk_obj_string(v)
+
+static inline void
+nvim_set_g(
+    char *key,
+    Object val)
+{
+  Error e = ERROR_INIT;
+  nvim_set_var(nvim_mk_string(key), val, &e);
+  if(e.type != kErrorTypeNone) { abort(); }
+}
+
+static inline void
+nvim_set_o(
+    char *key,
+    Object val)
+{
+  Dict(option) o = {0};
+  Error e = ERROR_INIT;
+  nvim_set_option_value(0, nvim_mk_string(key), val, &o, &e);
+  if(e.type != kErrorTypeNone) { abort(); }
+}
+
+static inline void
+nvim_map(
+    char *mode,
+    char *key,
+    char *action)
+{
+  Dict(keymap) o = {0};
+  PUT_KEY(o, keymap, noremap, true);
+  PUT_KEY(o, keymap, silent, true);
+  Error e = ERROR_INIT;
+  nvim_set_keymap(0, nvim_mk_string(mode), nvim_mk_string(key), nvim_mk_string(action), &o, &e);
+  if(e.type != kErrorTypeNone) { abort(); }
+}
+
+#define BENCH_OLD_KEYMAP(m, k, a) nvim_map(m, k, a)
+#define BENCH_OLD_KEYMAP_CMD(m, k, a) nvim_map(m, k, "<cmd>" a "<cr>")
+
+// the tables and loops config.c has now
+static struct NvimSetting const g_vars[] =
+{
+#define BENCH_VAR_X(n, kind, v) NVIM_SETTING(n, NVIM_OBJ_##kind##_LIT(v)),
+  BENCH_VAR_LIST
+#undef BENCH_VAR_X
+};
+
+static struct NvimSetting const g_options[] =
+{
+#define BENCH_OPTION_X(n, kind, v) NVIM_SETTING(n, NVIM_OBJ_##kind##_LIT(v)),
+  BENCH_OPTION_LIST
+#undef BENCH_OPTION_X
+};
+
+static struct NvimKeymap const g_keymaps[] =
+{
+#define BENCH_KEYMAP_X(kind, m, k, a) NVIM_##kind(m, k, a),
+  BENCH_KEYMAP_LIST
+#undef BENCH_KEYMAP_X
+};
+
+static inline void
+nvim_set_g_table(
+    struct NvimSetting const *vars,
+    uint vars_len)
+{
+  Error e = ERROR_INIT;
+  for(uint i = 0;
+      i < vars_len;
+      i += 1)
+  {
+    nvim_set_var(vars[i].key, vars[i].val, &e);
+    if(e.type != kErrorTypeNone) { abort(); }
+  }
+}
+
+static inline void
+nvim_set_o_table(
+    struct NvimSetting const *opts,
+    uint opts_len)
+{
+  Dict(option) o = {0};
+  Error e = ERROR_INIT;
+  for(uint i = 0;
+      i < opts_len;
+      i += 1)
+  {
+    nvim_set_option_value(0, opts[i].key, opts[i].val, &o, &e);
+    if(e.type != kErrorTypeNone) { abort(); }
+  }
+}
+
+static inline void
+nvim_map_table(
+    struct NvimKeymap const *maps,
+    uint maps_len)
+{
+  Dict(keymap) o = {0};
+  PUT_KEY(o, keymap, noremap, true);
+  PUT_KEY(o, keymap, silent, true);
+  Error e = ERROR_INIT;
+  for(uint i = 0;
+      i < maps_len;
+      i += 1)
+  {
+    nvim_set_keymap(0, maps[i].mode, maps[i].key, maps[i].action, &o, &e);
+    if(e.type != kErrorTypeNone) { abort(); }
+  }
+}
+
+/* BENCHMARKS */
+__attribute__((noinline)) static void
+bench_opt_calls(void)
+{
+#define BENCH_VAR_X(n, kind, v) nvim_set_g(n, BENCH_OLD_OBJ_##kind(v));
+  BENCH_VAR_LIST
+#undef BENCH_VAR_X
+#define BENCH_OPTION_X(n, kind, v) nvim_set_o(n, BENCH_OLD_OBJ_##kind(v));
+  BENCH_OPTION_LIST
+#undef BENCH_OPTION_X
+#define BENCH_KEYMAP_X(kind, m, k, a) BENCH_OLD_##kind(m, k, a);
+  BENCH_KEYMAP_LIST
+#undef BENCH_KEYMAP_X
+}
+
+__attribute__((noinline)) static void
+bench_opt_tables(void)
+{
+  nvim_set_g_table(g_vars, STATIC_ARRAY_SIZE(g_vars));
+  nvim_set_o_table(g_options, STATIC_ARRAY_SIZE(g_options));
+  nvim_map_table(g_keymaps, STATIC_ARRAY_SIZE(g_keymaps));
+}
+
+static uint64_t
+bench_phase(
+    void (*phase)(void))
+{
+  uint64_t t0 = bench_now_ns();
+  for(uint r = 0;
+      r < BENCH_ROUNDS;
+      r += 1)
+  {
+    phase();
+  }
+  return bench_now_ns() - t0;
+}
+
+int
+main(void)
+{
+  uint entries = STATIC_ARRAY_SIZE(g_vars) + STATIC_ARRAY_SIZE(g_options) + STATIC_ARRAY_SIZE(g_keymaps);
+  printf("Opt phase: %zu vars, %zu options, %zu keymaps, %u rounds\n",
+      STATIC_ARRAY_SIZE(g_vars), STATIC_ARRAY_SIZE(g_options), STATIC_ARRAY_SIZE(g_keymaps), BENCH_ROUNDS);
+
+  // the two take turns, the best of each counts
+  uint64_t calls_ns = UINT64_MAX;
+  uint64_t tables_ns = UINT64_MAX;
+  for(uint i = 0;
+      i < 5;
+      i += 1)
+  {
+    uint64_t c = bench_phase(bench_opt_calls);
+    uint64_t t = bench_phase(bench_opt_tables);
+    if(c < calls_ns) { calls_ns = c; }
+    if(t < tables_ns) { tables_ns = t; }
+  }
+  printf("%-28s %8.1f ns/phase %6.2f ns/entry\n", "call per entry (before)",
+      (double)calls_ns / BENCH_ROUNDS, (double)calls_ns / BENCH_ROUNDS / entries);
+  printf("%-28s %8.1f ns/phase %6.2f ns/entry  (%.2fx)\n", "static tables (after)",
+      (double)tables_ns / BENCH_ROUNDS, (double)tables_ns / BENCH_ROUNDS / entries,
+      tables_ns > 0 ? (double)calls_ns / (double)tables_ns : 0.0);
+  return 0;
+}
@@ -0,0 +1,388 @@
+#ifndef SNAPSHOT_C
+#define SNAPSHOT_C
+
+// Binary snapshot of state the config computes once and keeps across starts
+// (the bytecode pack, the module index, the helptags stamps).
+// One start writes a flat file (header, fixed size records, one string blob),
+// later starts mmap it and read the records in place. The file is only trusted
+// when its key matches, the key covers whatever the caller mixes in.
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* TYPES */
+#define SNAPSHOT_MAGIC 0x70616e73 // "snap"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_STRINGS_PER_RECORD 3
+#define SNAPSHOT_BUILD_ID_MAX 64
+
+#define SNAPSHOT_FNV_OFFSET 0xcbf29ce484222325ULL
+#define SNAPSHOT_FNV_PRIME 0x100000001b3ULL
+
+struct SnapshotHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t records_len;
+  uint32_t strings_len;
+};
+
+// meaning of kind, type, integer and the strings is up to the caller
+// strings are nul terminated inside the blob, len does not count the nul
+struct SnapshotRecord
+{
+  uint32_t kind;
+  uint32_t type;
+  int64_t integer;
+  uint32_t str_off[SNAPSHOT_STRINGS_PER_RECORD];
+  uint32_t str_len[SNAPSHOT_STRINGS_PER_RECORD];
+};
+
+struct SnapshotSlice
+{
+  char const *data;
+  uint len;
+};
+
+// records and strings are addressed by offset and written in one go, so they stay contiguous
+struct SnapshotBuffer
+{
+  uint length;
+  uint capacity;
+  char *buffer;
+};
+
+struct SnapshotWriter
+{
+  struct SnapshotBuffer records;
+  struct SnapshotBuffer strings;
+};
+
+struct Snapshot
+{
+  struct FileView view;
+  struct SnapshotHeader const *header;
+  struct SnapshotRecord const *records;
+  char const *strings;
+};
+
+struct SnapshotBuildId
+{
+  ElfW(Addr) base;
+  uint len;
+  uint8_t bytes[SNAPSHOT_BUILD_ID_MAX];
+};
+
+/* HELPERS */
+static inline uint64_t
+snapshot_hash(
+    uint64_t h,
+    void const *data,
+    size_t len)
+{
+  uint8_t const *p = data;
+  for(size_t i = 0;
+      i < len;
+      i += 1)
+  {
+    h = (h ^ p[i]) * SNAPSHOT_FNV_PRIME;
+  }
+  return h;
+}
+
+static inline uint64_t
+snapshot_hash_string(
+    uint64_t h,
+    char const *s)
+{
+  if(s == NULL) { return snapshot_hash(h, "", 1); }
+  return snapshot_hash(h, s, strlen(s) + 1); // keep the nul, "ab" + "c" != "a" + "bc"
+}
+
+static int
+snapshot_find_build_id(
+    struct dl_phdr_info *info,
+    size_t size,
+    void *data)
+{
+  (void)size;
+  struct SnapshotBuildId *id = data;
+  if(info->dlpi_addr != id->base) { return 0; }
+
+  for(uint i = 0;
+      i < info->dlpi_phnum;
+      i += 1)
+  {
+    ElfW(Phdr) const *ph = &info->dlpi_phdr[i];
+    if(ph->p_type != PT_NOTE) { continue; }
+
+    uint8_t const *note = (uint8_t const *)(info->dlpi_addr + ph->p_vaddr);
+    uint8_t const *note_end = note + ph->p_memsz;
+    while(note + sizeof(ElfW(Nhdr)) <= note_end)
+    {
+      ElfW(Nhdr) const *n = (ElfW(Nhdr) const *)note;
+      uint8_t const *name = note + sizeof(*n);
+      uint8_t const *desc = name + ((n->n_namesz + 3) & ~3u);
+      note = desc + ((n->n_descsz + 3) & ~3u);
+      if(note > note_end) { break; }
+
+      if(n->n_type == NT_GNU_BUILD_ID && n->n_namesz == 4 && memcmp(name, "GNU", 4) == 0)
+      {
+        id->len = Min(n->n_descsz, SNAPSHOT_BUILD_ID_MAX);
+        memcpy(id->bytes, desc, id->len);
+        return 1;
+      }
+    }
+  }
+  return 1; // right object, no build-id
+}
+
+static inline uint
+snapshot_buffer_push(
+    struct SnapshotBuffer *restrict b,
+    void const *restrict data,
+    uint len)
+{
+  if(len > b->capacity - b->length)
+  {
+    if(len > UINT32_MAX / 2 - b->length) { return 0; }
+    uint capacity = Max(b->capacity * 2, b->length + len);
+    char *buffer = realloc(b->buffer, capacity);
+    if(buffer == NULL) { return 0; }
+    b->buffer = buffer;
+    b->capacity = capacity;
+  }
+  memcpy(b->buffer + b->length, data, len);
+  b->length += len;
+  return 1;
+}
+
+static inline uint
+push_snapshot_string(
+    struct SnapshotWriter *restrict w,
+    struct SnapshotSlice s,
+    uint32_t *restrict off)
+{
+  if(s.len == 0)
+  {
+    *off = 0;
+    return 1;
+  }
+
+  *off = w->strings.length;
+  return snapshot_buffer_push(&w->strings, s.data, s.len)
+      && snapshot_buffer_push(&w->strings, "", 1);
+}
+
+/* API */
+// identity of the shared object that contains addr: its build-id, or its inode/size/mtime
+// 0 when neither is available, callers should not cache anything then
+static inline uint64_t
+snapshot_key_module(
+    uint64_t h,
+    void const *addr)
+{
+  Dl_info info;
+  if(dladdr(addr, &info) == 0) { return 0; }
+
+  struct SnapshotBuildId id = { .base = (ElfW(Addr))info.dli_fbase };
+  dl_iterate_phdr(snapshot_find_build_id, &id);
+  if(id.len > 0) { return snapshot_hash(h, id.bytes, id.len); }
+
+  struct stat st;
+  if(info.dli_fname == NULL || stat(info.dli_fname, &st) == -1) { return 0; }
+  h = snapshot_hash(h, &st.st_ino, sizeof(st.st_ino));
+  h = snapshot_hash(h, &st.st_size, sizeof(st.st_size));
+  return snapshot_hash(h, &st.st_mtim, sizeof(st.st_mtim));
+}
+
+// the sizes are a first guess, both buffers grow
+static inline uint
+init_snapshot_writer(
+    struct SnapshotWriter *w,
+    uint records_hint,
+    uint strings_hint)
+{
+  memset(w, 0, sizeof(*w));
+  w->records.capacity = records_hint * sizeof(struct SnapshotRecord);
+  w->records.buffer = malloc(Max(w->records.capacity, 1));
+  w->strings.capacity = Max(strings_hint, 1);
+  w->strings.buffer = malloc(w->strings.capacity);
+  // offset 0 is an empty string, unused string slots point at it
+  if(w->records.buffer == NULL || w->strings.buffer == NULL || !snapshot_buffer_push(&w->strings, "", 1))
+  {
+    free(w->records.buffer);
+    free(w->strings.buffer);
+    return 0;
+  }
+  return 1;
+}
+
+static inline void
+deinit_snapshot_writer(
+    struct SnapshotWriter *w)
+{
+  free(w->records.buffer);
+  free(w->strings.buffer);
+  memset(w, 0, sizeof(*w));
+}
+
+static inline uint
+push_snapshot_record(
+    struct SnapshotWriter *restrict w,
+    uint32_t kind,
+    uint32_t type,
+    int64_t integer,
+    struct SnapshotSlice const *restrict strs,
+    uint strs_len)
+{
+  if(strs_len > SNAPSHOT_STRINGS_PER_RECORD) { return 0; }
+
+  struct SnapshotRecord r = { .kind = kind, .type = type, .integer = integer };
+  for(uint i = 0;
+      i < strs_len;
+      i += 1)
+  {
+    if(!push_snapshot_string(w, strs[i], &r.str_off[i])) { return 0; }
+    r.str_len[i] = strs[i].len;
+  }
+  return snapshot_buffer_push(&w->records, &r, sizeof(r));
+}
+
+// mkdir -p of the directory part of path, the cache dir does not exist on a fresh install
+static inline uint
+snapshot_mkdir_parents(
+    char const *path)
+{
+  char dir[PATH_MAX];
+  int len = snprintf(dir, sizeof(dir), "%s", path);
+  if(len < 0 || len >= (int)sizeof(dir)) { return 0; }
+
+  for(int i = 1;
+      i < len;
+      i += 1)
+  {
+    if(dir[i] != '/') { continue; }
+    dir[i] = '\0';
+    if(mkdir(dir, 0755) == -1 && errno != EEXIST) { return 0; }
+    dir[i] = '/';
+  }
+  return 1;
+}
+
+// written next to path first and renamed over it, a reader never sees half a snapshot
+static inline uint
+write_snapshot(
+    struct SnapshotWriter *restrict w,
+    char const *restrict path,
+    uint64_t key)
+{
+  char tmp_path[PATH_MAX];
+  int len = snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+  if(len < 0 || len >= (int)sizeof(tmp_path)) { return 0; }
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd == -1 && errno == ENOENT && snapshot_mkdir_parents(tmp_path))
+  {
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+  if(fd == -1) { return 0; }
+
+  struct SnapshotHeader header = {
+    .magic = SNAPSHOT_MAGIC,
+    .version = SNAPSHOT_VERSION,
+    .key = key,
+    .records_len = w->records.length / sizeof(struct SnapshotRecord),
+    .strings_len = w->strings.length,
+  };
+  bool ok = write(fd, &header, sizeof(header)) == sizeof(header)
+    && write(fd, w->records.buffer, w->records.length) == (ssize_t)w->records.length
+    && write(fd, w->strings.buffer, w->strings.length) == (ssize_t)w->strings.length;
+  ok = close(fd) == 0 && ok;
+
+  if(ok && rename(tmp_path, path) == -1) { ok = false; }
+  if(!ok) { unlink(tmp_path); }
+  return ok;
+}
+
+// maps the snapshot at path, fails on a missing file, a different key or anything malformed
+static inline uint
+open_snapshot(
+    struct Snapshot *restrict s,
+    char const *restrict path,
+    uint64_t key)
+{
+  memset(s, 0, sizeof(*s));
+  if(key == 0) { return 0; }
+
+  // the callers read every record right away, fault the whole file in with the map
+  struct FileView view;
+  if(!open_file_view(&view, path, Fileio_Advice_WillNeed)) { return 0; }
+  if(view.len < sizeof(struct SnapshotHeader))
+  {
+    close_file_view(&view);
+    return 0;
+  }
+
+  struct SnapshotHeader const *header = (struct SnapshotHeader const *)view.data;
+  size_t records_size = (size_t)header->records_len * sizeof(struct SnapshotRecord);
+  bool ok = header->magic == SNAPSHOT_MAGIC
+    && header->version == SNAPSHOT_VERSION
+    && header->key == key
+    && sizeof(*header) + records_size + header->strings_len == view.len;
+
+  struct SnapshotRecord const *records = (struct SnapshotRecord const *)(header + 1);
+  char const *strings = (char const *)records + records_size;
+  for(uint i = 0;
+      ok && i < header->records_len;
+      i += 1)
+  {
+    for(uint j = 0;
+        j < SNAPSHOT_STRINGS_PER_RECORD;
+        j += 1)
+    {
+      uint64_t end = (uint64_t)records[i].str_off[j] + records[i].str_len[j];
+      ok = end < header->strings_len && strings[end] == 0;
+      if(!ok) { break; }
+    }
+  }
+
+  if(!ok)
+  {
+    close_file_view(&view);
+    return 0;
+  }
+
+  s->view = view;
+  s->header = header;
+  s->records = records;
+  s->strings = strings;
+  return 1;
+}
+
+static inline void
+close_snapshot(
+    struct Snapshot *s)
+{
+  close_file_view(&s->view);
+  memset(s, 0, sizeof(*s));
+}
+
+static inline char const *
+snapshot_string(
+    struct Snapshot const *s,
+    struct SnapshotRecord const *r,
+    uint idx)
+{
+  return s->strings + r->str_off[idx];
+}
+#endif
+
+#endif // SNAPSHOT_C
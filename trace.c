@@ -0,0 +1,141 @@
+#ifndef TRACE_C
+#define TRACE_C
+
+// Nested timing spans for the PERFORMANCE build, exported as Chrome `trace_event` json
+// (open it with chrome://tracing or https://ui.perfetto.dev).
+// Span names and categories are not copied, they must outlive the tracer (string literals).
+
+#if defined(__linux__)
+#include <stdio.h>
+
+/* TYPES */
+#define TRACE_EVENTS_MAX 4096
+#define TRACE_DEPTH_MAX 64
+#define TRACE_NONE UINT32_MAX
+
+struct TraceEvent
+{
+  char const *cat;
+  char const *name;
+  char const *arg; // optional, shown as args.arg
+  uint64_t begin_ns;
+  uint64_t end_ns;
+  uint depth;
+};
+
+struct Tracer
+{
+  uint length;
+  uint dropped;
+  uint depth;
+  uint32_t stack[TRACE_DEPTH_MAX];
+  struct TraceEvent events[TRACE_EVENTS_MAX];
+};
+
+/* HELPERS */
+static inline void
+trace_write_json_string(
+    FILE *restrict f,
+    char const *restrict s)
+{
+  fputc('"', f);
+  for(; *s != 0; s += 1)
+  {
+    unsigned char c = *s;
+    if(c == '"' || c == '\\') { fputc('\\', f); fputc(c, f); }
+    else if(c < 0x20) { fprintf(f, "\\u%04x", c); }
+    else { fputc(c, f); }
+  }
+  fputc('"', f);
+}
+
+/* API */
+static inline void
+trace_begin(
+    struct Tracer *restrict t,
+    char const *restrict cat,
+    char const *restrict name,
+    char const *restrict arg)
+{
+  uint32_t idx = TRACE_NONE;
+  if(t->length < TRACE_EVENTS_MAX)
+  {
+    idx = t->length++;
+    t->events[idx] = (struct TraceEvent){
+      .cat = cat,
+      .name = name,
+      .arg = arg,
+      .begin_ns = (uint64_t)now_ns(),
+      .depth = t->depth,
+    };
+  }
+  else
+  {
+    t->dropped += 1;
+  }
+
+  // still track the depth of dropped spans, so their ends stay matched
+  if(t->depth < TRACE_DEPTH_MAX) { t->stack[t->depth] = idx; }
+  t->depth += 1;
+}
+
+static inline void
+trace_end(
+    struct Tracer *t)
+{
+  if(t->depth == 0) { return; } // unbalanced, a lua error jumped over an end
+
+  t->depth -= 1;
+  if(t->depth >= TRACE_DEPTH_MAX) { return; }
+
+  uint32_t idx = t->stack[t->depth];
+  if(idx != TRACE_NONE) { t->events[idx].end_ns = (uint64_t)now_ns(); }
+}
+
+static inline uint64_t
+trace_duration_ns(
+    struct TraceEvent const *e)
+{
+  return e->end_ns > e->begin_ns ? e->end_ns - e->begin_ns : 0;
+}
+
+static inline uint
+write_trace(
+    struct Tracer *restrict t,
+    char const *restrict path)
+{
+  FILE *f = fopen(path, "w");
+  if(f == NULL) { return 0; }
+
+  uint64_t origin = t->length > 0 ? t->events[0].begin_ns : 0;
+  bool first = true;
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+  for(uint i = 0;
+      i < t->length;
+      i += 1)
+  {
+    struct TraceEvent const *e = &t->events[i];
+    if(e->end_ns == 0) { continue; } // never ended
+
+    fputs(first ? "{\"name\":" : ",\n{\"name\":", f);
+    first = false;
+    trace_write_json_string(f, e->name);
+    fputs(",\"cat\":", f);
+    trace_write_json_string(f, e->cat);
+    fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+        (double)(e->begin_ns - origin) / 1000.0, (double)trace_duration_ns(e) / 1000.0);
+    if(e->arg != NULL)
+    {
+      fputs(",\"args\":{\"arg\":", f);
+      trace_write_json_string(f, e->arg);
+      fputc('}', f);
+    }
+    fputc('}', f);
+  }
+  fputs("\n]}\n", f);
+
+  return fclose(f) == 0;
+}
+#endif
+
+#endif // TRACE_C
@@ -0,0 +1,44 @@
+-- Benchmark of <leader>cW (g_trim_trailing_whitespace) against the :%s/\s\+$//e it replaced.
+-- Runs inside nvim with config.so loaded:
+--   nvim --headless -c 'luafile trim_bench.lua' -c 'qa!'
+-- A log-like buffer of 1M lines, one in ten ends in blanks; both must leave the same text.
+
+local trim = _G.g_trim_trailing_whitespace
+assert(trim ~= nil, "config.so is not loaded")
+
+local function log_lines(n)
+  local out = {}
+  math.randomseed(1)
+  for i = 1, n do
+    local line = string.format("2024-01-01T00:00:%02d.%06d INFO worker[%d] request %d done in %dms",
+      i % 60, i, i % 16, i, math.random(1, 999))
+    if i % 10 == 0 then line = line .. string.rep(math.random(2) == 1 and " " or "\t", math.random(1, 40)) end
+    out[i] = line
+  end
+  return out
+end
+
+local function time(f)
+  local t = vim.uv.hrtime()
+  f()
+  return (vim.uv.hrtime() - t) / 1e6
+end
+
+local function run(name, lines, f)
+  local buf = vim.api.nvim_create_buf(true, false)
+  vim.api.nvim_set_current_buf(buf)
+  vim.api.nvim_buf_set_lines(buf, 0, -1, false, lines)
+  local ms = time(f)
+  local out = vim.api.nvim_buf_get_lines(buf, 0, -1, false)
+  print(string.format("%-8s %9.2f ms", name, ms))
+  vim.api.nvim_buf_delete(buf, { force = true })
+  return out
+end
+
+for _, n in ipairs({ 100000, 1000000 }) do
+  local lines = log_lines(n)
+  print(string.format("%d lines", n))
+  local a = run(":%s", lines, function() vim.cmd([[silent keeppatterns %s/\s\+$//e]]) end)
+  local b = run("native", lines, trim)
+  assert(vim.deep_equal(a, b), "the results differ")
+end
@@ -0,0 +1,838 @@
+#ifndef WALK_C
+#define WALK_C
+
+// Every file below a directory, found by a few threads that read directories with getdents64.
+// Each thread owns a deque of directories: it takes the newest one of its own (depth first, warm
+// caches), an idle thread steals the oldest one of another (the biggest subtree). Found paths are
+// relative to the root and collected into batches, the caller takes them while the walk runs.
+// Matches `fd -t f -H -E.git`: regular files only, hidden entries unless !hidden, names in excludes
+// never, and the rules of .gitignore (inside a git repository), .ignore and .fdignore, the ones of
+// the parent directories up to the repository included. Global git excludes are not read.
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* TYPES */
+#define WALK_THREADS_MAX 16
+#define WALK_DENTS_SIZE (32 * 1024)
+#define WALK_BATCH_PATHS 512
+#define WALK_BATCH_BYTES (64 * 1024)
+#define WALK_IGNORE_FILE_MAX (1024 * 1024)
+
+struct WalkOptions
+{
+  bool hidden;
+  bool ignore_files;
+  char const *const *excludes; // entry names, ".git"
+  uint excludes_len;
+};
+
+struct WalkRule
+{
+  char const *pattern;
+  uint len;
+  bool negate;
+  bool dir_only;
+  bool anchored; // has a '/' before its end, matched against the whole path
+};
+
+// the rules of one directory, a directory without ignore files shares its parent's
+struct WalkIgnore
+{
+  struct WalkIgnore const *parent;
+  struct WalkIgnore *next_alloc; // every one is freed with the walk
+  char const *base; // directory of the rules relative to the root, "" for the root and above
+  uint base_len;
+  char const *up; // the root relative to a directory above it ("sub/dir/"), "" inside the root
+  uint up_len;
+  uint rules_len;
+  struct WalkRule *rules;
+  char *text;
+};
+
+struct WalkDir
+{
+  struct WalkIgnore const *ignore;
+  bool git; // inside a git repository, .gitignore only counts then
+  uint path_len; // "" is the root
+  char path[];
+};
+
+struct WalkDeque
+{
+  pthread_mutex_t lock;
+  struct WalkDir **jobs;
+  uint head; // steal here
+  uint tail; // push and pop here
+  uint capacity;
+};
+
+// nul separated paths
+struct WalkBatch
+{
+  struct WalkBatch *next;
+  uint len;
+  uint bytes;
+  char data[WALK_BATCH_BYTES];
+};
+
+struct Walk
+{
+  struct WalkOptions options;
+  int root_fd;
+  uint threads_len;
+  pthread_t threads[WALK_THREADS_MAX];
+  struct WalkDeque deques[WALK_THREADS_MAX];
+
+  atomic_uint pending; // directories queued or being read
+  atomic_uint running; // threads that did not exit yet
+  atomic_bool cancel;
+  atomic_bool starving; // the reader found nothing last time
+
+  pthread_mutex_t lock; // everything below
+  pthread_cond_t found; // batches were added or the last thread is out
+  struct WalkBatch *batches;
+  struct WalkBatch **batches_tail;
+  struct WalkIgnore *ignores;
+  uint files;
+  uint dirs;
+};
+
+struct WalkThread
+{
+  struct Walk *walk;
+  uint id;
+  struct WalkBatch *batch;
+  char dents[WALK_DENTS_SIZE];
+};
+
+struct WalkDent64
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/* HELPERS */
+// gitignore globs: * and ? stop at '/', a "**" between slashes or at an end crosses them
+static bool
+walk_glob(
+    char const *p,
+    char const *p_end,
+    char const *s,
+    char const *s_end)
+{
+  while(p < p_end)
+  {
+    char c = *p;
+    if(c == '*')
+    {
+      bool deep = p + 1 < p_end && p[1] == '*';
+      if(deep)
+      {
+        p += 2;
+        if(p == p_end) { return true; } // "dir/**" or "**"
+        if(*p == '/')
+        {
+          // "**/": zero or more directories
+          p += 1;
+          for(char const *t = s;
+              t <= s_end;
+              t += 1)
+          {
+            if((t == s || t[-1] == '/') && walk_glob(p, p_end, t, s_end)) { return true; }
+          }
+          return false;
+        }
+      }
+      else { p += 1; }
+
+      for(char const *t = s;
+          t <= s_end;
+          t += 1)
+      {
+        if(walk_glob(p, p_end, t, s_end)) { return true; }
+        if(t < s_end && *t == '/' && !deep) { return false; }
+      }
+      return false;
+    }
+
+    if(s == s_end) { return false; }
+    if(c == '?')
+    {
+      if(*s == '/') { return false; }
+    }
+    else if(c == '[')
+    {
+      char const *q = p + 1;
+      bool negate = q < p_end && (*q == '!' || *q == '^');
+      if(negate) { q += 1; }
+      bool hit = false;
+      bool first = true;
+      while(q < p_end && (*q != ']' || first))
+      {
+        char lo = *q, hi = *q;
+        if(q + 2 < p_end && q[1] == '-' && q[2] != ']') { hi = q[2]; q += 2; }
+        if(*s >= lo && *s <= hi) { hit = true; }
+        q += 1;
+        first = false;
+      }
+      if(q == p_end) { return false; } // no ']'
+      if(hit == negate || *s == '/') { return false; }
+      p = q;
+    }
+    else
+    {
+      if(c == '\\' && p + 1 < p_end) { p += 1; c = *p; }
+      if(c != *s) { return false; }
+    }
+    p += 1;
+    s += 1;
+  }
+  return s == s_end;
+}
+
+// parses text in place, false when there is no rule (the caller frees text)
+static inline bool
+walk_parse_ignore(
+    struct WalkIgnore *ig,
+    char *text,
+    uint text_len)
+{
+  uint lines = 1;
+  for(uint i = 0;
+      i < text_len;
+      i += 1)
+  {
+    lines += text[i] == '\n';
+  }
+  ig->rules = malloc(lines * sizeof(*ig->rules));
+  if(ig->rules == NULL) { return false; }
+  ig->rules_len = 0;
+
+  char *line = text;
+  char *end = text + text_len;
+  while(line < end)
+  {
+    char *nl = memchr(line, '\n', end - line);
+    char *line_end = nl == NULL ? end : nl;
+    char *next = nl == NULL ? end : nl + 1;
+
+    if(line_end > line && line_end[-1] == '\r') { line_end -= 1; }
+    // trailing spaces go unless escaped
+    while(line_end > line && line_end[-1] == ' ' && !(line_end - 1 > line && line_end[-2] == '\\')) { line_end -= 1; }
+    if(line_end == line || line[0] == '#') { line = next; continue; }
+
+    struct WalkRule r = {0};
+    if(line[0] == '!') { r.negate = true; line += 1; }
+    else if(line[0] == '\\' && line + 1 < line_end && (line[1] == '!' || line[1] == '#')) { line += 1; }
+    if(line_end > line && line_end[-1] == '/') { r.dir_only = true; line_end -= 1; }
+    if(line_end > line && line[0] == '/') { r.anchored = true; line += 1; }
+    r.anchored = r.anchored || memchr(line, '/', line_end - line) != NULL;
+    r.pattern = line;
+    r.len = line_end - line;
+    if(r.len > 0) { ig->rules[ig->rules_len++] = r; }
+    line = next;
+  }
+  return ig->rules_len > 0;
+}
+
+static inline char *
+walk_read_at(
+    int dir_fd,
+    char const *name,
+    uint *len)
+{
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  if(fd == -1) { return NULL; }
+  long size = get_file_size(fd);
+  char *text = size >= 0 && size <= WALK_IGNORE_FILE_MAX ? malloc(size + 1) : NULL;
+  long got = 0;
+  while(text != NULL && got < size)
+  {
+    ssize_t n = read(fd, text + got, size - got);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n <= 0) { break; }
+    got += n;
+  }
+  close(fd);
+  if(text != NULL) { *len = got; }
+  return text;
+}
+
+// the rules of the ignore files present in a directory (flags from walk_ignore_names), parent when none
+static struct WalkIgnore const *
+walk_load_ignore(
+    struct Walk *w,
+    struct WalkIgnore const *parent,
+    int dir_fd,
+    char const *base,
+    uint base_len,
+    char const *up,
+    uint up_len,
+    uint present)
+{
+  static char const *const names[] = { ".gitignore", ".ignore", ".fdignore" }; // later ones win
+  uint lens[STATIC_ARRAY_SIZE(names)] = {0};
+  char *texts[STATIC_ARRAY_SIZE(names)] = {0};
+  uint total = 0;
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(names);
+      i += 1)
+  {
+    if((present & (1u << i)) == 0) { continue; }
+    texts[i] = walk_read_at(dir_fd, names[i], &lens[i]);
+    if(texts[i] != NULL) { total += lens[i] + 1; }
+  }
+  if(total == 0) { return parent; }
+
+  struct WalkIgnore *ig = malloc(sizeof(*ig) + base_len + up_len + 2);
+  char *text = malloc(total);
+  if(ig == NULL || text == NULL)
+  {
+    free(ig); free(text);
+    for(uint i = 0; i < STATIC_ARRAY_SIZE(names); i += 1) { free(texts[i]); }
+    return parent;
+  }
+  uint text_len = 0;
+  for(uint i = 0;
+      i < STATIC_ARRAY_SIZE(names);
+      i += 1)
+  {
+    if(texts[i] == NULL) { continue; }
+    memcpy(text + text_len, texts[i], lens[i]);
+    text_len += lens[i];
+    text[text_len++] = '\n';
+    free(texts[i]);
+  }
+
+  char *strings = (char *)(ig + 1);
+  memcpy(strings, base, base_len);
+  strings[base_len] = 0;
+  memcpy(strings + base_len + 1, up, up_len);
+  strings[base_len + 1 + up_len] = 0;
+  *ig = (struct WalkIgnore){
+    .parent = parent, .base = strings, .base_len = base_len,
+    .up = strings + base_len + 1, .up_len = up_len, .text = text,
+  };
+  if(!walk_parse_ignore(ig, text, text_len))
+  {
+    free(ig->rules); free(text); free(ig);
+    return parent;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  ig->next_alloc = w->ignores;
+  w->ignores = ig;
+  pthread_mutex_unlock(&w->lock);
+  return ig;
+}
+
+// path is relative to the root, the innermost file with a matching rule decides, in it the last rule
+static inline bool
+walk_ignored(
+    struct WalkIgnore const *ig,
+    char const *path,
+    uint path_len,
+    bool is_dir)
+{
+  char const *name = memrchr(path, '/', path_len);
+  name = name == NULL ? path : name + 1;
+  char const *path_end = path + path_len;
+
+  for(;
+      ig != NULL;
+      ig = ig->parent)
+  {
+    // the path as the ignore file sees it
+    char rel[PATH_MAX];
+    uint skip = ig->base_len > 0 ? ig->base_len + 1 : 0;
+    if(skip > path_len || ig->up_len + path_len - skip >= sizeof(rel)) { continue; }
+    memcpy(rel, ig->up, ig->up_len);
+    memcpy(rel + ig->up_len, path + skip, path_len - skip);
+    uint rel_len = ig->up_len + path_len - skip;
+
+    for(uint i = ig->rules_len;
+        i > 0;
+        i -= 1)
+    {
+      struct WalkRule const *r = &ig->rules[i - 1];
+      if(r->dir_only && !is_dir) { continue; }
+      bool hit = r->anchored
+        ? walk_glob(r->pattern, r->pattern + r->len, rel, rel + rel_len)
+        : walk_glob(r->pattern, r->pattern + r->len, name, path_end);
+      if(hit) { return !r->negate; }
+    }
+  }
+  return false;
+}
+
+// false when out of memory
+static inline bool
+walk_push(
+    struct WalkDeque *d,
+    struct WalkDir *dir)
+{
+  pthread_mutex_lock(&d->lock);
+  if(d->tail == d->capacity)
+  {
+    // slide to the front, grow when that is not enough
+    uint len = d->tail - d->head;
+    if(d->head > 0) { memmove(d->jobs, d->jobs + d->head, len * sizeof(*d->jobs)); }
+    d->head = 0;
+    d->tail = len;
+    if(len * 2 >= d->capacity)
+    {
+      uint capacity = Max(d->capacity * 2, 64);
+      struct WalkDir **jobs = realloc(d->jobs, capacity * sizeof(*jobs));
+      if(jobs != NULL) { d->jobs = jobs; d->capacity = capacity; }
+    }
+  }
+  bool pushed = d->tail < d->capacity;
+  if(pushed) { d->jobs[d->tail++] = dir; }
+  pthread_mutex_unlock(&d->lock);
+  return pushed;
+}
+
+static inline struct WalkDir *
+walk_pop(
+    struct WalkDeque *d,
+    bool steal)
+{
+  pthread_mutex_lock(&d->lock);
+  struct WalkDir *dir = NULL;
+  if(d->head < d->tail) { dir = steal ? d->jobs[d->head++] : d->jobs[--d->tail]; }
+  pthread_mutex_unlock(&d->lock);
+  return dir;
+}
+
+static inline void
+walk_flush(
+    struct WalkThread *t)
+{
+  struct Walk *w = t->walk;
+  if(t->batch == NULL || t->batch->len == 0) { return; }
+  pthread_mutex_lock(&w->lock);
+  *w->batches_tail = t->batch;
+  w->batches_tail = &t->batch->next;
+  w->files += t->batch->len;
+  pthread_cond_broadcast(&w->found);
+  pthread_mutex_unlock(&w->lock);
+  atomic_store_explicit(&w->starving, false, memory_order_relaxed);
+  t->batch = NULL;
+}
+
+static inline void
+walk_emit(
+    struct WalkThread *t,
+    char const *path,
+    uint path_len)
+{
+  if(t->batch != NULL && t->batch->bytes + path_len + 1 > WALK_BATCH_BYTES) { walk_flush(t); }
+  if(t->batch == NULL)
+  {
+    t->batch = malloc(sizeof(*t->batch));
+    if(t->batch == NULL) { return; }
+    t->batch->next = NULL;
+    t->batch->len = 0;
+    t->batch->bytes = 0;
+  }
+  memcpy(t->batch->data + t->batch->bytes, path, path_len);
+  t->batch->data[t->batch->bytes + path_len] = 0;
+  t->batch->bytes += path_len + 1;
+  t->batch->len += 1;
+}
+
+static inline bool
+walk_excluded(
+    struct WalkOptions const *o,
+    char const *name)
+{
+  if(!o->hidden && name[0] == '.') { return true; }
+  for(uint i = 0;
+      i < o->excludes_len;
+      i += 1)
+  {
+    if(strcmp(name, o->excludes[i]) == 0) { return true; }
+  }
+  return false;
+}
+
+static void
+walk_dir(
+    struct WalkThread *t,
+    struct WalkDir *dir)
+{
+  struct Walk *w = t->walk;
+  int fd = openat(w->root_fd, dir->path_len == 0 ? "." : dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(fd == -1) { return; }
+
+  // read every entry first, the ignore files of this directory apply to its own entries
+  char *dents = t->dents;
+  uint dents_len = 0;
+  uint dents_cap = WALK_DENTS_SIZE;
+  for(;;)
+  {
+    if(dents_cap - dents_len < 1024)
+    {
+      char *grown = malloc(dents_cap * 2);
+      if(grown == NULL) { break; }
+      memcpy(grown, dents, dents_len);
+      if(dents != t->dents) { free(dents); }
+      dents = grown;
+      dents_cap *= 2;
+    }
+    long n = syscall(SYS_getdents64, fd, dents + dents_len, dents_cap - dents_len);
+    if(n == -1 && errno == EINTR) { continue; }
+    if(n <= 0) { break; }
+    dents_len += n;
+  }
+
+  uint present = 0;
+  bool git = dir->git;
+  if(w->options.ignore_files)
+  {
+    bool gitignore = false;
+    for(uint off = 0;
+        off < dents_len;
+        off += ((struct WalkDent64 *)(dents + off))->d_reclen)
+    {
+      char const *name = ((struct WalkDent64 *)(dents + off))->d_name;
+      if(name[0] != '.') { continue; }
+      if(strcmp(name, ".git") == 0) { git = true; }
+      else if(strcmp(name, ".gitignore") == 0) { gitignore = true; }
+      else if(strcmp(name, ".ignore") == 0) { present |= 2; }
+      else if(strcmp(name, ".fdignore") == 0) { present |= 4; }
+    }
+    if(gitignore && git) { present |= 1; }
+  }
+  struct WalkIgnore const *ignore = present == 0 ? dir->ignore
+    : walk_load_ignore(w, dir->ignore, fd, dir->path, dir->path_len, "", 0, present);
+
+  char path[PATH_MAX];
+  memcpy(path, dir->path, dir->path_len);
+  uint prefix_len = dir->path_len;
+  if(prefix_len > 0) { path[prefix_len++] = '/'; }
+
+  for(uint off = 0;
+      off < dents_len && !atomic_load_explicit(&w->cancel, memory_order_relaxed);
+      off += ((struct WalkDent64 *)(dents + off))->d_reclen)
+  {
+    struct WalkDent64 const *e = (struct WalkDent64 const *)(dents + off);
+    char const *name = e->d_name;
+    if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) { continue; }
+    if(walk_excluded(&w->options, name)) { continue; }
+
+    uint name_len = strlen(name);
+    if(prefix_len + name_len >= sizeof(path)) { continue; }
+    memcpy(path + prefix_len, name, name_len + 1);
+    uint path_len = prefix_len + name_len;
+
+    unsigned char type = e->d_type;
+    if(type == DT_UNKNOWN)
+    {
+      struct stat st;
+      if(fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) { continue; }
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+    }
+    if(type != DT_DIR && type != DT_REG) { continue; } // -t f, symlinks are not followed
+
+    if(ignore != NULL && walk_ignored(ignore, path, path_len, type == DT_DIR)) { continue; }
+    if(type == DT_REG) { walk_emit(t, path, path_len); continue; }
+
+    struct WalkDir *sub = malloc(sizeof(*sub) + path_len + 1);
+    if(sub == NULL) { continue; }
+    sub->ignore = ignore;
+    sub->git = git;
+    sub->path_len = path_len;
+    memcpy(sub->path, path, path_len + 1);
+    atomic_fetch_add(&w->pending, 1);
+    if(!walk_push(&w->deques[t->id], sub))
+    {
+      // the subtree is lost
+      free(sub);
+      atomic_fetch_sub(&w->pending, 1);
+    }
+  }
+
+  if(dents != t->dents) { free(dents); }
+  close(fd);
+
+  // a reader that has nothing gets what is there, otherwise full batches
+  if(t->batch != NULL && (t->batch->len >= WALK_BATCH_PATHS || atomic_load_explicit(&w->starving, memory_order_relaxed))) { walk_flush(t); }
+}
+
+static void *
+walk_worker(
+    void *data)
+{
+  struct WalkThread *t = data;
+  struct Walk *w = t->walk;
+  uint idle = 0;
+  while(!atomic_load_explicit(&w->cancel, memory_order_relaxed))
+  {
+    struct WalkDir *dir = walk_pop(&w->deques[t->id], false);
+    for(uint i = 1;
+        dir == NULL && i < w->threads_len;
+        i += 1)
+    {
+      dir = walk_pop(&w->deques[(t->id + i) % w->threads_len], true);
+    }
+
+    if(dir == NULL)
+    {
+      if(atomic_load(&w->pending) == 0) { break; }
+      // someone is still reading a directory that may have subdirectories
+      if(++idle < 64) { sched_yield(); }
+      else { usleep(50); }
+      continue;
+    }
+    idle = 0;
+
+    walk_dir(t, dir);
+    free(dir);
+    pthread_mutex_lock(&w->lock);
+    w->dirs += 1;
+    pthread_mutex_unlock(&w->lock);
+    atomic_fetch_sub(&w->pending, 1);
+  }
+
+  walk_flush(t);
+  free(t->batch);
+  free(t);
+  pthread_mutex_lock(&w->lock); // a waiter checks running under it
+  atomic_fetch_sub(&w->running, 1);
+  pthread_cond_broadcast(&w->found);
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+// the ignore files of the directories above root, up to the one holding .git; git when there is one
+static inline struct WalkIgnore const *
+walk_load_parents(
+    struct Walk *w,
+    char const *root,
+    bool *git_out)
+{
+  char dir[PATH_MAX];
+  if(realpath(root, dir) == NULL) { return NULL; }
+  uint dir_len = strlen(dir);
+
+  char const *dirs[64];
+  uint dirs_len[64];
+  uint depth = 0;
+  bool git = false;
+  for(;;)
+  {
+    struct stat st;
+    char probe[PATH_MAX + 8];
+    snprintf(probe, sizeof(probe), "%.*s/.git", (int)dir_len, dir);
+    if(stat(probe, &st) == 0) { git = true; break; }
+    char *slash = memrchr(dir, '/', dir_len);
+    if(slash == NULL || slash == dir || depth == STATIC_ARRAY_SIZE(dirs)) { break; }
+    dir_len = slash - dir;
+    dirs[depth] = dir;
+    dirs_len[depth] = dir_len;
+    depth += 1;
+  }
+  *git_out = git;
+  if(!git) { return NULL; } // .gitignore only counts inside a repository, like fd
+
+  // outermost first, each one sees root as the path below it
+  char real_root[PATH_MAX];
+  if(realpath(root, real_root) == NULL) { return NULL; }
+  uint real_root_len = strlen(real_root);
+  struct WalkIgnore const *ig = NULL;
+  for(uint i = depth;
+      i > 0;
+      i -= 1)
+  {
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%.*s", (int)dirs_len[i - 1], dirs[i - 1]);
+    int fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd == -1) { continue; }
+    char up[PATH_MAX];
+    int up_len = snprintf(up, sizeof(up), "%.*s/", (int)(real_root_len - dirs_len[i - 1] - 1),
+        real_root + dirs_len[i - 1] + 1);
+    if(up_len > 0 && up_len < (int)sizeof(up)) { ig = walk_load_ignore(w, ig, fd, "", 0, up, up_len, 7); }
+    close(fd);
+  }
+  return ig;
+}
+
+/* API */
+static inline void
+free_walk_batches(
+    struct WalkBatch *b)
+{
+  while(b != NULL)
+  {
+    struct WalkBatch *next = b->next;
+    free(b);
+    b = next;
+  }
+}
+
+// waits for the threads
+static inline void
+deinit_walk(
+    struct Walk *w)
+{
+  for(uint i = 0;
+      i < w->threads_len;
+      i += 1)
+  {
+    pthread_join(w->threads[i], NULL);
+  }
+  for(uint i = 0;
+      i < WALK_THREADS_MAX;
+      i += 1)
+  {
+    struct WalkDeque *d = &w->deques[i];
+    for(uint j = d->head;
+        j < d->tail;
+        j += 1)
+    {
+      free(d->jobs[j]);
+    }
+    free(d->jobs);
+    pthread_mutex_destroy(&d->lock);
+  }
+  free_walk_batches(w->batches);
+  while(w->ignores != NULL)
+  {
+    struct WalkIgnore *next = w->ignores->next_alloc;
+    free(w->ignores->rules);
+    free(w->ignores->text);
+    free(w->ignores);
+    w->ignores = next;
+  }
+  if(w->root_fd != -1) { close(w->root_fd); }
+  pthread_cond_destroy(&w->found);
+  pthread_mutex_destroy(&w->lock);
+  memset(w, 0, sizeof(*w));
+  w->root_fd = -1;
+}
+
+// starts the threads and returns, false when root cannot be read
+static inline bool
+start_walk(
+    struct Walk *restrict w,
+    char const *restrict root,
+    struct WalkOptions const *restrict options,
+    uint threads)
+{
+  memset(w, 0, sizeof(*w));
+  w->options = *options;
+  w->batches_tail = &w->batches;
+  atomic_store(&w->starving, true);
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->found, NULL);
+
+  w->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(w->root_fd == -1) { pthread_cond_destroy(&w->found); pthread_mutex_destroy(&w->lock); return false; }
+
+  if(threads == 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = Max(cpus, 1);
+  }
+  w->threads_len = Min(threads, WALK_THREADS_MAX);
+  for(uint i = 0;
+      i < WALK_THREADS_MAX;
+      i += 1)
+  {
+    pthread_mutex_init(&w->deques[i].lock, NULL);
+  }
+
+  struct WalkDir *first = malloc(sizeof(*first) + 1);
+  if(first == NULL) { w->threads_len = 0; deinit_walk(w); return false; }
+  first->git = false;
+  first->ignore = options->ignore_files ? walk_load_parents(w, root, &first->git) : NULL;
+  first->path_len = 0;
+  first->path[0] = 0;
+  atomic_store(&w->pending, 1);
+  if(!walk_push(&w->deques[0], first)) { free(first); w->threads_len = 0; deinit_walk(w); return false; }
+
+  for(uint i = 0;
+      i < w->threads_len;
+      i += 1)
+  {
+    struct WalkThread *t = malloc(sizeof(*t));
+    if(t == NULL) { w->threads_len = i; break; }
+    *t = (struct WalkThread){ .walk = w, .id = i };
+    atomic_fetch_add(&w->running, 1);
+    if(pthread_create(&w->threads[i], NULL, walk_worker, t) != 0)
+    {
+      atomic_fetch_sub(&w->running, 1);
+      free(t);
+      w->threads_len = i;
+      break;
+    }
+  }
+  if(w->threads_len == 0)
+  {
+    // no thread, walk right here
+    struct WalkThread *t = malloc(sizeof(*t));
+    if(t == NULL) { deinit_walk(w); return false; }
+    *t = (struct WalkThread){ .walk = w, .id = 0 };
+    w->threads_len = 1;
+    atomic_fetch_add(&w->running, 1);
+    walk_worker(t);
+    w->threads_len = 0;
+  }
+  return true;
+}
+
+static inline bool
+finished_walk(
+    struct Walk *w)
+{
+  return atomic_load(&w->running) == 0;
+}
+
+// the batches found since the last call, oldest first; free them with free_walk_batches
+static inline struct WalkBatch *
+take_walk(
+    struct Walk *w)
+{
+  pthread_mutex_lock(&w->lock);
+  struct WalkBatch *batches = w->batches;
+  w->batches = NULL;
+  w->batches_tail = &w->batches;
+  pthread_mutex_unlock(&w->lock);
+  if(batches == NULL) { atomic_store_explicit(&w->starving, true, memory_order_relaxed); }
+  return batches;
+}
+
+// sleeps until take_walk has something or the walk is over
+static inline void
+wait_walk(
+    struct Walk *w)
+{
+  pthread_mutex_lock(&w->lock);
+  while(w->batches == NULL && atomic_load(&w->running) > 0) { pthread_cond_wait(&w->found, &w->lock); }
+  pthread_mutex_unlock(&w->lock);
+}
+
+static inline void
+cancel_walk(
+    struct Walk *w)
+{
+  atomic_store(&w->cancel, true);
+}
+
+#endif
+
+#endif // WALK_C
@@ -0,0 +1,107 @@
+// Benchmark of walk.c: time to the first batch and to the last path, single threaded and over the cpus,
+// against `fd -t f -H -E.git` (spawn to the end of its output) when fd is installed.
+// Not part of config.so, build and run it by hand on a big tree:
+//   gcc -std=c23 -O3 -march=native -pthread walk_bench.c -o walk_bench && ./walk_bench ~/src/linux
+
+#define _GNU_SOURCE // clock_gettime, memrchr under -std=c23
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int uint;
+#define Min(x,y) ((x) < (y) ? (x) : (y))
+#define Max(x,y) ((x) > (y) ? (x) : (y))
+#define STATIC_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+#include "fileio.c"
+#include "walk.c"
+
+/* HELPERS */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_nsec;
+}
+
+static void
+bench_walk(
+    char const *root,
+    uint threads)
+{
+  static char const *const excludes[] = { ".git" };
+  struct WalkOptions options = {
+    .hidden = true,
+    .ignore_files = true,
+    .excludes = excludes,
+    .excludes_len = STATIC_ARRAY_SIZE(excludes),
+  };
+
+  // polled like the picker does, only faster
+  uint64_t t0 = bench_now_ns();
+  uint64_t first = 0;
+  uint files = 0;
+  struct Walk w;
+  if(!start_walk(&w, root, &options, threads)) { fprintf(stderr, "cannot read %s\n", root); exit(1); }
+  for(;;)
+  {
+    bool finished = finished_walk(&w);
+    struct WalkBatch *batches = take_walk(&w);
+    for(struct WalkBatch const *b = batches;
+        b != NULL;
+        b = b->next)
+    {
+      if(first == 0) { first = bench_now_ns(); }
+      files += b->len;
+    }
+    free_walk_batches(batches);
+    if(finished) { break; }
+    usleep(200);
+  }
+  uint64_t t1 = bench_now_ns();
+  uint dirs = w.dirs;
+  uint used = w.threads_len;
+  deinit_walk(&w);
+
+  printf("walk.c %2u threads  %8u files %7u dirs  first %8.2f ms  total %8.2f ms\n",
+      used, files, dirs, first == 0 ? 0.0 : (double)(first - t0) / 1e6, (double)(t1 - t0) / 1e6);
+}
+
+static void
+bench_fd(
+    char const *root)
+{
+  char cmd[PATH_MAX + 64];
+  snprintf(cmd, sizeof(cmd), "cd '%s' && fd -t f -H -E.git 2>/dev/null", root);
+
+  uint64_t t0 = bench_now_ns();
+  FILE *p = popen(cmd, "r");
+  if(p == NULL) { return; }
+  uint files = 0;
+  char line[PATH_MAX];
+  while(fgets(line, sizeof(line), p) != NULL) { files += 1; }
+  int status = pclose(p);
+  uint64_t t1 = bench_now_ns();
+  if(status != 0) { printf("fd                  not installed\n"); return; }
+
+  printf("fd                  %8u files                total %8.2f ms\n", files, (double)(t1 - t0) / 1e6);
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+  char const *root = argc > 1 ? argv[1] : ".";
+
+  // the first walk warms the dentry cache for the rest
+  bench_walk(root, 0);
+  bench_walk(root, 1);
+  bench_walk(root, 0);
+  bench_fd(root);
+  return 0;
+}